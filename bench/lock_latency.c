@@ -0,0 +1,703 @@
+/**
+ * @file lock_latency.c
+ * @brief End-to-end lock latency benchmark against a virtual X server.
+ *
+ * Starts Xvfb with one X screen per requested resolution, joined with
+ * Xinerama, then for every run starts a fresh, non-forking (DEBUG build)
+ * lockscreen and measures from the outside:
+ *
+ *   sigusr1_to_map_ms   SIGUSR1 until every lock window is mapped
+ *   map_to_frame_ms     mapped until every screen shows the background
+ *                       (by polling pixels near each corner)
+ *   keypress_to_draw_ms XTest keypress until the password entry changes
+ *   idle_to_lock_ms     the screensaver timeout expiring (idle time driven
+ *                       with XTest and XSetScreenSaver) until mapped
+ *   startup_ms          exec until the control socket answers
+ *   rss_unlocked_kib    resident memory once started
+ *   rss_locked_kib      resident memory while locked, after the keypress
+ *
+ * Running it against two builds (e.g. the default one and a static profile)
+ * compares their start time and footprint; "--skip-idle" leaves out the idle
+ * lock for builds without idle support.
+ * Results are written as JSON so lock latency can be compared between
+ * releases without real hardware:
+ *
+ *   lock-latency --daemon ./minimalist-lockscreen-debug \
+ *                --screens 1920x1080,1280x1024 --runs 10 --output out.json
+ */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/Xinerama.h>
+#include <X11/extensions/dpms.h>
+#include <X11/keysym.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define MAX_SCREENS 16
+static const int MAX_RUNS = 1000;
+/* Background the daemon is started with, and its 24-bit pixel value. */
+static const char *const BENCH_COLOR = "#336699";
+static const unsigned long BENCH_PIXEL = 0x336699;
+/* Distance from each screen corner of the pixels that are polled. */
+static const int SAMPLE_INSET = 4;
+static const int64_t STARTUP_TIMEOUT_NS = 10000000000LL;
+static const int64_t STEP_TIMEOUT_NS = 5000000000LL;
+static const int64_t POLL_INTERVAL_NS = 500000LL;
+/* Screensaver timeout used for the idle measurement, in seconds. */
+static const int IDLE_TIMEOUT_S = 2;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Samples of one measurement, in the unit its name ends with.
+ */
+struct Metric {
+  const char *name;
+  double *samples;
+  int count;
+  int failures;
+};
+
+enum MetricIndex {
+  METRIC_SIGUSR1_TO_MAP,
+  METRIC_MAP_TO_FRAME,
+  METRIC_KEYPRESS_TO_DRAW,
+  METRIC_IDLE_TO_LOCK,
+  METRIC_STARTUP,
+  METRIC_RSS_UNLOCKED,
+  METRIC_RSS_LOCKED,
+  METRIC_COUNT
+};
+
+/**
+ * @brief Benchmark parameters, from the command line.
+ */
+struct BenchConfig {
+  const char *daemon;
+  const char *xvfb;
+  const char *display;
+  const char *screens;
+  const char *output;
+  int runs;
+  int verbose;
+  int skip_idle;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct BenchConfig g_config = {
+    .daemon = NULL,
+    .xvfb = "Xvfb",
+    .display = ":99",
+    .screens = "1920x1080",
+    .output = NULL,
+    .runs = 5,
+    .verbose = 0,
+    .skip_idle = 0,
+};
+static struct Metric g_metrics[METRIC_COUNT] = {
+    {"sigusr1_to_map_ms", NULL, 0, 0},
+    {"map_to_frame_ms", NULL, 0, 0},
+    {"keypress_to_draw_ms", NULL, 0, 0},
+    {"idle_to_lock_ms", NULL, 0, 0},
+    {"startup_ms", NULL, 0, 0},
+    {"rss_unlocked_kib", NULL, 0, 0},
+    {"rss_locked_kib", NULL, 0, 0},
+};
+static XineramaScreenInfo *g_screens = NULL;
+static int g_screen_count = 0;
+static char g_work_dir[] = "/tmp/lock-latency-XXXXXX";
+static char g_socket_path[128];
+static pid_t g_xvfb_pid = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ns(int64_t ns) {
+  struct timespec ts = {.tv_sec = ns / 1000000000LL,
+                        .tv_nsec = ns % 1000000000LL};
+  nanosleep(&ts, NULL);
+}
+
+static void record(enum MetricIndex index, int64_t start_ns, int64_t end_ns) {
+  struct Metric *metric = &g_metrics[index];
+  if (start_ns < 0 || end_ns < 0) {
+    metric->failures++;
+    return;
+  }
+  metric->samples[metric->count++] = (double)(end_ns - start_ns) / 1e6;
+}
+
+/**
+ * @brief Records a sample that is not a time interval; negative for a
+ *        failure.
+ */
+static void record_value(enum MetricIndex index, double value) {
+  struct Metric *metric = &g_metrics[index];
+  if (value < 0) {
+    metric->failures++;
+    return;
+  }
+  metric->samples[metric->count++] = value;
+}
+
+/**
+ * @brief Reads a process's resident set size from /proc.
+ *
+ * @return VmRSS in KiB, or -1 if unavailable.
+ */
+static double resident_kib(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return -1;
+  }
+  char line[128];
+  double kib = -1;
+  while (fgets(line, sizeof(line), file)) {
+    long value;
+    if (sscanf(line, "VmRSS: %ld kB", &value) == 1) {
+      kib = (double)value;
+      break;
+    }
+  }
+  fclose(file);
+  return kib;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s --daemon PATH [--screens WxH[,WxH...]] [--runs N]\n"
+          "          [--display :N] [--xvfb PATH] [--output FILE] "
+          "[--skip-idle]\n          [--verbose]\n",
+          program);
+}
+
+static int parse_command_line(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (strcmp(argv[i], "--verbose") == 0) {
+      g_config.verbose = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--skip-idle") == 0) {
+      g_config.skip_idle = 1;
+      continue;
+    }
+    if (!value) {
+      return -1;
+    }
+    if (strcmp(argv[i], "--daemon") == 0) {
+      g_config.daemon = value;
+    } else if (strcmp(argv[i], "--xvfb") == 0) {
+      g_config.xvfb = value;
+    } else if (strcmp(argv[i], "--display") == 0) {
+      g_config.display = value;
+    } else if (strcmp(argv[i], "--screens") == 0) {
+      g_config.screens = value;
+    } else if (strcmp(argv[i], "--output") == 0) {
+      g_config.output = value;
+    } else if (strcmp(argv[i], "--runs") == 0) {
+      g_config.runs = atoi(value);
+    } else {
+      return -1;
+    }
+    i++;
+  }
+  if (!g_config.daemon || g_config.runs < 1 || g_config.runs > MAX_RUNS) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Starts Xvfb with one X screen per entry of --screens and Xinerama
+ *        enabled, and waits until it accepts connections.
+ *
+ * @return The connection, or NULL on failure.
+ */
+static Display *start_xvfb(void) {
+  char *argv[6 + 3 * MAX_SCREENS];
+  char geometries[MAX_SCREENS][32];
+  char numbers[MAX_SCREENS][8];
+  int argc = 0;
+  argv[argc++] = (char *)g_config.xvfb;
+  argv[argc++] = (char *)g_config.display;
+  argv[argc++] = "+xinerama";
+  argv[argc++] = "-nolisten";
+  argv[argc++] = "tcp";
+
+  const char *start = g_config.screens;
+  int screens = 0;
+  while (*start != '\0' && screens < MAX_SCREENS) {
+    int width, height;
+    if (sscanf(start, "%dx%d", &width, &height) != 2) {
+      fprintf(stderr, "Invalid screen size: %s\n", start);
+      return NULL;
+    }
+    snprintf(numbers[screens], sizeof(numbers[screens]), "%d", screens);
+    snprintf(geometries[screens], sizeof(geometries[screens]), "%dx%dx24",
+             width, height);
+    argv[argc++] = "-screen";
+    argv[argc++] = numbers[screens];
+    argv[argc++] = geometries[screens];
+    screens++;
+    start += strcspn(start, ",");
+    if (*start == ',') {
+      start++;
+    }
+  }
+  argv[argc] = NULL;
+
+  g_xvfb_pid = fork();
+  if (g_xvfb_pid < 0) {
+    perror("fork");
+    return NULL;
+  }
+  if (g_xvfb_pid == 0) {
+    if (!g_config.verbose) {
+      int null_fd = open("/dev/null", O_WRONLY);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+    }
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+
+  int64_t deadline = monotonic_ns() + STARTUP_TIMEOUT_NS;
+  while (monotonic_ns() < deadline) {
+    Display *display = XOpenDisplay(g_config.display);
+    if (display) {
+      return display;
+    }
+    if (waitpid(g_xvfb_pid, NULL, WNOHANG) == g_xvfb_pid) {
+      break;
+    }
+    sleep_ns(10000000LL);
+  }
+  fprintf(stderr, "Xvfb did not start on %s.\n", g_config.display);
+  return NULL;
+}
+
+/**
+ * @brief Sends one command to the daemon's control socket.
+ *
+ * @return 0 if it answered, -1 otherwise.
+ */
+static int control_command(const char *command) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", g_socket_path);
+  int ok = fd >= 0 &&
+           connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+
+  char line[64];
+  snprintf(line, sizeof(line), "%s\n", command);
+  ok = ok && send(fd, line, strlen(line), MSG_NOSIGNAL) > 0;
+  ok = ok && recv(fd, line, sizeof(line), 0) > 0;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief Starts the lockscreen on the virtual display and waits until it
+ *        answers on its control socket, i.e. its signal handlers are set.
+ *
+ * @return Its pid, or -1 on failure.
+ */
+static pid_t start_daemon(void) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    char config_path[160];
+    snprintf(config_path, sizeof(config_path), "%s/config", g_work_dir);
+    setenv("DISPLAY", g_config.display, 1);
+    if (!g_config.verbose) {
+      int null_fd = open("/dev/null", O_WRONLY);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+    }
+    execl(g_config.daemon, g_config.daemon, "--color", BENCH_COLOR,
+          "--config", config_path, "--socket", g_socket_path, (char *)NULL);
+    _exit(127);
+  }
+
+  int64_t deadline = monotonic_ns() + STARTUP_TIMEOUT_NS;
+  while (monotonic_ns() < deadline) {
+    if (control_command("status") == 0) {
+      return pid;
+    }
+    if (waitpid(pid, NULL, WNOHANG) == pid) {
+      fprintf(stderr, "The lockscreen exited during startup.\n");
+      return -1;
+    }
+    sleep_ns(5000000LL);
+  }
+  fprintf(stderr, "The lockscreen did not start.\n");
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  return -1;
+}
+
+static void stop_daemon(pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+/**
+ * @brief Waits until one window per Xinerama screen has been mapped.
+ *
+ * @return When the last one was mapped, or -1 on timeout.
+ */
+static int64_t wait_for_windows(Display *display) {
+  int mapped = 0;
+  int64_t deadline = monotonic_ns() + STEP_TIMEOUT_NS;
+  while (mapped < g_screen_count) {
+    while (XPending(display)) {
+      XEvent event;
+      XNextEvent(display, &event);
+      if (event.type == MapNotify) {
+        mapped++;
+      }
+    }
+    if (mapped >= g_screen_count) {
+      break;
+    }
+    int64_t now = monotonic_ns();
+    if (now >= deadline) {
+      return -1;
+    }
+    struct pollfd pfd = {.fd = ConnectionNumber(display), .events = POLLIN};
+    poll(&pfd, 1, (int)((deadline - now) / 1000000LL) + 1);
+  }
+  return monotonic_ns();
+}
+
+static unsigned long read_pixel(Display *display, int x, int y) {
+  XImage *image = XGetImage(display, DefaultRootWindow(display), x, y, 1, 1,
+                            AllPlanes, ZPixmap);
+  if (!image) {
+    return 0;
+  }
+  unsigned long pixel = XGetPixel(image, 0, 0) & 0xffffff;
+  XDestroyImage(image);
+  return pixel;
+}
+
+/**
+ * @brief Checks that every screen shows the background near all four
+ *        corners.
+ */
+static int screens_covered(Display *display) {
+  for (int i = 0; i < g_screen_count; i++) {
+    const XineramaScreenInfo *screen = &g_screens[i];
+    int left = screen->x_org + SAMPLE_INSET;
+    int top = screen->y_org + SAMPLE_INSET;
+    int right = screen->x_org + screen->width - 1 - SAMPLE_INSET;
+    int bottom = screen->y_org + screen->height - 1 - SAMPLE_INSET;
+    if (read_pixel(display, left, top) != BENCH_PIXEL ||
+        read_pixel(display, right, top) != BENCH_PIXEL ||
+        read_pixel(display, left, bottom) != BENCH_PIXEL ||
+        read_pixel(display, right, bottom) != BENCH_PIXEL) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Waits until every screen shows the lock's background.
+ *
+ * @return When it did, or -1 on timeout.
+ */
+static int64_t wait_for_frame(Display *display) {
+  int64_t deadline = monotonic_ns() + STEP_TIMEOUT_NS;
+  while (monotonic_ns() < deadline) {
+    if (screens_covered(display)) {
+      return monotonic_ns();
+    }
+    sleep_ns(POLL_INTERVAL_NS);
+  }
+  return -1;
+}
+
+/**
+ * @brief Grabs the middle of the first screen, where the password entry is
+ *        drawn.
+ */
+static XImage *capture_entry(Display *display) {
+  const XineramaScreenInfo *screen = &g_screens[0];
+  return XGetImage(display, DefaultRootWindow(display),
+                   screen->x_org + screen->width / 4,
+                   screen->y_org + screen->height * 3 / 8, screen->width / 2,
+                   screen->height / 4, AllPlanes, ZPixmap);
+}
+
+/**
+ * @brief Types one character and waits until the password entry changes.
+ *
+ * @return When it changed, or -1 on timeout.
+ */
+static int64_t measure_keypress(Display *display, int64_t *pressed_ns) {
+  XImage *before = capture_entry(display);
+  if (!before) {
+    return -1;
+  }
+  size_t size = (size_t)before->bytes_per_line * (size_t)before->height;
+  KeyCode key = XKeysymToKeycode(display, XK_a);
+
+  *pressed_ns = monotonic_ns();
+  XTestFakeKeyEvent(display, key, True, CurrentTime);
+  XTestFakeKeyEvent(display, key, False, CurrentTime);
+  XFlush(display);
+
+  int64_t changed_ns = -1;
+  int64_t deadline = *pressed_ns + STEP_TIMEOUT_NS;
+  while (changed_ns < 0 && monotonic_ns() < deadline) {
+    XImage *after = capture_entry(display);
+    if (after) {
+      if (memcmp(before->data, after->data, size) != 0) {
+        changed_ns = monotonic_ns();
+      }
+      XDestroyImage(after);
+    }
+    if (changed_ns < 0) {
+      sleep_ns(POLL_INTERVAL_NS);
+    }
+  }
+  XDestroyImage(before);
+  return changed_ns;
+}
+
+/**
+ * @brief Configures the screensaver timeout the daemon reads at startup.
+ *        The daemon only locks on idle while DPMS is enabled.
+ */
+static void set_idle_timeout(Display *display, int timeout) {
+  XSetScreenSaver(display, timeout, 0, DontPreferBlanking, AllowExposures);
+  int event_base, error_base;
+  if (DPMSQueryExtension(display, &event_base, &error_base)) {
+    if (timeout > 0) {
+      DPMSEnable(display);
+    } else {
+      DPMSDisable(display);
+    }
+  }
+  XSync(display, False);
+}
+
+/**
+ * @brief One lock triggered with SIGUSR1: map, first frame, keypress.
+ */
+static void run_signal_lock(Display *display) {
+  set_idle_timeout(display, 0);
+  int64_t started_ns = monotonic_ns();
+  pid_t pid = start_daemon();
+  if (pid < 0) {
+    record(METRIC_STARTUP, -1, -1);
+    record_value(METRIC_RSS_UNLOCKED, -1);
+    record(METRIC_SIGUSR1_TO_MAP, -1, -1);
+    record(METRIC_MAP_TO_FRAME, -1, -1);
+    record(METRIC_KEYPRESS_TO_DRAW, -1, -1);
+    record_value(METRIC_RSS_LOCKED, -1);
+    return;
+  }
+  record(METRIC_STARTUP, started_ns, monotonic_ns());
+  record_value(METRIC_RSS_UNLOCKED, resident_kib(pid));
+  XSync(display, True);
+
+  int64_t signalled_ns = monotonic_ns();
+  kill(pid, SIGUSR1);
+  int64_t mapped_ns = wait_for_windows(display);
+  int64_t framed_ns = (mapped_ns < 0) ? -1 : wait_for_frame(display);
+  record(METRIC_SIGUSR1_TO_MAP, signalled_ns, mapped_ns);
+  record(METRIC_MAP_TO_FRAME, mapped_ns, framed_ns);
+
+  int64_t pressed_ns = -1;
+  int64_t drawn_ns =
+      (framed_ns < 0) ? -1 : measure_keypress(display, &pressed_ns);
+  record(METRIC_KEYPRESS_TO_DRAW, pressed_ns, drawn_ns);
+  record_value(METRIC_RSS_LOCKED, drawn_ns < 0 ? -1 : resident_kib(pid));
+
+  stop_daemon(pid);
+}
+
+/**
+ * @brief One lock triggered by the screensaver timeout expiring.
+ */
+static void run_idle_lock(Display *display) {
+  set_idle_timeout(display, IDLE_TIMEOUT_S);
+  pid_t pid = start_daemon();
+  if (pid < 0) {
+    record(METRIC_IDLE_TO_LOCK, -1, -1);
+    set_idle_timeout(display, 0);
+    return;
+  }
+  XSync(display, True);
+
+  /* The idle timer restarts with this motion. */
+  XTestFakeMotionEvent(display, 0, g_screens[0].x_org + 1,
+                       g_screens[0].y_org + 1, CurrentTime);
+  XSync(display, False);
+  int64_t expired_ns = monotonic_ns() + IDLE_TIMEOUT_S * 1000000000LL;
+
+  int64_t deadline = expired_ns + STEP_TIMEOUT_NS;
+  int64_t mapped_ns = -1;
+  while (mapped_ns < 0 && monotonic_ns() < deadline) {
+    mapped_ns = wait_for_windows(display);
+  }
+  record(METRIC_IDLE_TO_LOCK, expired_ns, mapped_ns);
+
+  stop_daemon(pid);
+  set_idle_timeout(display, 0);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void write_metric(FILE *out, const struct Metric *metric, int last) {
+  qsort(metric->samples, (size_t)metric->count, sizeof(double),
+        compare_doubles);
+  fprintf(out, "    \"%s\": {\"failures\": %d, \"samples\": [", metric->name,
+          metric->failures);
+  for (int i = 0; i < metric->count; i++) {
+    fprintf(out, "%s%.3f", i ? ", " : "", metric->samples[i]);
+  }
+  fprintf(out, "]");
+  if (metric->count > 0) {
+    double sum = 0.0;
+    for (int i = 0; i < metric->count; i++) {
+      sum += metric->samples[i];
+    }
+    fprintf(out,
+            ", \"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, "
+            "\"max\": %.3f",
+            metric->samples[0], metric->samples[metric->count / 2],
+            sum / metric->count, metric->samples[metric->count - 1]);
+  }
+  fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+static void write_results(FILE *out) {
+  fprintf(out, "{\n  \"display\": \"%s\",\n  \"runs\": %d,\n",
+          g_config.display, g_config.runs);
+  fprintf(out, "  \"screens\": [");
+  for (int i = 0; i < g_screen_count; i++) {
+    fprintf(out, "%s{\"x\": %d, \"y\": %d, \"width\": %d, \"height\": %d}",
+            i ? ", " : "", g_screens[i].x_org, g_screens[i].y_org,
+            g_screens[i].width, g_screens[i].height);
+  }
+  fprintf(out, "],\n  \"metrics\": {\n");
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    write_metric(out, &g_metrics[i], i == METRIC_COUNT - 1);
+  }
+  fprintf(out, "  }\n}\n");
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[]) {
+  if (parse_command_line(argc, argv) != 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!mkdtemp(g_work_dir)) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  snprintf(g_socket_path, sizeof(g_socket_path), "%s/control.sock",
+           g_work_dir);
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    g_metrics[i].samples = calloc((size_t)g_config.runs, sizeof(double));
+  }
+
+  Display *display = start_xvfb();
+  if (!display) {
+    rmdir(g_work_dir);
+    return EXIT_FAILURE;
+  }
+  int event_base, error_base, major, minor;
+  if (!XTestQueryExtension(display, &event_base, &error_base, &major,
+                           &minor)) {
+    fprintf(stderr, "Xvfb lacks the XTEST extension.\n");
+  }
+  g_screens = XineramaQueryScreens(display, &g_screen_count);
+  if (!g_screens || g_screen_count == 0) {
+    fprintf(stderr, "Xinerama is not active on %s.\n", g_config.display);
+    kill(g_xvfb_pid, SIGTERM);
+    waitpid(g_xvfb_pid, NULL, 0);
+    rmdir(g_work_dir);
+    return EXIT_FAILURE;
+  }
+  XSelectInput(display, DefaultRootWindow(display), SubstructureNotifyMask);
+
+  for (int run = 0; run < g_config.runs; run++) {
+    run_signal_lock(display);
+    if (!g_config.skip_idle) {
+      run_idle_lock(display);
+    }
+  }
+
+  FILE *out = g_config.output ? fopen(g_config.output, "w") : stdout;
+  if (!out) {
+    perror(g_config.output);
+    out = stdout;
+  }
+  write_results(out);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  int failed = 0;
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    failed |= g_metrics[i].failures > 0;
+    free(g_metrics[i].samples);
+  }
+  XFree(g_screens);
+  XCloseDisplay(display);
+  kill(g_xvfb_pid, SIGTERM);
+  waitpid(g_xvfb_pid, NULL, 0);
+  unlink(g_socket_path);
+  rmdir(g_work_dir);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,395 @@
+/**
+ * @file mpris_watch.c
+ * @brief MPRIS watcher benchmark against a mock media player.
+ *
+ * Runs the lockscreen's own mpris_watch_loop() on the session bus next to a
+ * mock player (a second connection owning org.mpris.MediaPlayer2.bench) and
+ * measures how long the cached "a player is playing" flag takes to follow:
+ *
+ *   appear_ms       the player taking its name while playing
+ *   toggle_ms       PropertiesChanged carrying the new PlaybackStatus
+ *   invalidate_ms   PropertiesChanged only invalidating it, so the watcher
+ *                   has to ask the player
+ *   vanish_ms       the player dropping its name while playing
+ *
+ * A change the flag does not follow within a second counts as missed and
+ * fails the run. Meant for a private bus; results are written as JSON:
+ *
+ *   dbus-run-session -- mpris-watch --runs 100 --output mpris-watch.json
+ */
+
+#include "mpris.h"
+#include <dbus/dbus.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const char *const PLAYER_NAME = "org.mpris.MediaPlayer2.bench";
+static const char *const PLAYER_PATH = "/org/mpris/MediaPlayer2";
+static const char *const PLAYER_IFACE = "org.mpris.MediaPlayer2.Player";
+static const char *const PROPERTIES_IFACE = "org.freedesktop.DBus.Properties";
+static const int64_t FOLLOW_TIMEOUT_NS = 1000000000LL;
+static const useconds_t FOLLOW_POLL_US = 50;
+/* Sends to the player wait behind its dispatch for up to this long. */
+static const int SERVE_TIMEOUT_MS = 1;
+static const int MAX_RUNS = 100000;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Samples of one measurement.
+ */
+struct Metric {
+  const char *name;
+  double *samples;
+  int count;
+};
+
+enum MetricIndex {
+  METRIC_APPEAR,
+  METRIC_TOGGLE,
+  METRIC_INVALIDATE,
+  METRIC_VANISH,
+  METRIC_COUNT
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static int g_runs = 50;
+static const char *g_output = NULL;
+static struct Metric g_metrics[METRIC_COUNT] = {
+    {"appear_ms", NULL, 0},
+    {"toggle_ms", NULL, 0},
+    {"invalidate_ms", NULL, 0},
+    {"vanish_ms", NULL, 0},
+};
+static int g_capacity = 0; /* Samples each metric has room for. */
+
+/* The mock player: its connection, its status and the thread serving it. */
+static DBusConnection *g_player = NULL;
+static atomic_int g_playing = 0;
+static atomic_int g_serving = 1;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void record(enum MetricIndex index, double value) {
+  struct Metric *metric = &g_metrics[index];
+  if (metric->count < g_capacity) {
+    metric->samples[metric->count++] = value;
+  }
+}
+
+static int parse_command_line(int argc, char *argv[]) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], "--runs") == 0) {
+      g_runs = atoi(value);
+    } else if (strcmp(argv[i], "--output") == 0) {
+      g_output = value;
+    } else {
+      return -1;
+    }
+  }
+  return (argc % 2 == 1 && g_runs > 0 && g_runs <= MAX_RUNS) ? 0 : -1;
+}
+
+static const char *playback_status(void) {
+  return atomic_load(&g_playing) ? "Playing" : "Paused";
+}
+
+/**
+ * @brief Answers Properties.Get(PlaybackStatus) for the mock player.
+ */
+static DBusHandlerResult
+handle_player_call(DBusConnection *conn, DBusMessage *msg,
+                   void *data __attribute__((unused))) {
+  if (!dbus_message_is_method_call(msg, PROPERTIES_IFACE, "Get")) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+  DBusMessage *reply = dbus_message_new_method_return(msg);
+  if (!reply) {
+    return DBUS_HANDLER_RESULT_NEED_MEMORY;
+  }
+  const char *status = playback_status();
+  DBusMessageIter iter;
+  DBusMessageIter variant;
+  dbus_message_iter_init_append(reply, &iter);
+  dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT,
+                                   DBUS_TYPE_STRING_AS_STRING, &variant);
+  dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &status);
+  dbus_message_iter_close_container(&iter, &variant);
+  dbus_connection_send(conn, reply, NULL);
+  dbus_message_unref(reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/**
+ * @brief Thread function that answers the watcher's calls to the player.
+ *
+ * The main thread only ever sends on the player connection without waiting
+ * for replies, so this thread is the only one reading from it.
+ */
+static void *serve_player_loop(void *arg __attribute__((unused))) {
+  while (atomic_load(&g_serving) &&
+         dbus_connection_read_write_dispatch(g_player, SERVE_TIMEOUT_MS)) {
+  }
+  return NULL;
+}
+
+/**
+ * @brief Asks the bus daemon to give the player its well-known name, or to
+ *        take it away. The reply is not waited for; the watcher sees the
+ *        change as NameOwnerChanged.
+ */
+static void set_player_name(int owned) {
+  DBusMessage *msg = dbus_message_new_method_call(
+      DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS,
+      owned ? "RequestName" : "ReleaseName");
+  if (!msg) {
+    return;
+  }
+  if (owned) {
+    dbus_uint32_t flags = DBUS_NAME_FLAG_DO_NOT_QUEUE;
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &PLAYER_NAME,
+                             DBUS_TYPE_UINT32, &flags, DBUS_TYPE_INVALID);
+  } else {
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &PLAYER_NAME,
+                             DBUS_TYPE_INVALID);
+  }
+  dbus_message_set_no_reply(msg, TRUE);
+  dbus_connection_send(g_player, msg, NULL);
+  dbus_connection_flush(g_player);
+  dbus_message_unref(msg);
+}
+
+/**
+ * @brief Emits PropertiesChanged for the player's PlaybackStatus, either
+ *        with the new value or only naming it as invalidated.
+ */
+static void emit_properties_changed(int with_value) {
+  DBusMessage *msg = dbus_message_new_signal(PLAYER_PATH, PROPERTIES_IFACE,
+                                             "PropertiesChanged");
+  if (!msg) {
+    return;
+  }
+  const char *property = "PlaybackStatus";
+  const char *status = playback_status();
+  DBusMessageIter iter;
+  DBusMessageIter changed;
+  DBusMessageIter entry;
+  DBusMessageIter variant;
+  DBusMessageIter invalidated;
+  dbus_message_iter_init_append(msg, &iter);
+  dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &PLAYER_IFACE);
+
+  dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &changed);
+  if (with_value) {
+    dbus_message_iter_open_container(&changed, DBUS_TYPE_DICT_ENTRY, NULL,
+                                     &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &property);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+                                     DBUS_TYPE_STRING_AS_STRING, &variant);
+    dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &status);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(&changed, &entry);
+  }
+  dbus_message_iter_close_container(&iter, &changed);
+
+  dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                                   DBUS_TYPE_STRING_AS_STRING, &invalidated);
+  if (!with_value) {
+    dbus_message_iter_append_basic(&invalidated, DBUS_TYPE_STRING, &property);
+  }
+  dbus_message_iter_close_container(&iter, &invalidated);
+
+  dbus_connection_send(g_player, msg, NULL);
+  dbus_connection_flush(g_player);
+  dbus_message_unref(msg);
+}
+
+/**
+ * @brief Waits for the watcher's flag to reach the expected value.
+ *
+ * @param start_ns When the change was sent.
+ * @return Milliseconds it took, or -1 if it did not follow in time.
+ */
+static double wait_for_flag(int expected, int64_t start_ns) {
+  while (mpris_player_playing() != expected) {
+    if (monotonic_ns() - start_ns > FOLLOW_TIMEOUT_NS) {
+      return -1.0;
+    }
+    usleep(FOLLOW_POLL_US);
+  }
+  return (double)(monotonic_ns() - start_ns) / 1e6;
+}
+
+/**
+ * @brief Sets the player's status and publishes it, recording how long the
+ *        watcher took to follow.
+ *
+ * @return 1 if the watcher missed the change, 0 otherwise.
+ */
+static int measure_change(enum MetricIndex index, int playing,
+                          int with_value) {
+  atomic_store(&g_playing, playing);
+  int64_t start_ns = monotonic_ns();
+  emit_properties_changed(with_value);
+  double ms = wait_for_flag(playing, start_ns);
+  if (ms < 0) {
+    return 1;
+  }
+  record(index, ms);
+  return 0;
+}
+
+/**
+ * @brief Gives the player its name (playing) or takes it away, recording
+ *        how long the watcher took to notice.
+ *
+ * @return 1 if the watcher missed the change, 0 otherwise.
+ */
+static int measure_name(enum MetricIndex index, int owned) {
+  atomic_store(&g_playing, 1);
+  int64_t start_ns = monotonic_ns();
+  set_player_name(owned);
+  double ms = wait_for_flag(owned, start_ns);
+  if (ms < 0) {
+    return 1;
+  }
+  record(index, ms);
+  return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void write_metric(FILE *out, struct Metric *metric) {
+  qsort(metric->samples, (size_t)metric->count, sizeof(double),
+        compare_doubles);
+  fprintf(out, "    \"%s\": {\"count\": %d", metric->name, metric->count);
+  if (metric->count > 0) {
+    double sum = 0.0;
+    for (int i = 0; i < metric->count; i++) {
+      sum += metric->samples[i];
+    }
+    fprintf(out,
+            ", \"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, "
+            "\"mean\": %.3f, \"max\": %.3f",
+            metric->samples[0], metric->samples[metric->count / 2],
+            metric->samples[(metric->count * 99) / 100], sum / metric->count,
+            metric->samples[metric->count - 1]);
+  }
+  fprintf(out, "}");
+}
+
+/* ------------------------------------------------------------------------- */
+/* Main                                                                      */
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[]) {
+  if (parse_command_line(argc, argv) != 0) {
+    fprintf(stderr, "Usage: %s [--runs N] [--output FILE]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!dbus_threads_init_default()) {
+    fprintf(stderr, "Failed to initialize D-Bus threading.\n");
+    return EXIT_FAILURE;
+  }
+
+  DBusError err;
+  dbus_error_init(&err);
+  g_player = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+  if (!g_player) {
+    fprintf(stderr, "No session bus: %s\n", err.message);
+    dbus_error_free(&err);
+    return EXIT_FAILURE;
+  }
+  dbus_connection_set_exit_on_disconnect(g_player, FALSE);
+  DBusObjectPathVTable vtable = {.message_function = handle_player_call};
+  dbus_connection_register_object_path(g_player, PLAYER_PATH, &vtable, NULL);
+
+  /* Room for every sample; toggles and invalidations happen twice a run. */
+  g_capacity = 2 * g_runs;
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    g_metrics[i].samples = calloc((size_t)g_capacity, sizeof(double));
+    if (!g_metrics[i].samples) {
+      g_capacity = 0;
+    }
+  }
+
+  pthread_t serve_thread;
+  pthread_t watch_thread;
+  pthread_create(&serve_thread, NULL, serve_player_loop, NULL);
+
+  /*
+   * The watcher subscribes before it scans the bus, so once its scan has
+   * found an already playing player it cannot miss any later change.
+   */
+  atomic_store(&g_playing, 1);
+  set_player_name(1);
+  pthread_create(&watch_thread, NULL, mpris_watch_loop, NULL);
+  int missed = wait_for_flag(1, monotonic_ns()) < 0;
+  missed += measure_name(METRIC_VANISH, 0);
+
+  for (int run = 0; run < g_runs && !missed; run++) {
+    missed += measure_name(METRIC_APPEAR, 1);
+    missed += measure_change(METRIC_TOGGLE, 0, 1);
+    missed += measure_change(METRIC_TOGGLE, 1, 1);
+    missed += measure_change(METRIC_INVALIDATE, 0, 0);
+    missed += measure_change(METRIC_INVALIDATE, 1, 0);
+    missed += measure_name(METRIC_VANISH, 0);
+  }
+
+  pthread_cancel(watch_thread);
+  pthread_join(watch_thread, NULL);
+  atomic_store(&g_serving, 0);
+  pthread_join(serve_thread, NULL);
+  dbus_connection_close(g_player);
+  dbus_connection_unref(g_player);
+
+  FILE *out = g_output ? fopen(g_output, "w") : stdout;
+  if (!out) {
+    perror(g_output);
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "{\n  \"runs\": %d,\n  \"missed_changes\": %d,\n"
+               "  \"metrics\": {\n",
+          g_runs, missed);
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    write_metric(out, &g_metrics[i]);
+    fprintf(out, i + 1 < METRIC_COUNT ? ",\n" : "\n");
+  }
+  fprintf(out, "  }\n}\n");
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    free(g_metrics[i].samples);
+  }
+  return missed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
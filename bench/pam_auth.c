@@ -0,0 +1,461 @@
+/**
+ * @file pam_auth.c
+ * @brief Authentication latency benchmark against the mock PAM module.
+ *
+ * Writes a private PAM service using pam_mock.so (see pam_mock.c) and runs
+ * the lockscreen's own auth_pam() against it, measuring:
+ *
+ *   handle_setup_us       pam_start() + pam_end() alone
+ *   success_attempt_ms    one successful attempt, end to end
+ *   failure_attempt_ms    one failed attempt, end to end
+ *   loop_stall_ms         how late a 60 Hz main loop's next frame was when
+ *                         an attempt ran on it synchronously
+ *   async_loop_stall_ms   the same with auth_start(), as the lockscreen does
+ *   race_password_ms      auth_start() with the password service and a
+ *                         slower "token" service: the password wins
+ *   race_token_ms         the same with a wrong password: the token wins
+ *   conversation_bytes    heap held by the conversation's responses
+ *   heap_retained_bytes   heap still in use after all attempts
+ *
+ * Results are written as JSON:
+ *
+ *   pam-auth --module ./pam_mock.so --attempts 200 --delay-ms 50 \
+ *            --token-delay-ms 150
+ */
+
+#include "auth.h"
+#include "events.h"
+#include "pam.h"
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <pwd.h>
+#include <security/pam_appl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const char *const SERVICE_NAME = "lockscreen-bench";
+/* Stands for a second factor: no prompt, succeeds after its delay. */
+static const char *const TOKEN_SERVICE_NAME = "lockscreen-bench-token";
+static const char *const RACE_SERVICES =
+    "lockscreen-bench,lockscreen-bench-token";
+static const char *const GOOD_PASSWORD = "secret";
+static const char *const BAD_PASSWORD = "wrong";
+static const int MAX_ATTEMPTS = 100000;
+static const int64_t FRAME_PERIOD_NS = 16666667LL;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Samples of one measurement.
+ */
+struct Metric {
+  const char *name;
+  double *samples;
+  int count;
+};
+
+enum MetricIndex {
+  METRIC_HANDLE_SETUP,
+  METRIC_SUCCESS_ATTEMPT,
+  METRIC_FAILURE_ATTEMPT,
+  METRIC_LOOP_STALL,
+  METRIC_ASYNC_LOOP_STALL,
+  METRIC_RACE_PASSWORD,
+  METRIC_RACE_TOKEN,
+  METRIC_CONVERSATION_BYTES,
+  METRIC_COUNT
+};
+
+/**
+ * @brief Benchmark parameters, from the command line.
+ */
+struct BenchConfig {
+  const char *module;
+  const char *output;
+  int attempts;
+  int delay_ms;
+  int token_delay_ms;
+  int prompts;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct BenchConfig g_config = {
+    .module = NULL,
+    .output = NULL,
+    .attempts = 100,
+    .delay_ms = 0,
+    .token_delay_ms = 100,
+    .prompts = 1,
+};
+static struct Metric g_metrics[METRIC_COUNT] = {
+    {"handle_setup_us", NULL, 0},
+    {"success_attempt_ms", NULL, 0},
+    {"failure_attempt_ms", NULL, 0},
+    {"loop_stall_ms", NULL, 0},
+    {"async_loop_stall_ms", NULL, 0},
+    {"race_password_ms", NULL, 0},
+    {"race_token_ms", NULL, 0},
+    {"conversation_bytes", NULL, 0},
+};
+static char g_conf_dir[] = "/tmp/pam-auth-XXXXXX";
+static int g_capacity = 0; /* Samples each metric has room for. */
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void record(enum MetricIndex index, double value) {
+  struct Metric *metric = &g_metrics[index];
+  if (metric->count < g_capacity) {
+    metric->samples[metric->count++] = value;
+  }
+}
+
+static int parse_command_line(int argc, char *argv[]) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], "--module") == 0) {
+      g_config.module = value;
+    } else if (strcmp(argv[i], "--output") == 0) {
+      g_config.output = value;
+    } else if (strcmp(argv[i], "--attempts") == 0) {
+      g_config.attempts = atoi(value);
+    } else if (strcmp(argv[i], "--delay-ms") == 0) {
+      g_config.delay_ms = atoi(value);
+    } else if (strcmp(argv[i], "--token-delay-ms") == 0) {
+      g_config.token_delay_ms = atoi(value);
+    } else if (strcmp(argv[i], "--prompts") == 0) {
+      g_config.prompts = atoi(value);
+    } else {
+      return -1;
+    }
+  }
+  if (argc % 2 == 0 || !g_config.module || g_config.attempts < 1 ||
+      g_config.attempts > MAX_ATTEMPTS || g_config.prompts < 1 ||
+      g_config.delay_ms < 0 || g_config.token_delay_ms < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Writes the benchmark's PAM service into a private directory.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int write_service_file(const char *name, const char *arguments) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%s", g_conf_dir, name);
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+  fprintf(file, "auth required %s %s\n", g_config.module, arguments);
+  fclose(file);
+  return 0;
+}
+
+static int write_service(void) {
+  if (!mkdtemp(g_conf_dir)) {
+    perror("mkdtemp");
+    return -1;
+  }
+  char arguments[128];
+  snprintf(arguments, sizeof(arguments), "delay_ms=%d prompts=%d password=%s",
+           g_config.delay_ms, g_config.prompts, GOOD_PASSWORD);
+  if (write_service_file(SERVICE_NAME, arguments) != 0) {
+    return -1;
+  }
+  snprintf(arguments, sizeof(arguments), "delay_ms=%d prompts=0 result=success",
+           g_config.token_delay_ms);
+  return write_service_file(TOKEN_SERVICE_NAME, arguments);
+}
+
+static void remove_service(void) {
+  const char *names[] = {SERVICE_NAME, TOKEN_SERVICE_NAME};
+  char path[128];
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    snprintf(path, sizeof(path), "%s/%s", g_conf_dir, names[i]);
+    unlink(path);
+  }
+  rmdir(g_conf_dir);
+}
+
+static int null_conversation(int num_msg __attribute__((unused)),
+                             const struct pam_message **msg
+                             __attribute__((unused)),
+                             struct pam_response **resp,
+                             void *appdata_ptr __attribute__((unused))) {
+  *resp = NULL;
+  return PAM_CONV_ERR;
+}
+
+/**
+ * @brief Times opening and closing a PAM handle, which every attempt pays
+ *        before any module runs.
+ */
+static void measure_handle_setup(const char *username) {
+  struct pam_conv conv = {.conv = null_conversation, .appdata_ptr = NULL};
+  for (int i = 0; i < g_config.attempts; i++) {
+    pam_handle_t *pamh = NULL;
+    int64_t start = monotonic_ns();
+    int ret =
+        pam_start_confdir(SERVICE_NAME, username, &conv, g_conf_dir, &pamh);
+    if (ret == PAM_SUCCESS) {
+      pam_end(pamh, PAM_SUCCESS);
+    }
+    record(METRIC_HANDLE_SETUP, (double)(monotonic_ns() - start) / 1e3);
+  }
+}
+
+/**
+ * @return Number of attempts whose outcome was not the expected one.
+ */
+static int measure_attempts(const char *username) {
+  int unexpected = 0;
+  for (int i = 0; i < g_config.attempts; i++) {
+    int64_t start = monotonic_ns();
+    unexpected += auth_pam(SERVICE_NAME, g_conf_dir, GOOD_PASSWORD, username,
+                           NULL) != 0;
+    record(METRIC_SUCCESS_ATTEMPT, (double)(monotonic_ns() - start) / 1e6);
+
+    start = monotonic_ns();
+    unexpected += auth_pam(SERVICE_NAME, g_conf_dir, BAD_PASSWORD, username,
+                           NULL) == 0;
+    record(METRIC_FAILURE_ATTEMPT, (double)(monotonic_ns() - start) / 1e6);
+  }
+  return unexpected;
+}
+
+/**
+ * @brief Collects the outcome of the asynchronous attempt, if it has one.
+ *
+ * @return AUTH_PENDING while undecided.
+ */
+static enum AuthResult poll_auth(void) {
+  enum EventType type;
+  events_clear();
+  while (event_next(&type)) {
+  }
+  return auth_result();
+}
+
+/**
+ * @brief Waits for the asynchronous attempt's outcome.
+ */
+static enum AuthResult wait_for_auth(void) {
+  struct pollfd pfd = {.fd = events_fd(), .events = POLLIN};
+  enum AuthResult result;
+  while ((result = poll_auth()) == AUTH_PENDING) {
+    poll(&pfd, 1, -1);
+  }
+  return result;
+}
+
+/**
+ * @brief Runs a 60 Hz loop that starts an attempt on every other frame,
+ *        like the lock loop does on Enter, and records how late the frame
+ *        after each start was.
+ *
+ * @param async 0 to authenticate inline with auth_pam(), 1 to start
+ *        auth_start() and pick up the outcome on later frames.
+ */
+static void measure_loop_stall(const char *username, int async) {
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (timer < 0) {
+    perror("timerfd_create");
+    return;
+  }
+  struct itimerspec period = {
+      .it_interval = {.tv_sec = 0, .tv_nsec = FRAME_PERIOD_NS},
+      .it_value = {.tv_sec = 0, .tv_nsec = FRAME_PERIOD_NS},
+  };
+  int64_t origin = monotonic_ns();
+  timerfd_settime(timer, 0, &period, NULL);
+
+  uint64_t ticks = 0;
+  int started = 0;
+  struct pollfd pfd = {.fd = timer, .events = POLLIN};
+  while (started < g_config.attempts) {
+    uint64_t expirations = 0;
+    poll(&pfd, 1, -1);
+    if (read(timer, &expirations, sizeof(expirations)) > 0) {
+      ticks += expirations;
+    }
+    if (async && poll_auth() == AUTH_PENDING) {
+      continue;
+    }
+    if (ticks % 2 == 1) {
+      continue;
+    }
+
+    if (async) {
+      auth_start(SERVICE_NAME, g_conf_dir, GOOD_PASSWORD, username);
+    } else {
+      auth_pam(SERVICE_NAME, g_conf_dir, GOOD_PASSWORD, username, NULL);
+    }
+    started++;
+
+    /* The next frame was due one period after the tick just handled. */
+    int64_t due = origin + (int64_t)(ticks + 1) * FRAME_PERIOD_NS;
+    poll(&pfd, 1, -1);
+    int64_t late = monotonic_ns() - due;
+    record(async ? METRIC_ASYNC_LOOP_STALL : METRIC_LOOP_STALL,
+           (late > 0) ? (double)late / 1e6 : 0.0);
+    if (read(timer, &expirations, sizeof(expirations)) > 0) {
+      ticks += expirations;
+    }
+  }
+  if (async) {
+    wait_for_auth();
+  }
+  close(timer);
+}
+
+/**
+ * @brief Races the password service against the slower token service.
+ *
+ * @return Number of attempts whose outcome was not the expected one.
+ */
+static int measure_race(const char *username) {
+  int unexpected = 0;
+  for (int i = 0; i < g_config.attempts; i++) {
+    int64_t start = monotonic_ns();
+    auth_start(RACE_SERVICES, g_conf_dir, GOOD_PASSWORD, username);
+    unexpected += wait_for_auth() != AUTH_SUCCESS;
+    record(METRIC_RACE_PASSWORD, (double)(monotonic_ns() - start) / 1e6);
+
+    start = monotonic_ns();
+    auth_start(RACE_SERVICES, g_conf_dir, BAD_PASSWORD, username);
+    unexpected += wait_for_auth() != AUTH_SUCCESS;
+    record(METRIC_RACE_TOKEN, (double)(monotonic_ns() - start) / 1e6);
+  }
+  return unexpected;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void write_metric(FILE *out, struct Metric *metric) {
+  qsort(metric->samples, (size_t)metric->count, sizeof(double),
+        compare_doubles);
+  fprintf(out, "    \"%s\": {\"count\": %d", metric->name, metric->count);
+  if (metric->count > 0) {
+    double sum = 0.0;
+    for (int i = 0; i < metric->count; i++) {
+      sum += metric->samples[i];
+    }
+    fprintf(out,
+            ", \"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, "
+            "\"mean\": %.3f, \"max\": %.3f",
+            metric->samples[0], metric->samples[metric->count / 2],
+            metric->samples[(metric->count * 99) / 100], sum / metric->count,
+            metric->samples[metric->count - 1]);
+  }
+  fprintf(out, "},\n");
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Called by pam_mock.so after each conversation (looked up with
+ *        dlsym(), hence exported).
+ *
+ * @param conversation_bytes Heap held by the conversation's responses.
+ */
+void pam_mock_report(size_t conversation_bytes) {
+  record(METRIC_CONVERSATION_BYTES, (double)conversation_bytes);
+}
+
+int main(int argc, char *argv[]) {
+  if (parse_command_line(argc, argv) != 0) {
+    fprintf(stderr,
+            "Usage: %s --module PATH [--attempts N] [--delay-ms N]\n"
+            "          [--token-delay-ms N] [--prompts N] [--output FILE]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  struct passwd *pw = getpwuid(getuid());
+  if (!pw || write_service() != 0 || events_init() != 0) {
+    return EXIT_FAILURE;
+  }
+
+  /* auth_pam() reports each attempt on stdout; keep the JSON apart. */
+  FILE *out = g_config.output ? fopen(g_config.output, "w")
+                              : fdopen(dup(STDOUT_FILENO), "w");
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (!out || null_fd < 0) {
+    perror("output");
+    remove_service();
+    return EXIT_FAILURE;
+  }
+  dup2(null_fd, STDOUT_FILENO);
+  dup2(null_fd, STDERR_FILENO);
+  close(null_fd);
+
+  /* Room for every conversation of every attempt, in all phases. */
+  g_capacity = 6 * g_config.attempts * g_config.prompts;
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    g_metrics[i].samples = calloc((size_t)g_capacity, sizeof(double));
+    if (!g_metrics[i].samples) {
+      g_capacity = 0;
+    }
+  }
+
+  malloc_trim(0);
+  size_t heap_before = mallinfo2().uordblks;
+  measure_handle_setup(pw->pw_name);
+  int unexpected = measure_attempts(pw->pw_name);
+  measure_loop_stall(pw->pw_name, 0);
+  measure_loop_stall(pw->pw_name, 1);
+  unexpected += measure_race(pw->pw_name);
+  malloc_trim(0);
+  size_t heap_after = mallinfo2().uordblks;
+
+  fprintf(out,
+          "{\n  \"attempts\": %d,\n  \"delay_ms\": %d,\n"
+          "  \"token_delay_ms\": %d,\n  \"prompts\": %d,\n"
+          "  \"unexpected_results\": %d,\n  \"metrics\": {\n",
+          g_config.attempts, g_config.delay_ms, g_config.token_delay_ms,
+          g_config.prompts, unexpected);
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    write_metric(out, &g_metrics[i]);
+  }
+  fprintf(out, "    \"heap_retained_bytes\": %lld\n  }\n}\n",
+          (long long)heap_after - (long long)heap_before);
+  fclose(out);
+
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    free(g_metrics[i].samples);
+  }
+  remove_service();
+  events_cleanup();
+  return unexpected ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file pam_mock.c
+ * @brief PAM module with tunable latency and outcome, for benchmarking the
+ *        lockscreen's authentication path without real credentials.
+ *
+ * Arguments (in the service file):
+ *
+ *   delay_ms=N     wait N ms before prompting (e.g. a token being touched)
+ *   prompts=N      number of password prompts (default 1)
+ *   password=S     the password that succeeds (default "secret")
+ *   result=R       "check" (default) compares the answer with password=,
+ *                  "success" and "fail" ignore it
+ *
+ * If the program loading the module exports pam_mock_report(), it is told
+ * how many heap bytes each conversation's responses occupied.
+ */
+
+#define PAM_SM_AUTH
+#include <dlfcn.h>
+#include <malloc.h>
+#include <security/pam_appl.h>
+#include <security/pam_modules.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+enum MockResult { RESULT_CHECK, RESULT_SUCCESS, RESULT_FAIL };
+
+/**
+ * @brief Behaviour configured by the module arguments.
+ */
+struct MockConfig {
+  long delay_ms;
+  int prompts;
+  const char *password;
+  enum MockResult result;
+};
+
+typedef void (*MockReport)(size_t conversation_bytes);
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static struct MockConfig parse_module_args(int argc, const char **argv) {
+  struct MockConfig config = {0, 1, "secret", RESULT_CHECK};
+  for (int i = 0; i < argc; i++) {
+    if (strncmp(argv[i], "delay_ms=", 9) == 0) {
+      config.delay_ms = atol(argv[i] + 9);
+    } else if (strncmp(argv[i], "prompts=", 8) == 0) {
+      config.prompts = atoi(argv[i] + 8);
+    } else if (strncmp(argv[i], "password=", 9) == 0) {
+      config.password = argv[i] + 9;
+    } else if (strcmp(argv[i], "result=success") == 0) {
+      config.result = RESULT_SUCCESS;
+    } else if (strcmp(argv[i], "result=fail") == 0) {
+      config.result = RESULT_FAIL;
+    }
+  }
+  return config;
+}
+
+/**
+ * @brief Asks for the password once.
+ *
+ * @return PAM_SUCCESS if the answer matched, PAM_AUTH_ERR if not, or the
+ *         conversation's error.
+ */
+static int prompt_password(pam_handle_t *pamh, const struct MockConfig *config,
+                           MockReport report) {
+  const struct pam_conv *conv = NULL;
+  int ret = pam_get_item(pamh, PAM_CONV, (const void **)&conv);
+  if (ret != PAM_SUCCESS || !conv || !conv->conv) {
+    return PAM_CONV_ERR;
+  }
+
+  struct pam_message message = {.msg_style = PAM_PROMPT_ECHO_OFF,
+                                .msg = "Password: "};
+  const struct pam_message *messages[1] = {&message};
+  struct pam_response *response = NULL;
+
+  size_t before = mallinfo2().uordblks;
+  ret = conv->conv(1, messages, &response, conv->appdata_ptr);
+  if (report) {
+    report(mallinfo2().uordblks - before);
+  }
+  if (ret != PAM_SUCCESS) {
+    return ret;
+  }
+  if (!response) {
+    return PAM_CONV_ERR;
+  }
+
+  int matched = response->resp && strcmp(response->resp, config->password) == 0;
+  if (response->resp) {
+    explicit_bzero(response->resp, strlen(response->resp));
+    free(response->resp);
+  }
+  free(response);
+  return matched ? PAM_SUCCESS : PAM_AUTH_ERR;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+PAM_EXTERN int pam_sm_authenticate(pam_handle_t *pamh,
+                                   int flags __attribute__((unused)),
+                                   int argc, const char **argv) {
+  struct MockConfig config = parse_module_args(argc, argv);
+  MockReport report = (MockReport)dlsym(RTLD_DEFAULT, "pam_mock_report");
+
+  if (config.delay_ms > 0) {
+    struct timespec delay = {.tv_sec = config.delay_ms / 1000,
+                             .tv_nsec = (config.delay_ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+  }
+
+  int ret = PAM_SUCCESS;
+  for (int i = 0; i < config.prompts; i++) {
+    int prompt_ret = prompt_password(pamh, &config, report);
+    if (prompt_ret != PAM_SUCCESS && prompt_ret != PAM_AUTH_ERR) {
+      return prompt_ret;
+    }
+    if (prompt_ret == PAM_AUTH_ERR) {
+      ret = PAM_AUTH_ERR;
+    }
+  }
+
+  switch (config.result) {
+  case RESULT_SUCCESS:
+    return PAM_SUCCESS;
+  case RESULT_FAIL:
+    return PAM_AUTH_ERR;
+  default:
+    return ret;
+  }
+}
+
+PAM_EXTERN int pam_sm_setcred(pam_handle_t *pamh __attribute__((unused)),
+                              int flags __attribute__((unused)),
+                              int argc __attribute__((unused)),
+                              const char **argv __attribute__((unused))) {
+  return PAM_SUCCESS;
+}
@@ -31,6 +31,27 @@ char *retrieve_command_arg(const char *arg) {
   return NULL;
 }
 
+/**
+ * @brief Checks whether a flag was given on the command line.
+ *
+ * Unlike retrieve_command_arg(), this also works for flags that take no
+ * value (e.g., "--blur").
+ *
+ * @param arg The argument name to look for.
+ * @return 1 if the flag is present, 0 otherwise.
+ */
+int has_command_arg(const char *arg) {
+  struct Argument *current = g_argument_head;
+
+  while (current != NULL) {
+    if (strcmp(current->name, arg) == 0) {
+      return 1;
+    }
+    current = current->next;
+  }
+  return 0;
+}
+
 /**
  * @brief Parses the command-line arguments and stores them in a linked list.
  *
@@ -70,8 +91,19 @@ void parse_arguments(int argc, char *argv[]) {
 
     /* Check for flags that require a value. */
     if ((strcmp(argv[i], "--image") == 0) ||
+        (strcmp(argv[i], "--slideshow-interval") == 0) ||
         (strcmp(argv[i], "--suspend") == 0) ||
-        (strcmp(argv[i], "--color") == 0)) {
+        (strcmp(argv[i], "--prewarm") == 0) ||
+        (strcmp(argv[i], "--color") == 0) ||
+        (strcmp(argv[i], "--animation") == 0) ||
+        (strcmp(argv[i], "--fps") == 0) ||
+        (strcmp(argv[i], "--powersave") == 0) ||
+        (strcmp(argv[i], "--pam-service") == 0) ||
+        (strcmp(argv[i], "--font") == 0) ||
+        (strcmp(argv[i], "--displays") == 0) ||
+        (strcmp(argv[i], "--socket") == 0) ||
+        (strcmp(argv[i], "--command") == 0) ||
+        (strcmp(argv[i], "--config") == 0)) {
       if (i + 1 < argc) {
         /* Allocate and copy the next argument as the value. */
         current_arg->value = malloc(strlen(argv[i + 1]) + 1);
@@ -39,5 +39,6 @@ extern int args_count;
 
 void parse_arguments(int argc, char *argv[]);
 char *retrieve_command_arg(const char *arg);
+int has_command_arg(const char *arg);
 
 #endif /* ARGS_H */
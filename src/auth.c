@@ -0,0 +1,285 @@
+/**
+ * @file auth.c
+ * @brief Runs the configured PAM services concurrently, off the main
+ *        thread, and unlocks on the first one that succeeds.
+ *
+ * Users may authenticate with a password or a second factor (e.g. a module
+ * waiting for a token), each configured as its own PAM service. Pressing
+ * Enter starts one worker thread per service; the main loop keeps drawing
+ * and is woken with EVENT_AUTH once the outcome is known: success as soon
+ * as any service succeeds, failure once all have failed. The losers are
+ * then cancelled: their next conversation call fails, which makes the module
+ * give up. A module that blocks without talking to the conversation cannot
+ * be interrupted; its worker finishes on its own and its result is ignored.
+ */
+
+#include "auth.h"
+#include "events.h"
+#include "pam.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define AUTH_MAX_SERVICES 4
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief One press of Enter, shared by its workers and the main thread.
+ *        Freed by whoever drops the last reference.
+ */
+struct AuthAttempt {
+  char password[256];
+  char username[256];
+  char confdir[256];      /**< Empty for the system PAM configuration. */
+  atomic_int cancelled;   /**< Checked by the conversation function. */
+  atomic_int outcome;     /**< An enum AuthResult. */
+  atomic_int remaining;   /**< Workers still running. */
+  atomic_int references;  /**< Workers plus the main thread's. */
+  struct timespec started;
+  struct AuthAttempt *next_live; /**< Next in g_live_attempts. */
+};
+
+/**
+ * @brief One service being tried.
+ */
+struct AuthWorker {
+  struct AuthAttempt *attempt;
+  char service[64];
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/* The attempt the main thread is waiting on, or NULL. Main thread only. */
+static struct AuthAttempt *g_attempt = NULL;
+
+/*
+ * Every attempt not yet freed, including cancelled ones workers still hold,
+ * so auth_relock() can lock them again. The lock also covers each attempt's
+ * mlock() and munlock(), so auth_relock() never touches a freed one.
+ */
+static pthread_mutex_t g_live_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct AuthAttempt *g_live_attempts = NULL;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static double elapsed_ms(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - since->tv_sec) * 1e3 +
+         (double)(now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+static void release_attempt(struct AuthAttempt *attempt) {
+  if (atomic_fetch_sub(&attempt->references, 1) == 1) {
+    explicit_bzero(attempt->password, sizeof(attempt->password));
+    pthread_mutex_lock(&g_live_lock);
+    struct AuthAttempt **link = &g_live_attempts;
+    while (*link && *link != attempt) {
+      link = &(*link)->next_live;
+    }
+    if (*link) {
+      *link = attempt->next_live;
+    }
+    munlock(attempt, sizeof(*attempt));
+    pthread_mutex_unlock(&g_live_lock);
+    free(attempt);
+  }
+}
+
+/**
+ * @brief Publishes an outcome unless another worker already has.
+ */
+static int settle(struct AuthAttempt *attempt, enum AuthResult outcome) {
+  int expected = AUTH_PENDING;
+  if (!atomic_compare_exchange_strong(&attempt->outcome, &expected,
+                                      (int)outcome)) {
+    return 0;
+  }
+  event_post(EVENT_AUTH);
+  return 1;
+}
+
+static void *auth_worker(void *arg) {
+  struct AuthWorker *worker = (struct AuthWorker *)arg;
+  struct AuthAttempt *attempt = worker->attempt;
+
+  int succeeded =
+      auth_pam(worker->service,
+               attempt->confdir[0] != '\0' ? attempt->confdir : NULL,
+               attempt->password, attempt->username, &attempt->cancelled) == 0;
+  if (succeeded && settle(attempt, AUTH_SUCCESS)) {
+    /* The others are no longer needed. */
+    atomic_store(&attempt->cancelled, 1);
+    printf("Authenticated by '%s' after %.1f ms.\n", worker->service,
+           elapsed_ms(&attempt->started));
+  }
+  if (atomic_fetch_sub(&attempt->remaining, 1) == 1) {
+    settle(attempt, AUTH_FAILURE);
+  }
+
+  release_attempt(attempt);
+  free(worker);
+  return NULL;
+}
+
+/**
+ * @brief Starts a worker for one service.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int start_worker(struct AuthAttempt *attempt, const char *service,
+                        size_t len) {
+  struct AuthWorker *worker = calloc(1, sizeof(*worker));
+  if (!worker) {
+    return -1;
+  }
+  worker->attempt = attempt;
+  memcpy(worker->service, service, len);
+
+  atomic_fetch_add(&attempt->references, 1);
+  atomic_fetch_add(&attempt->remaining, 1);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_t thread;
+  int ret = pthread_create(&thread, &attr, auth_worker, worker);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    fprintf(stderr, "Failed to start authentication for '%s'.\n", service);
+    atomic_fetch_sub(&attempt->remaining, 1);
+    atomic_fetch_sub(&attempt->references, 1);
+    free(worker);
+    return -1;
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Starts authenticating with every service at once. Main thread only;
+ *        the outcome is announced with EVENT_AUTH and read with
+ *        auth_result().
+ *
+ * @param services Comma-separated PAM service names.
+ * @param confdir PAM configuration directory, or NULL for the system one.
+ * @param password The typed password; copied.
+ * @param username The user to authenticate.
+ * @return 0 if at least one service is being tried, -1 otherwise (or if an
+ *         attempt is already running).
+ */
+int auth_start(const char *services, const char *confdir, const char *password,
+               const char *username) {
+  if (g_attempt) {
+    return -1;
+  }
+  struct AuthAttempt *attempt = calloc(1, sizeof(*attempt));
+  if (!attempt) {
+    return -1;
+  }
+  /* Like the input buffer, the copy must never reach swap. */
+  pthread_mutex_lock(&g_live_lock);
+  mlock(attempt, sizeof(*attempt));
+  attempt->next_live = g_live_attempts;
+  g_live_attempts = attempt;
+  pthread_mutex_unlock(&g_live_lock);
+  snprintf(attempt->password, sizeof(attempt->password), "%s", password);
+  snprintf(attempt->username, sizeof(attempt->username), "%s", username);
+  snprintf(attempt->confdir, sizeof(attempt->confdir), "%s",
+           confdir ? confdir : "");
+  atomic_init(&attempt->cancelled, 0);
+  atomic_init(&attempt->outcome, AUTH_PENDING);
+  /* Held while starting, so early failures cannot settle the attempt. */
+  atomic_init(&attempt->remaining, 1);
+  atomic_init(&attempt->references, 1);
+  clock_gettime(CLOCK_MONOTONIC, &attempt->started);
+
+  int started = 0;
+  const char *start = services;
+  while (*start != '\0' && started < AUTH_MAX_SERVICES) {
+    start += strspn(start, ", ");
+    size_t len = strcspn(start, ", ");
+    if (len > 0 && len < sizeof(((struct AuthWorker *)0)->service) &&
+        start_worker(attempt, start, len) == 0) {
+      started++;
+    }
+    start += len;
+  }
+
+  if (started == 0) {
+    release_attempt(attempt);
+    return -1;
+  }
+  if (atomic_fetch_sub(&attempt->remaining, 1) == 1) {
+    settle(attempt, AUTH_FAILURE);
+  }
+  g_attempt = attempt;
+  return 0;
+}
+
+/**
+ * @brief Reports whether an attempt is still waiting for its outcome.
+ */
+int auth_pending(void) { return g_attempt != NULL; }
+
+/**
+ * @brief Collects the outcome of the current attempt, once. Main thread
+ *        only.
+ *
+ * @return AUTH_PENDING while undecided, AUTH_SUCCESS or AUTH_FAILURE once
+ *         (the attempt is then finished), AUTH_IDLE without an attempt.
+ */
+enum AuthResult auth_result(void) {
+  if (!g_attempt) {
+    return AUTH_IDLE;
+  }
+  enum AuthResult outcome = (enum AuthResult)atomic_load(&g_attempt->outcome);
+  if (outcome != AUTH_PENDING) {
+    release_attempt(g_attempt);
+    g_attempt = NULL;
+  }
+  return outcome;
+}
+
+/**
+ * @brief Abandons the current attempt, e.g. because the lock ended. Its
+ *        workers are cancelled and clean up after themselves.
+ */
+void auth_cancel(void) {
+  if (!g_attempt) {
+    return;
+  }
+  atomic_store(&g_attempt->cancelled, 1);
+  release_attempt(g_attempt);
+  g_attempt = NULL;
+}
+
+/**
+ * @brief Locks every attempt's password copy into memory again, e.g. after
+ *        munlockall() dropped all locks. Safe to call from any thread.
+ */
+void auth_relock(void) {
+  pthread_mutex_lock(&g_live_lock);
+  for (struct AuthAttempt *attempt = g_live_attempts; attempt;
+       attempt = attempt->next_live) {
+    mlock(attempt, sizeof(*attempt));
+  }
+  pthread_mutex_unlock(&g_live_lock);
+}
@@ -0,0 +1,34 @@
+#ifndef AUTH_H
+#define AUTH_H
+
+/**
+ * @file auth.h
+ * @brief Declarations for concurrent, asynchronous PAM authentication.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Type Definitions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief State of the current authentication attempt.
+ */
+enum AuthResult {
+  AUTH_IDLE,    /**< No attempt. */
+  AUTH_PENDING, /**< Services are still being tried. */
+  AUTH_SUCCESS, /**< One of the services succeeded. */
+  AUTH_FAILURE, /**< Every service failed. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int auth_start(const char *services, const char *confdir, const char *password,
+               const char *username);
+int auth_pending(void);
+enum AuthResult auth_result(void);
+void auth_cancel(void);
+void auth_relock(void);
+
+#endif /* AUTH_H */
@@ -0,0 +1,458 @@
+/**
+ * @file config.c
+ * @brief Parses the config file and command line into a typed options struct
+ *        and reloads it when the file changes.
+ *
+ * The config file lives at $XDG_CONFIG_HOME/minimalist-lockscreen/config
+ * (or ~/.config/minimalist-lockscreen/config, or the path given with
+ * "--config") and holds one "key = value" pair per line; '#' starts a comment.
+ * Command-line arguments always take precedence over the file.
+ *
+ * A static profile build (see profile.h) has no config file: its options
+ * start from the values baked in at configure time, the command line can
+ * still override them, and the file parser and watcher are compiled out.
+ */
+
+#include "config.h"
+#include "args.h"
+#include "events.h"
+#include "power.h"
+#include "profile.h"
+#include "residency.h"
+#include <ctype.h>
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const int DEFAULT_FPS = 24;
+static const int MAX_FPS = 60;
+static const char *const CONFIG_SUBPATH = "minimalist-lockscreen/config";
+
+static const char *const DEFAULT_PAM_SERVICE = "login";
+
+/*
+ * Keys that can be given both in the file and as "--<key> <value>" (with
+ * '_' written as '-').
+ */
+static const char *const VALUE_KEYS[] = {
+    "image",   "slideshow_interval", "color", "suspend",
+    "prewarm", "animation",          "fps",   "powersave",
+    "pam_service", "font"};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct Options g_options;
+static int g_options_loaded = 0;
+static pthread_mutex_t g_options_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_config_path[PATH_MAX];
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static void set_default_options(struct Options *options) {
+  memset(options, 0, sizeof(*options));
+  options->fps = DEFAULT_FPS;
+  strcpy(options->pam_service, DEFAULT_PAM_SERVICE);
+  /* Empty unless baked in by a static profile. */
+  snprintf(options->image, sizeof(options->image), "%s", PROFILE_IMAGE);
+  snprintf(options->color, sizeof(options->color), "%s", PROFILE_COLOR);
+  options->suspend_timeout = PROFILE_SUSPEND;
+  snprintf(options->font, sizeof(options->font), "%s", PROFILE_FONT);
+}
+
+static char *trim(char *str) {
+  while (isspace((unsigned char)*str)) {
+    str++;
+  }
+  char *end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) {
+    *--end = '\0';
+  }
+  return str;
+}
+
+static int parse_bool(const char *value) {
+  return strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0 ||
+         strcasecmp(value, "yes") == 0 || strcasecmp(value, "on") == 0;
+}
+
+/**
+ * @brief Parses "auto" or a boolean into a powersave mode.
+ */
+static enum PowersaveMode parse_powersave(const char *value) {
+  if (strcasecmp(value, "auto") == 0) {
+    return POWERSAVE_AUTO;
+  }
+  return parse_bool(value) ? POWERSAVE_ON : POWERSAVE_OFF;
+}
+
+/**
+ * @brief Parses a non-negative integer within [min, max].
+ *
+ * @return 0 on success, -1 if the value is not a valid number in range.
+ */
+static int parse_int(const char *value, int min, int max, int *out) {
+  char *end = NULL;
+  errno = 0;
+  long parsed = strtol(value, &end, 10);
+  while (end && isspace((unsigned char)*end)) {
+    end++;
+  }
+  if (errno != 0 || end == value || *end != '\0' || parsed < min ||
+      parsed > max) {
+    return -1;
+  }
+  *out = (int)parsed;
+  return 0;
+}
+
+static void copy_string(char *dest, size_t size, const char *value,
+                        const char *key) {
+  if (strlen(value) >= size) {
+    fprintf(stderr, "Warning: value for '%s' is too long, ignoring it.\n",
+            key);
+    return;
+  }
+  strcpy(dest, value);
+}
+
+/**
+ * @brief Stores one key/value pair into the options struct.
+ *
+ * @param source Where the pair came from, for warnings.
+ */
+static void apply_option(struct Options *options, const char *key,
+                         const char *value, const char *source) {
+  if (strcmp(key, "image") == 0) {
+    copy_string(options->image, sizeof(options->image), value, key);
+  } else if (strcmp(key, "slideshow_interval") == 0) {
+    if (parse_int(value, 0, INT_MAX / 1000, &options->slideshow_interval) !=
+        0) {
+      fprintf(stderr, "Warning: invalid slideshow interval '%s' in %s.\n",
+              value, source);
+    }
+  } else if (strcmp(key, "color") == 0) {
+    copy_string(options->color, sizeof(options->color), value, key);
+  } else if (strcmp(key, "suspend") == 0) {
+    if (parse_int(value, 0, INT_MAX / 1000, &options->suspend_timeout) != 0) {
+      fprintf(stderr, "Warning: invalid suspend timeout '%s' in %s.\n", value,
+              source);
+    }
+  } else if (strcmp(key, "prewarm") == 0) {
+    if (parse_int(value, 0, INT_MAX / 1000, &options->prewarm) != 0) {
+      fprintf(stderr, "Warning: invalid prewarm lead '%s' in %s.\n", value,
+              source);
+    }
+  } else if (strcmp(key, "blur") == 0) {
+    options->blur = parse_bool(value);
+  } else if (strcmp(key, "animation") == 0) {
+    copy_string(options->animation, sizeof(options->animation), value, key);
+  } else if (strcmp(key, "fps") == 0) {
+    if (parse_int(value, 1, MAX_FPS, &options->fps) != 0) {
+      fprintf(stderr, "Warning: fps must be between 1 and %d in %s.\n",
+              MAX_FPS, source);
+    }
+  } else if (strcmp(key, "progressive") == 0) {
+    options->progressive = parse_bool(value);
+  } else if (strcmp(key, "mlock") == 0) {
+    options->mlock = parse_bool(value);
+  } else if (strcmp(key, "override_redirect") == 0) {
+    options->override_redirect = parse_bool(value);
+  } else if (strcmp(key, "powersave") == 0) {
+    options->powersave = parse_powersave(value);
+  } else if (strcmp(key, "pam_service") == 0) {
+    copy_string(options->pam_service, sizeof(options->pam_service), value,
+                key);
+  } else if (strcmp(key, "font") == 0) {
+    copy_string(options->font, sizeof(options->font), value, key);
+  } else {
+    fprintf(stderr, "Warning: unknown option '%s' in %s.\n", key, source);
+  }
+}
+
+/**
+ * @brief Works out where the config file lives, once.
+ */
+static void resolve_config_path(void) {
+  if (g_config_path[0] != '\0') {
+    return;
+  }
+
+  const char *explicit_path = retrieve_command_arg("--config");
+  const char *xdg = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+
+  if (explicit_path) {
+    snprintf(g_config_path, sizeof(g_config_path), "%s", explicit_path);
+  } else if (xdg && xdg[0] == '/') {
+    snprintf(g_config_path, sizeof(g_config_path), "%s/%s", xdg,
+             CONFIG_SUBPATH);
+  } else if (home) {
+    snprintf(g_config_path, sizeof(g_config_path), "%s/.config/%s", home,
+             CONFIG_SUBPATH);
+  }
+}
+
+/**
+ * @brief Reads the config file into the options struct. A missing file is
+ *        not an error; the defaults simply stay in place.
+ */
+static void parse_config_file(struct Options *options) {
+  if (g_config_path[0] == '\0') {
+    return;
+  }
+
+  FILE *file = fopen(g_config_path, "r");
+  if (!file) {
+    return;
+  }
+
+  char line[PATH_MAX + 64];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    char *entry = trim(line);
+    if (*entry == '\0') {
+      continue;
+    }
+
+    char *equals = strchr(entry, '=');
+    if (!equals) {
+      fprintf(stderr, "Warning: ignoring malformed line %d in %s.\n",
+              line_number, g_config_path);
+      continue;
+    }
+    *equals = '\0';
+    apply_option(options, trim(entry), trim(equals + 1), g_config_path);
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Lets command-line arguments override whatever the file said.
+ */
+static void apply_command_line(struct Options *options) {
+  char flag[32];
+  for (size_t i = 0; i < sizeof(VALUE_KEYS) / sizeof(VALUE_KEYS[0]); i++) {
+    /* "pam_service" is given as "--pam-service". */
+    snprintf(flag, sizeof(flag), "--%s", VALUE_KEYS[i]);
+    for (char *c = flag; *c != '\0'; c++) {
+      *c = (*c == '_') ? '-' : *c;
+    }
+    const char *value = retrieve_command_arg(flag);
+    if (value) {
+      apply_option(options, VALUE_KEYS[i], value, "the command line");
+    }
+  }
+  if (has_command_arg("--blur")) {
+    options->blur = 1;
+  }
+  if (has_command_arg("--override-redirect")) {
+    options->override_redirect = 1;
+  }
+  if (has_command_arg("--mlock")) {
+    options->mlock = 1;
+  }
+  if (has_command_arg("--progressive")) {
+    options->progressive = 1;
+  }
+}
+
+static void close_fd(void *arg) { close(*(int *)arg); }
+
+static unsigned int diff_options(const struct Options *a,
+                                 const struct Options *b) {
+  unsigned int changed = 0;
+  if (strcmp(a->image, b->image) != 0) {
+    changed |= OPTION_IMAGE;
+  }
+  if (a->slideshow_interval != b->slideshow_interval) {
+    changed |= OPTION_SLIDESHOW_INTERVAL;
+  }
+  if (strcmp(a->color, b->color) != 0) {
+    changed |= OPTION_COLOR;
+  }
+  if (a->suspend_timeout != b->suspend_timeout) {
+    changed |= OPTION_SUSPEND;
+  }
+  if (a->prewarm != b->prewarm) {
+    changed |= OPTION_PREWARM;
+  }
+  if (a->blur != b->blur) {
+    changed |= OPTION_BLUR;
+  }
+  if (a->progressive != b->progressive) {
+    changed |= OPTION_PROGRESSIVE;
+  }
+  if (strcmp(a->animation, b->animation) != 0) {
+    changed |= OPTION_ANIMATION;
+  }
+  if (a->fps != b->fps) {
+    changed |= OPTION_FPS;
+  }
+  if (a->powersave != b->powersave) {
+    changed |= OPTION_POWERSAVE;
+  }
+  if (a->override_redirect != b->override_redirect) {
+    changed |= OPTION_OVERRIDE_REDIRECT;
+  }
+  if (a->mlock != b->mlock) {
+    changed |= OPTION_MLOCK;
+  }
+  if (strcmp(a->pam_service, b->pam_service) != 0) {
+    changed |= OPTION_PAM_SERVICE;
+  }
+  if (strcmp(a->font, b->font) != 0) {
+    changed |= OPTION_FONT;
+  }
+  return changed;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief (Re)builds the options from the config file and command line and
+ *        publishes them in one step.
+ *
+ * Must be called after parse_arguments().
+ *
+ * @return A mask of OPTION_* bits for the fields that changed (all bits on
+ *         the first call).
+ */
+unsigned int load_options(void) {
+  struct Options fresh;
+  set_default_options(&fresh);
+  if (!PROFILE_STATIC) {
+    resolve_config_path();
+    parse_config_file(&fresh);
+  }
+  apply_command_line(&fresh);
+
+  pthread_mutex_lock(&g_options_lock);
+  unsigned int changed =
+      g_options_loaded ? diff_options(&g_options, &fresh) : ~0u;
+  g_options = fresh;
+  g_options_loaded = 1;
+  pthread_mutex_unlock(&g_options_lock);
+
+  return changed;
+}
+
+/**
+ * @brief Copies the current options snapshot.
+ *
+ * @param out Destination for the snapshot.
+ */
+void get_options(struct Options *out) {
+  pthread_mutex_lock(&g_options_lock);
+  *out = g_options;
+  pthread_mutex_unlock(&g_options_lock);
+}
+
+/**
+ * @brief Thread function that reloads the options whenever the config file
+ *        changes.
+ *
+ * The containing directory is watched rather than the file itself so that
+ * editors which save by renaming a temporary file are picked up too. If the
+ * backgrounds need rebuilding, EVENT_RELOAD is posted so the main thread
+ * (which owns all cairo state) can do it.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+void *config_watch_loop(void *arg __attribute__((unused))) {
+  if (PROFILE_STATIC) {
+    return NULL;
+  }
+  resolve_config_path();
+  if (g_config_path[0] == '\0') {
+    return NULL;
+  }
+
+  char dir_buffer[PATH_MAX];
+  char name_buffer[PATH_MAX];
+  snprintf(dir_buffer, sizeof(dir_buffer), "%s", g_config_path);
+  snprintf(name_buffer, sizeof(name_buffer), "%s", g_config_path);
+  const char *dir = dirname(dir_buffer);
+  const char *name = basename(name_buffer);
+
+  int inotify_fd = inotify_init1(IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    perror("inotify_init1");
+    return NULL;
+  }
+  if (inotify_add_watch(inotify_fd, dir,
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                            IN_DELETE) < 0) {
+    /* No config directory: nothing to reload. */
+    close(inotify_fd);
+    return NULL;
+  }
+
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  pthread_cleanup_push(close_fd, &inotify_fd);
+  for (;;) {
+    /* read() is a cancellation point; main() cancels us on shutdown. */
+    ssize_t len = read(inotify_fd, events, sizeof(events));
+    if (len <= 0) {
+      if (len < 0 && errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    int relevant = 0;
+    for (char *ptr = events; ptr < events + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      if (event->len > 0 && strcmp(event->name, name) == 0) {
+        relevant = 1;
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+    if (!relevant) {
+      continue;
+    }
+
+    unsigned int changed = load_options();
+    if (changed != 0) {
+      printf("Reloaded %s.\n", g_config_path);
+    }
+    if (changed & OPTION_POWERSAVE) {
+      low_power_load_option();
+    }
+    if (changed & OPTION_MLOCK) {
+      residency_reload();
+    }
+    if (changed & OPTION_FONT) {
+      printf("The font is only resolved at startup; restart to apply it.\n");
+    }
+    if (changed & OPTION_BACKGROUND_MASK) {
+      if (event_post(EVENT_RELOAD) != 0) {
+        fprintf(stderr, "Failed to request background reload.\n");
+      }
+    }
+  }
+  pthread_cleanup_pop(1);
+
+  return NULL;
+}
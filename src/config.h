@@ -0,0 +1,87 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**
+ * @file config.h
+ * @brief Declarations for the typed options parsed from the config file and
+ *        the command line.
+ */
+
+#include <limits.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+/* Bits reported by load_options() for the fields that changed. */
+#define OPTION_IMAGE (1u << 0)
+#define OPTION_COLOR (1u << 1)
+#define OPTION_SUSPEND (1u << 2)
+#define OPTION_BLUR (1u << 3)
+#define OPTION_ANIMATION (1u << 4)
+#define OPTION_FPS (1u << 5)
+#define OPTION_POWERSAVE (1u << 6)
+#define OPTION_OVERRIDE_REDIRECT (1u << 7)
+#define OPTION_MLOCK (1u << 8)
+#define OPTION_PAM_SERVICE (1u << 9)
+#define OPTION_PROGRESSIVE (1u << 10)
+#define OPTION_PREWARM (1u << 11)
+#define OPTION_SLIDESHOW_INTERVAL (1u << 12)
+#define OPTION_FONT (1u << 13)
+
+/* Options that require the per-screen backgrounds to be rebuilt. */
+#define OPTION_BACKGROUND_MASK                                                 \
+  (OPTION_IMAGE | OPTION_COLOR | OPTION_SLIDESHOW_INTERVAL)
+
+/* ------------------------------------------------------------------------- */
+/* Type Definitions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief When the low-power rendering mode is used.
+ */
+enum PowersaveMode {
+  POWERSAVE_AUTO, /**< Only while running off the battery (default). */
+  POWERSAVE_ON,   /**< Always. */
+  POWERSAVE_OFF,  /**< Never. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Every user-facing option, already parsed into its final type.
+ *
+ * The struct is flat (no pointers) so a snapshot can be copied out in one
+ * go while the config thread swaps in a new one.
+ */
+struct Options {
+  char image[PATH_MAX];         /**< Background image, directory or
+                                     playlist path, empty if unset. */
+  int slideshow_interval;       /**< Seconds between wallpapers, 0 = one
+                                     per lock. */
+  char color[16];               /**< Background color ("#RRGGBB[AA]"). */
+  int suspend_timeout;          /**< Idle seconds to suspend, 0 = never. */
+  int prewarm;                  /**< Seconds before the idle lock to prepare
+                                     it, 0 = never. */
+  int blur;                     /**< Use a blurred screenshot as background. */
+  int progressive;              /**< Cover with a placeholder, refine later. */
+  char animation[PATH_MAX];     /**< Directory of animation frames, or empty. */
+  int fps;                      /**< Animation playback rate. */
+  enum PowersaveMode powersave; /**< When to use the low-power mode. */
+  int override_redirect;        /**< Map without the window manager. */
+  int mlock;                    /**< Lock the process into memory. */
+  char pam_service[128];        /**< PAM services, comma-separated. */
+  char font[128];               /**< Font family (a fontconfig pattern). */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+unsigned int load_options(void);
+void get_options(struct Options *out);
+void *config_watch_loop(void *arg);
+
+#endif /* CONFIG_H */
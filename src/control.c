@@ -0,0 +1,465 @@
+/**
+ * @file control.c
+ * @brief Unix domain socket for controlling the daemon: lock (optionally
+ *        waiting until the screens are covered), status and stats.
+ *
+ * The socket lives at $XDG_RUNTIME_DIR/minimalist-lockscreen-$DISPLAY.sock
+ * (or the path given with "--socket") and speaks one command per line,
+ * answering each with a single line:
+ *
+ *   lock         -> "ok"          (the lock has been requested)
+ *   lock --wait  -> "ok covered"  (once the first frame is on every screen)
+ *   status       -> "locked=0|1 covered=0|1 low_power=0|1"
+ *   stats        -> counters of the current (or last) lock
+ *
+ * All sockets are non-blocking and serviced from whichever main loop is
+ * running (idle or locked), so a slow client never delays a frame. Only
+ * the user running the daemon may connect.
+ */
+
+#include "control.h"
+#include "args.h"
+#include "events.h"
+#include "lockscreen.h"
+#include "power.h"
+#include "stats.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const char *const SOCKET_NAME_FORMAT =
+    "%s/minimalist-lockscreen-%s.sock";
+/* Without $XDG_RUNTIME_DIR; the peer check still keeps other users out. */
+static const char *const FALLBACK_SOCKET_FORMAT =
+    "/tmp/minimalist-lockscreen-%u-%s.sock";
+static const int LISTEN_BACKLOG = 4;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief A connected client.
+ */
+struct ControlClient {
+  int fd;           /**< Socket, or -1 if the slot is free. */
+  char buffer[128]; /**< Partial command line. */
+  size_t length;    /**< Bytes in buffer. */
+  int waiting;      /**< Waiting for the lock to be presented. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static int g_listen_fd = -1;
+static struct ControlClient g_clients[CONTROL_MAX_CLIENTS];
+static char g_socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Works out the socket path shared by the daemon and "--command".
+ *
+ * @return 0 on success, -1 if the path does not fit.
+ */
+static int resolve_socket_path(void) {
+  const char *explicit_path = retrieve_command_arg("--socket");
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  const char *display = getenv("DISPLAY");
+  int len;
+
+  if (!display) {
+    display = ":0";
+  }
+  if (explicit_path) {
+    len = snprintf(g_socket_path, sizeof(g_socket_path), "%s", explicit_path);
+  } else if (runtime_dir && runtime_dir[0] == '/') {
+    len = snprintf(g_socket_path, sizeof(g_socket_path), SOCKET_NAME_FORMAT,
+                   runtime_dir, display);
+  } else {
+    len = snprintf(g_socket_path, sizeof(g_socket_path),
+                   FALLBACK_SOCKET_FORMAT, (unsigned int)getuid(), display);
+  }
+  if (len < 0 || (size_t)len >= sizeof(g_socket_path)) {
+    fprintf(stderr, "Control socket path is too long.\n");
+    return -1;
+  }
+  return 0;
+}
+
+static struct sockaddr_un socket_address(void) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, g_socket_path, strlen(g_socket_path));
+  return address;
+}
+
+/**
+ * @brief Clears the socket path for bind(), removing a socket left behind
+ *        by a daemon that is gone.
+ *
+ * Only a socket that refuses connections is removed. A live daemon's socket
+ * or anything that is not a socket is left alone.
+ *
+ * @return 0 if the path is free, CONTROL_PATH_IN_USE otherwise.
+ */
+static int remove_stale_socket(void) {
+  struct stat st;
+  if (lstat(g_socket_path, &st) != 0) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    fprintf(stderr, "Cannot check %s: %s\n", g_socket_path, strerror(errno));
+    return CONTROL_PATH_IN_USE;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    fprintf(stderr, "%s exists and is not a socket.\n", g_socket_path);
+    return CONTROL_PATH_IN_USE;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return CONTROL_PATH_IN_USE;
+  }
+  struct sockaddr_un address = socket_address();
+  int connected = connect(fd, (struct sockaddr *)&address, sizeof(address));
+  int error = errno;
+  close(fd);
+  if (connected == 0) {
+    fprintf(stderr, "A lockscreen is already listening on %s.\n",
+            g_socket_path);
+    return CONTROL_PATH_IN_USE;
+  }
+  if (error != ECONNREFUSED) {
+    fprintf(stderr, "Cannot check %s: %s\n", g_socket_path, strerror(error));
+    return CONTROL_PATH_IN_USE;
+  }
+  if (unlink(g_socket_path) != 0 && errno != ENOENT) {
+    fprintf(stderr, "Cannot remove stale %s: %s\n", g_socket_path,
+            strerror(errno));
+    return CONTROL_PATH_IN_USE;
+  }
+  return 0;
+}
+
+static void close_client(struct ControlClient *client) {
+  close(client->fd);
+  client->fd = -1;
+  client->length = 0;
+  client->waiting = 0;
+}
+
+/**
+ * @brief Sends one reply line. Replies are tiny, so a full socket buffer
+ *        means the client is not reading; it is dropped rather than waited
+ *        on.
+ */
+static void reply(struct ControlClient *client, const char *text) {
+  size_t len = strlen(text);
+  ssize_t written = send(client->fd, text, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (written != (ssize_t)len) {
+    close_client(client);
+  }
+}
+
+/**
+ * @brief Only the daemon's own user may control it.
+ */
+static int peer_allowed(int fd) {
+  struct ucred credentials;
+  socklen_t size = sizeof(credentials);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+         credentials.uid == getuid();
+}
+
+static void accept_clients(void) {
+  for (;;) {
+    int fd = accept4(g_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    if (!peer_allowed(fd)) {
+      close(fd);
+      continue;
+    }
+
+    struct ControlClient *slot = NULL;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+      if (g_clients[i].fd < 0) {
+        slot = &g_clients[i];
+        break;
+      }
+    }
+    if (!slot) {
+      const char busy[] = "error busy\n";
+      ssize_t written = send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+      (void)written;
+      close(fd);
+      continue;
+    }
+    slot->fd = fd;
+    slot->length = 0;
+    slot->waiting = 0;
+  }
+}
+
+static void handle_command(struct ControlClient *client, const char *command) {
+  char text[512];
+
+  if (strcmp(command, "lock") == 0 || strcmp(command, "lock --wait") == 0) {
+    int wait = strcmp(command, "lock") != 0;
+    if (!atomic_load(&lockscreen_running)) {
+      event_post(EVENT_LOCK);
+    } else if (wait && atomic_load(&lock_presented)) {
+      reply(client, "ok covered\n");
+      return;
+    }
+    if (wait) {
+      client->waiting = 1;
+    } else {
+      reply(client, "ok\n");
+    }
+  } else if (strcmp(command, "status") == 0) {
+    snprintf(text, sizeof(text), "locked=%d covered=%d low_power=%d\n",
+             atomic_load(&lockscreen_running) ? 1 : 0,
+             atomic_load(&lock_presented) ? 1 : 0, low_power_active());
+    reply(client, text);
+  } else if (strcmp(command, "stats") == 0) {
+    stats_format(text, sizeof(text) - 1);
+    strcat(text, "\n");
+    reply(client, text);
+  } else {
+    reply(client, "error unknown command\n");
+  }
+}
+
+/**
+ * @brief Reads what a client sent and runs every complete line.
+ */
+static void read_client(struct ControlClient *client) {
+  for (;;) {
+    ssize_t len = recv(client->fd, client->buffer + client->length,
+                       sizeof(client->buffer) - 1 - client->length, 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_client(client);
+      return;
+    }
+    if (len < 0) {
+      return;
+    }
+    client->length += (size_t)len;
+    client->buffer[client->length] = '\0';
+
+    char *line = client->buffer;
+    char *newline;
+    while (client->fd >= 0 && (newline = strchr(line, '\n'))) {
+      *newline = '\0';
+      if (newline > line && newline[-1] == '\r') {
+        newline[-1] = '\0';
+      }
+      handle_command(client, line);
+      line = newline + 1;
+    }
+    if (client->fd < 0) {
+      return;
+    }
+    client->length = strlen(line);
+    memmove(client->buffer, line, client->length + 1);
+    if (client->length == sizeof(client->buffer) - 1) {
+      reply(client, "error line too long\n");
+      if (client->fd >= 0) {
+        close_client(client);
+      }
+      return;
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Creates the control socket. Most failures only disable the control
+ *        interface; a path held by something else (another daemon, a file)
+ *        is reported separately so the caller can refuse to start.
+ *
+ * @return 0 on success, CONTROL_PATH_IN_USE if the path is taken, -1 on
+ *         other failures.
+ */
+int control_init(void) {
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    g_clients[i].fd = -1;
+  }
+  if (resolve_socket_path() != 0) {
+    return -1;
+  }
+  if (remove_stale_socket() != 0) {
+    return CONTROL_PATH_IN_USE;
+  }
+
+  g_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (g_listen_fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  struct sockaddr_un address = socket_address();
+  if (bind(g_listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(g_listen_fd, LISTEN_BACKLOG) != 0) {
+    fprintf(stderr, "Cannot listen on %s: %s\n", g_socket_path,
+            strerror(errno));
+    close(g_listen_fd);
+    g_listen_fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Closes every connection and removes the socket.
+ */
+void control_cleanup(void) {
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (g_clients[i].fd >= 0) {
+      close_client(&g_clients[i]);
+    }
+  }
+  if (g_listen_fd >= 0) {
+    close(g_listen_fd);
+    g_listen_fd = -1;
+    unlink(g_socket_path);
+  }
+}
+
+/**
+ * @brief Adds the control sockets to a main loop's poll set.
+ *
+ * @param fds Room for at least CONTROL_POLL_FDS entries.
+ * @return Number of entries filled in.
+ */
+int control_pollfds(struct pollfd *fds) {
+  int count = 0;
+  if (g_listen_fd >= 0) {
+    fds[count++] = (struct pollfd){.fd = g_listen_fd, .events = POLLIN};
+  }
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (g_clients[i].fd >= 0) {
+      fds[count++] = (struct pollfd){.fd = g_clients[i].fd, .events = POLLIN};
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Services whatever poll() reported on the control sockets. Main
+ *        thread only.
+ *
+ * @param fds The entries filled in by control_pollfds(), after poll().
+ * @param count Number of entries.
+ */
+void control_dispatch(const struct pollfd *fds, int count) {
+  for (int i = 0; i < count; i++) {
+    if (fds[i].revents == 0) {
+      continue;
+    }
+    if (fds[i].fd == g_listen_fd) {
+      accept_clients();
+      continue;
+    }
+    for (int c = 0; c < CONTROL_MAX_CLIENTS; c++) {
+      if (g_clients[c].fd == fds[i].fd) {
+        read_client(&g_clients[c]);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Answers every "lock --wait" once the first frame of the lock is
+ *        on screen.
+ */
+void control_lock_presented(void) {
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (g_clients[i].fd >= 0 && g_clients[i].waiting) {
+      g_clients[i].waiting = 0;
+      reply(&g_clients[i], "ok covered\n");
+    }
+  }
+}
+
+/**
+ * @brief Fails any "lock --wait" still pending when a lock ends (or never
+ *        started).
+ */
+void control_lock_ended(void) {
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (g_clients[i].fd >= 0 && g_clients[i].waiting) {
+      g_clients[i].waiting = 0;
+      reply(&g_clients[i], "error unlocked before covered\n");
+    }
+  }
+}
+
+/**
+ * @brief Client side of "--command": sends one command to the running
+ *        daemon and prints its reply.
+ *
+ * @param command The command line to send.
+ * @return 0 on success, 1 if the daemon could not be reached or answered
+ *         with an error.
+ */
+int control_send(const char *command) {
+  if (resolve_socket_path() != 0) {
+    return 1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un address = socket_address();
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "Cannot connect to %s: %s\n", g_socket_path,
+            strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  char line[256];
+  snprintf(line, sizeof(line), "%s\n", command);
+  ssize_t written = send(fd, line, strlen(line), MSG_NOSIGNAL);
+
+  char response[512];
+  size_t length = 0;
+  while (written > 0 && length < sizeof(response) - 1) {
+    ssize_t len = recv(fd, response + length, sizeof(response) - 1 - length, 0);
+    if (len <= 0) {
+      break;
+    }
+    length += (size_t)len;
+    if (response[length - 1] == '\n') {
+      break;
+    }
+  }
+  response[length] = '\0';
+  close(fd);
+
+  fputs(response, stdout);
+  fflush(stdout);
+  return (length == 0 || strncmp(response, "error", 5) == 0) ? 1 : 0;
+}
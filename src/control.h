@@ -0,0 +1,33 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/**
+ * @file control.h
+ * @brief Declarations for the Unix domain socket control interface.
+ */
+
+#include <poll.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define CONTROL_MAX_CLIENTS 8
+/* Poll entries a main loop must reserve: the listener plus every client. */
+#define CONTROL_POLL_FDS (1 + CONTROL_MAX_CLIENTS)
+/* control_init(): the socket path belongs to someone else. */
+#define CONTROL_PATH_IN_USE (-2)
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int control_init(void);
+void control_cleanup(void);
+int control_pollfds(struct pollfd *fds);
+void control_dispatch(const struct pollfd *fds, int count);
+void control_lock_presented(void);
+void control_lock_ended(void);
+int control_send(const char *command);
+
+#endif /* CONTROL_H */
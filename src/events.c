@@ -0,0 +1,179 @@
+/**
+ * @file events.c
+ * @brief Lock-free queue carrying requests from worker threads (and signal
+ *        handlers) to the main thread.
+ *
+ * Any thread may post; only the main thread consumes. Each post bumps an
+ * eventfd which the main loops poll next to the X connection, so waking the
+ * lockscreen never involves the X server. The queue is a bounded ring with
+ * per-slot sequence numbers (Vyukov), which keeps posting free of locks and
+ * therefore safe from signal handlers. Redraw requests are coalesced: at
+ * most one sits in the queue at a time.
+ */
+
+#include "events.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+/* Must be a power of two. */
+#define EVENT_QUEUE_SIZE 64
+static const size_t EVENT_QUEUE_MASK = EVENT_QUEUE_SIZE - 1;
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+struct EventSlot {
+  atomic_size_t sequence;
+  enum EventType type;
+};
+
+static struct EventSlot g_slots[EVENT_QUEUE_SIZE];
+static atomic_size_t g_enqueue_pos = 0;
+static size_t g_dequeue_pos = 0; /* Consumer (main thread) only. */
+static atomic_int g_redraw_queued = 0;
+static int g_event_fd = -1;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int enqueue(enum EventType type) {
+  size_t pos = atomic_load_explicit(&g_enqueue_pos, memory_order_relaxed);
+  struct EventSlot *slot;
+  for (;;) {
+    slot = &g_slots[pos & EVENT_QUEUE_MASK];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      /* The slot is free for this position; try to claim it. */
+      if (atomic_compare_exchange_weak_explicit(&g_enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* The consumer has not caught up: the queue is full. */
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&g_enqueue_pos, memory_order_relaxed);
+    }
+  }
+  slot->type = type;
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Creates the eventfd and resets the queue. Must be called before any
+ *        thread that posts events is started.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int events_init(void) {
+  for (size_t i = 0; i < EVENT_QUEUE_SIZE; i++) {
+    atomic_init(&g_slots[i].sequence, i);
+  }
+  g_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (g_event_fd < 0) {
+    perror("eventfd");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Closes the eventfd.
+ */
+void events_cleanup(void) {
+  if (g_event_fd >= 0) {
+    close(g_event_fd);
+    g_event_fd = -1;
+  }
+}
+
+/**
+ * @brief The file descriptor to poll for readability; it becomes readable
+ *        whenever an event has been posted.
+ */
+int events_fd(void) { return g_event_fd; }
+
+/**
+ * @brief Posts an event to the main thread.
+ *
+ * Lock-free and async-signal-safe, so it may be called from any thread or
+ * from a signal handler.
+ *
+ * @param type The event to post.
+ * @return 0 on success (or if an equivalent redraw is already queued), -1 if
+ *         the queue is full.
+ */
+int event_post(enum EventType type) {
+  if (type == EVENT_REDRAW && atomic_exchange(&g_redraw_queued, 1)) {
+    return 0;
+  }
+
+  int saved_errno = errno;
+  int result = enqueue(type);
+  if (result != 0) {
+    if (type == EVENT_REDRAW) {
+      atomic_store(&g_redraw_queued, 0);
+    }
+  } else {
+    uint64_t one = 1;
+    /* Only fails if the counter would overflow, i.e. it is already set. */
+    ssize_t written = write(g_event_fd, &one, sizeof(one));
+    (void)written;
+  }
+  errno = saved_errno;
+  return result;
+}
+
+/**
+ * @brief Resets the eventfd counter. Call before draining the queue with
+ *        event_next(), so that a post racing with the drain still leaves the
+ *        fd readable. Main thread only.
+ */
+void events_clear(void) {
+  uint64_t count;
+  ssize_t len = read(g_event_fd, &count, sizeof(count));
+  (void)len;
+}
+
+/**
+ * @brief Pops the next event. Main thread only.
+ *
+ * @param type Receives the event.
+ * @return 1 if an event was returned, 0 if the queue is empty.
+ */
+int event_next(enum EventType *type) {
+  struct EventSlot *slot = &g_slots[g_dequeue_pos & EVENT_QUEUE_MASK];
+  size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+  if ((intptr_t)sequence - (intptr_t)(g_dequeue_pos + 1) < 0) {
+    return 0;
+  }
+
+  *type = slot->type;
+  atomic_store_explicit(&slot->sequence, g_dequeue_pos + EVENT_QUEUE_SIZE,
+                        memory_order_release);
+  g_dequeue_pos++;
+
+  if (*type == EVENT_REDRAW) {
+    /* From here on a new request must queue another redraw. */
+    atomic_store(&g_redraw_queued, 0);
+  }
+  return 1;
+}
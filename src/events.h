@@ -0,0 +1,40 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/**
+ * @file events.h
+ * @brief Declarations for the internal event queue that wakes the main
+ *        thread.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Type Definitions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Requests handled by the main thread.
+ */
+enum EventType {
+  EVENT_REDRAW,   /**< Something on the lockscreen changed; draw a frame. */
+  EVENT_LOCK,     /**< Lock the screen (ignored while already locked). */
+  EVENT_RELOAD,   /**< Rebuild the backgrounds (deferred while locked). */
+  EVENT_AUTH,     /**< An authentication attempt has an outcome. */
+  EVENT_PREWARM,  /**< The idle lock is near; prepare it ahead of time. */
+  EVENT_COOLDOWN, /**< Activity resumed; release what was prepared. */
+  EVENT_WALLPAPER, /**< The next slideshow wallpaper is ready to be shown. */
+  EVENT_QUIT,      /**< Exit the main loop (deferred while locked). */
+  EVENT_REFINED,   /**< The full-quality blur is ready to be installed. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int events_init(void);
+void events_cleanup(void);
+int events_fd(void);
+int event_post(enum EventType type);
+void events_clear(void);
+int event_next(enum EventType *type);
+
+#endif /* EVENTS_H */
@@ -0,0 +1,490 @@
+/**
+ * @file animation.c
+ * @brief Plays a looping sequence of PNG frames as the lockscreen background.
+ *
+ * A dedicated decode thread loads each frame, scales it once per distinct
+ * screen geometry and pushes the result into a small ring buffer. The main
+ * thread pops whichever frame is due when it redraws, so decoding never runs
+ * on the thread that handles key presses. The decode thread also paces
+ * playback: it requests a redraw when the next frame is due, drops frames it
+ * cannot decode in time, and sleeps while the main loop reports the displays
+ * off.
+ */
+
+#include "animation.h"
+#include "../config.h"
+#include "../lockscreen.h"
+#include "graphics.h"
+#include <cairo/cairo.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define ANIMATION_RING_SIZE 3 /* Decoded frames kept ahead of playback. */
+
+static const int DECODE_THREAD_NICE = 10;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief One decoded frame, pre-scaled for every screen.
+ */
+struct AnimationFrame {
+  cairo_surface_t **screens; /**< One surface per screen (shared by size). */
+  int64_t sequence;          /**< Monotonic frame number across loops. */
+};
+
+/**
+ * @brief Running average and maximum of a timed operation.
+ */
+struct FrameTimer {
+  long count;
+  int64_t total_ns;
+  int64_t max_ns;
+};
+
+/**
+ * @brief State shared between the decode thread and the main thread.
+ */
+struct Animation {
+  char **paths;      /**< Sorted frame file paths. */
+  int num_paths;     /**< Number of frames in one loop. */
+  int64_t interval_ns;
+
+  struct AnimationFrame ring[ANIMATION_RING_SIZE];
+  int head;  /**< Oldest queued frame. */
+  int count; /**< Number of queued frames. */
+
+  int64_t start_ns;      /**< Presentation time of sequence 0. */
+  int64_t next_sequence; /**< Next frame the decoder will produce. */
+  int paused;            /**< Displays are off; nothing is presented. */
+  int64_t last_requested; /**< Sequence of the last redraw requested. */
+  int stop;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  struct FrameTimer decode;
+  struct FrameTimer present;
+  long dropped;
+};
+
+static struct Animation *g_animation = NULL;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void timer_add(struct FrameTimer *timer, int64_t elapsed_ns) {
+  timer->count++;
+  timer->total_ns += elapsed_ns;
+  if (elapsed_ns > timer->max_ns) {
+    timer->max_ns = elapsed_ns;
+  }
+}
+
+static int is_png_file(const struct dirent *entry) {
+  size_t len = strlen(entry->d_name);
+  return len > 4 && strcasecmp(entry->d_name + len - 4, ".png") == 0;
+}
+
+/**
+ * @brief Lists the PNG frames of a directory in name order.
+ *
+ * @return Number of frames found, 0 if none or on error.
+ */
+static int load_frame_list(const char *dir, char ***paths_out) {
+  struct dirent **entries = NULL;
+  int n = scandir(dir, &entries, is_png_file, alphasort);
+  if (n <= 0) {
+    free(entries);
+    return 0;
+  }
+
+  char **paths = calloc((size_t)n, sizeof(char *));
+  for (int i = 0; i < n; i++) {
+    if (paths && asprintf(&paths[i], "%s/%s", dir, entries[i]->d_name) < 0) {
+      paths[i] = NULL;
+    }
+    free(entries[i]);
+  }
+  free(entries);
+
+  if (!paths) {
+    return 0;
+  }
+  *paths_out = paths;
+  return n;
+}
+
+static void release_frame(struct AnimationFrame *frame) {
+  if (!frame->screens) {
+    return;
+  }
+  for (int i = 0; i < display_config->num_screens; i++) {
+    if (frame->screens[i]) {
+      cairo_surface_destroy(frame->screens[i]);
+    }
+  }
+  free(frame->screens);
+  frame->screens = NULL;
+}
+
+/**
+ * @brief Decodes one frame and scales it once per distinct screen size.
+ *
+ * @return 0 on success, -1 if the frame could not be loaded.
+ */
+static int decode_frame(const char *path, struct AnimationFrame *frame) {
+  cairo_surface_t *image = cairo_image_surface_create_from_png(path);
+  if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(image);
+    return -1;
+  }
+
+  frame->screens = calloc((size_t)display_config->num_screens,
+                          sizeof(cairo_surface_t *));
+  if (!frame->screens) {
+    cairo_surface_destroy(image);
+    return -1;
+  }
+
+  for (int i = 0; i < display_config->num_screens; i++) {
+    const XineramaScreenInfo *info = &display_config->screen_info[i];
+
+    /* Screens of the same size share one scaled copy. */
+    for (int j = 0; j < i; j++) {
+      if (frame->screens[j] &&
+          display_config->screen_info[j].width == info->width &&
+          display_config->screen_info[j].height == info->height) {
+        frame->screens[i] = cairo_surface_reference(frame->screens[j]);
+        break;
+      }
+    }
+    if (!frame->screens[i]) {
+      frame->screens[i] =
+          create_scaled_image(image, info->width, info->height);
+    }
+    if (!frame->screens[i]) {
+      cairo_surface_destroy(image);
+      release_frame(frame);
+      return -1;
+    }
+  }
+
+  cairo_surface_destroy(image);
+  return 0;
+}
+
+static void deadline_to_timespec(int64_t deadline_ns, struct timespec *ts) {
+  ts->tv_sec = (time_t)(deadline_ns / 1000000000LL);
+  ts->tv_nsec = (long)(deadline_ns % 1000000000LL);
+}
+
+/**
+ * @brief Decode thread: keeps the ring full and paces presentation.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+static void *animation_loop(void *arg __attribute__((unused))) {
+  struct Animation *anim = g_animation;
+
+  /* Stay out of the way of the session and of our own input handling. */
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DECODE_THREAD_NICE);
+
+  pthread_mutex_lock(&anim->lock);
+  while (!anim->stop) {
+    /* Displays off: nothing to decode for until animation_set_paused(0). */
+    if (anim->paused) {
+      pthread_cond_wait(&anim->changed, &anim->lock);
+      continue;
+    }
+
+    int64_t now = monotonic_ns();
+
+    /* Ask the main thread to present the oldest queued frame once due. */
+    if (anim->count > 0) {
+      int64_t sequence = anim->ring[anim->head].sequence;
+      int64_t due = anim->start_ns + sequence * anim->interval_ns;
+      if (now >= due && sequence != anim->last_requested) {
+        anim->last_requested = sequence;
+        pthread_mutex_unlock(&anim->lock);
+        request_redraw();
+        pthread_mutex_lock(&anim->lock);
+        continue;
+      }
+    }
+
+    if (anim->count < ANIMATION_RING_SIZE) {
+      int64_t sequence = anim->next_sequence++;
+      int64_t due = anim->start_ns + sequence * anim->interval_ns;
+
+      /* Already late for this frame: skip it rather than fall further back. */
+      if (monotonic_ns() > due + anim->interval_ns) {
+        anim->dropped++;
+        continue;
+      }
+
+      const char *path = anim->paths[sequence % anim->num_paths];
+      pthread_mutex_unlock(&anim->lock);
+
+      struct AnimationFrame frame = {.screens = NULL, .sequence = sequence};
+      int64_t decode_start = monotonic_ns();
+      int result = path ? decode_frame(path, &frame) : -1;
+      int64_t decode_time = monotonic_ns() - decode_start;
+
+      pthread_mutex_lock(&anim->lock);
+      if (result != 0) {
+        anim->dropped++;
+        continue;
+      }
+      timer_add(&anim->decode, decode_time);
+      int tail = (anim->head + anim->count) % ANIMATION_RING_SIZE;
+      anim->ring[tail] = frame;
+      anim->count++;
+      continue;
+    }
+
+    /*
+     * Ring is full: sleep until the oldest frame is due, or, if it has already
+     * been requested, until the main thread pops it (or a frame goes by).
+     */
+    int64_t deadline =
+        anim->start_ns + anim->ring[anim->head].sequence * anim->interval_ns;
+    if (anim->ring[anim->head].sequence == anim->last_requested) {
+      deadline = now + anim->interval_ns;
+    }
+    struct timespec ts;
+    deadline_to_timespec(deadline, &ts);
+    int wait = pthread_cond_timedwait(&anim->changed, &anim->lock, &ts);
+    if (wait != 0 && wait != ETIMEDOUT) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&anim->lock);
+
+  return NULL;
+}
+
+static void print_timer(const char *name, const struct FrameTimer *timer) {
+  if (timer->count == 0) {
+    printf("  %s: no frames\n", name);
+    return;
+  }
+  printf("  %s: %ld frames, avg %.2f ms, max %.2f ms\n", name, timer->count,
+         (double)timer->total_ns / (double)timer->count / 1e6,
+         (double)timer->max_ns / 1e6);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reports whether an animation frame directory is configured.
+ *
+ * @return 1 if enabled, 0 otherwise.
+ */
+int animation_enabled(void) {
+  struct Options options;
+  get_options(&options);
+  return options.animation[0] != '\0';
+}
+
+/**
+ * @brief Starts the decode thread for this lock.
+ *
+ * @return 0 on success, non-zero on failure (the static background is kept).
+ */
+int animation_start(void) {
+  struct Options options;
+  get_options(&options);
+  const char *dir = options.animation;
+  if (dir[0] == '\0' || g_animation) {
+    return -1;
+  }
+
+  struct Animation *anim = calloc(1, sizeof(struct Animation));
+  if (!anim) {
+    return -1;
+  }
+
+  anim->num_paths = load_frame_list(dir, &anim->paths);
+  if (anim->num_paths == 0) {
+    fprintf(stderr, "No PNG frames found in %s.\n", dir);
+    free(anim);
+    return -1;
+  }
+
+  anim->interval_ns = 1000000000LL / options.fps;
+  anim->start_ns = monotonic_ns();
+  anim->last_requested = -1;
+
+  pthread_mutex_init(&anim->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&anim->changed, &attr);
+  pthread_condattr_destroy(&attr);
+
+  g_animation = anim;
+  if (pthread_create(&anim->thread, NULL, animation_loop, NULL) != 0) {
+    fprintf(stderr, "Failed to create animation decode thread.\n");
+    g_animation = NULL;
+    pthread_cond_destroy(&anim->changed);
+    pthread_mutex_destroy(&anim->lock);
+    for (int i = 0; i < anim->num_paths; i++) {
+      free(anim->paths[i]);
+    }
+    free(anim->paths);
+    free(anim);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Stops the decode thread, reports frame statistics and frees every
+ *        queued frame.
+ */
+void animation_stop(void) {
+  struct Animation *anim = g_animation;
+  if (!anim) {
+    return;
+  }
+
+  pthread_mutex_lock(&anim->lock);
+  anim->stop = 1;
+  pthread_cond_broadcast(&anim->changed);
+  pthread_mutex_unlock(&anim->lock);
+  pthread_join(anim->thread, NULL);
+  g_animation = NULL;
+
+  printf("Animation statistics:\n");
+  print_timer("decode", &anim->decode);
+  print_timer("present", &anim->present);
+  printf("  dropped: %ld frames\n", anim->dropped);
+
+  while (anim->count > 0) {
+    release_frame(&anim->ring[anim->head]);
+    anim->head = (anim->head + 1) % ANIMATION_RING_SIZE;
+    anim->count--;
+  }
+  for (int i = 0; i < anim->num_paths; i++) {
+    free(anim->paths[i]);
+  }
+  free(anim->paths);
+  pthread_cond_destroy(&anim->changed);
+  pthread_mutex_destroy(&anim->lock);
+  free(anim);
+}
+
+/**
+ * @brief Pauses playback while the displays are off, and resumes it where it
+ *        left off (rather than racing to catch up) when they come back.
+ *        Main thread only.
+ *
+ * @param paused Non-zero to pause.
+ */
+void animation_set_paused(int paused) {
+  struct Animation *anim = g_animation;
+  if (!anim) {
+    return;
+  }
+
+  pthread_mutex_lock(&anim->lock);
+  if (!paused && anim->paused) {
+    int64_t resume_sequence = anim->count > 0 ? anim->ring[anim->head].sequence
+                                              : anim->next_sequence;
+    anim->start_ns = monotonic_ns() - resume_sequence * anim->interval_ns;
+    anim->last_requested = -1;
+  }
+  anim->paused = paused;
+  pthread_cond_broadcast(&anim->changed);
+  pthread_mutex_unlock(&anim->lock);
+}
+
+/**
+ * @brief Installs the newest due frame as every screen's background.
+ *
+ * Frames that became due while the main thread was busy are dropped so
+ * playback never lags behind the clock. Must be called from the main thread.
+ *
+ * @return 1 if a new frame was painted into the background, 0 otherwise.
+ */
+int animation_present(void) {
+  struct Animation *anim = g_animation;
+  if (!anim) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&anim->lock);
+  if (anim->paused || anim->count == 0) {
+    pthread_mutex_unlock(&anim->lock);
+    return 0;
+  }
+
+  int64_t now = monotonic_ns();
+  struct AnimationFrame frame = {.screens = NULL, .sequence = -1};
+  while (anim->count > 0) {
+    struct AnimationFrame *oldest = &anim->ring[anim->head];
+    if (anim->start_ns + oldest->sequence * anim->interval_ns > now) {
+      break;
+    }
+    if (frame.screens) {
+      release_frame(&frame);
+      anim->dropped++;
+    }
+    frame = *oldest;
+    oldest->screens = NULL;
+    anim->head = (anim->head + 1) % ANIMATION_RING_SIZE;
+    anim->count--;
+  }
+  if (frame.screens) {
+    /* A slot was freed; let the decoder refill it. */
+    pthread_cond_signal(&anim->changed);
+  }
+  pthread_mutex_unlock(&anim->lock);
+
+  if (!frame.screens) {
+    return 0;
+  }
+
+  int64_t present_start = monotonic_ns();
+  for (int i = 0; i < display_config->num_screens; i++) {
+    /* Each frame crosses the wire once; module redraws reuse the copy. */
+    cairo_pattern_t *pattern =
+        cairo_pattern_create_for_surface(frame.screens[i]);
+    install_background(i, pattern);
+    cairo_pattern_destroy(pattern);
+  }
+  release_frame(&frame);
+
+  pthread_mutex_lock(&anim->lock);
+  timer_add(&anim->present, monotonic_ns() - present_start);
+  pthread_mutex_unlock(&anim->lock);
+  return 1;
+}
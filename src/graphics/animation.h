@@ -0,0 +1,19 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+/**
+ * @file animation.h
+ * @brief Declarations for the animated background engine.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int animation_enabled(void);
+int animation_start(void);
+void animation_stop(void);
+void animation_set_paused(int paused);
+int animation_present(void);
+
+#endif /* ANIMATION_H */
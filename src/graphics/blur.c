@@ -0,0 +1,767 @@
+/**
+ * @file blur.c
+ * @brief Captures the current contents of each monitor at lock time and turns
+ *        them into a blurred background.
+ *
+ * The capture is downscaled before blurring: a wide blur throws away all high
+ * frequency detail anyway, so working on a 1/BLUR_DOWNSCALE image and letting
+ * cairo upscale it bilinearly gives the same look for a fraction of the cost.
+ * The blur itself is three box passes (a close Gaussian approximation), each
+ * split into a horizontal and a vertical sweep and spread over all cores by
+ * row bands.
+ *
+ * In progressive mode the lock does not wait for that: a much cheaper
+ * placeholder (1/BLUR_PLACEHOLDER_DOWNSCALE, a single pass) covers the
+ * screens first, and the capture is kept until the full-quality blur
+ * replaces it after the first frame. That blur runs on a worker thread,
+ * which posts EVENT_REFINED for the main thread to install the result, so
+ * the lock keeps answering input meanwhile.
+ */
+
+#include "blur.h"
+#include "../config.h"
+#include "../events.h"
+#include "../lockscreen.h"
+#include "../utils.h"
+#include "graphics.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define BLUR_MAX_THREADS 32
+
+static const int BLUR_DOWNSCALE = 4;   /* Capture is averaged in 4x4 blocks. */
+static const int BLUR_RADIUS = 6;      /* Box radius in downscaled pixels. */
+static const int BLUR_PASSES = 3;      /* Three box passes ~ Gaussian. */
+static const int BLUR_MIN_BAND_ROWS = 16;
+/* Placeholder: 8x8 blocks, one pass of the same on-screen radius. */
+static const int BLUR_PLACEHOLDER_DOWNSCALE = 8;
+static const int BLUR_PLACEHOLDER_RADIUS = 3;
+static const int BLUR_PLACEHOLDER_PASSES = 1;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Work shared by all blur threads.
+ */
+struct BlurJob {
+  uint8_t *pixels;        /**< Destination image, blurred in place. */
+  uint8_t *scratch;       /**< Intermediate image between the two sweeps. */
+  int width;              /**< Width of the destination in pixels. */
+  int height;             /**< Height of the destination in pixels. */
+  int stride;             /**< Bytes per destination row. */
+  int radius;             /**< Box radius in pixels. */
+  int passes;             /**< Number of box passes. */
+  const uint8_t *source;  /**< Optional full-size source to downscale from. */
+  int source_stride;      /**< Bytes per source row. */
+  int factor;             /**< Downscale factor applied to the source. */
+  pthread_barrier_t barrier;
+  pthread_mutex_t gate_lock; /**< Holds workers until bands are assigned. */
+  pthread_cond_t gate_cond;
+  int gate_open;
+};
+
+/**
+ * @brief One band of rows handled by a single blur thread.
+ */
+struct BlurBand {
+  struct BlurJob *job;
+  int row_start;
+  int row_end;
+};
+
+/**
+ * @brief A screen capture waiting for its full-quality blur.
+ */
+struct PendingCapture {
+  XImage *image; /**< NULL if nothing is pending for the screen. */
+  XShmSegmentInfo shm_info;
+  cairo_surface_t *refined; /**< The worker's full-quality blur, or NULL. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Per-screen captures kept by capture_blurred_placeholder(). Main thread,
+ * except for the refine worker while it runs.
+ */
+static struct PendingCapture *g_pending = NULL;
+static pthread_t g_refine_thread;
+static int g_refine_started = 0; /* Main thread only. */
+static atomic_int g_refine_cancel = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static inline int clamp_index(int value, int max) {
+  if (value < 0) {
+    return 0;
+  }
+  return (value > max) ? max : value;
+}
+
+/**
+ * @brief Averages factor x factor blocks of the source into one band of the
+ *        destination.
+ *
+ * Source rows are first summed vertically into a full-width accumulator
+ * (contiguous, so it vectorises), which is then reduced horizontally.
+ */
+static void downscale_rows(const struct BlurJob *job, int row_start,
+                           int row_end, uint16_t *acc) {
+  const int row_bytes = job->width * 4;
+  const int source_bytes = row_bytes * job->factor;
+  const int factor = job->factor;
+  const uint32_t area = (uint32_t)(factor * factor);
+  const uint32_t inv_area = (65536 + area / 2) / area;
+
+  for (int y = row_start; y < row_end; y++) {
+    const uint8_t *restrict first =
+        job->source + (size_t)(y * factor) * job->source_stride;
+    for (int i = 0; i < source_bytes; i++) {
+      acc[i] = first[i];
+    }
+    for (int fy = 1; fy < factor; fy++) {
+      const uint8_t *restrict src =
+          job->source + (size_t)(y * factor + fy) * job->source_stride;
+      for (int i = 0; i < source_bytes; i++) {
+        acc[i] += src[i];
+      }
+    }
+
+    uint8_t *restrict dst = job->pixels + (size_t)y * job->stride;
+    for (int x = 0; x < job->width; x++) {
+      const uint16_t *block = acc + (size_t)x * factor * 4;
+      uint32_t sum[4] = {0, 0, 0, 0};
+      for (int fx = 0; fx < factor; fx++) {
+        for (int c = 0; c < 4; c++) {
+          sum[c] += block[fx * 4 + c];
+        }
+      }
+      for (int c = 0; c < 4; c++) {
+        dst[x * 4 + c] = (uint8_t)((sum[c] * inv_area + 0x8000) >> 16);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Horizontal running-sum box filter over one row (4 bytes per pixel).
+ */
+static void blur_row_horizontal(const uint8_t *restrict src,
+                                uint8_t *restrict dst, int width, int radius,
+                                uint32_t mul) {
+  const int last = width - 1;
+  uint32_t acc[4];
+
+  for (int c = 0; c < 4; c++) {
+    acc[c] = (uint32_t)(radius + 1) * src[c];
+  }
+  for (int i = 1; i <= radius; i++) {
+    const uint8_t *p = src + clamp_index(i, last) * 4;
+    for (int c = 0; c < 4; c++) {
+      acc[c] += p[c];
+    }
+  }
+
+  /* Clamped edges are handled separately so the middle loop has no branches. */
+  int middle_start = (radius < width) ? radius : width;
+  int middle_end = width - radius - 1;
+  if (middle_end < middle_start) {
+    middle_end = middle_start;
+  }
+
+  for (int x = 0; x < middle_start; x++) {
+    const uint8_t *add = src + clamp_index(x + radius + 1, last) * 4;
+    const uint8_t *sub = src + clamp_index(x - radius, last) * 4;
+    for (int c = 0; c < 4; c++) {
+      dst[x * 4 + c] = (uint8_t)((acc[c] * mul + 0x8000) >> 16);
+      acc[c] = acc[c] + add[c] - sub[c];
+    }
+  }
+  for (int x = middle_start; x < middle_end; x++) {
+    const uint8_t *add = src + (x + radius + 1) * 4;
+    const uint8_t *sub = src + (x - radius) * 4;
+    for (int c = 0; c < 4; c++) {
+      dst[x * 4 + c] = (uint8_t)((acc[c] * mul + 0x8000) >> 16);
+      acc[c] = acc[c] + add[c] - sub[c];
+    }
+  }
+  for (int x = middle_end; x < width; x++) {
+    const uint8_t *add = src + clamp_index(x + radius + 1, last) * 4;
+    const uint8_t *sub = src + clamp_index(x - radius, last) * 4;
+    for (int c = 0; c < 4; c++) {
+      dst[x * 4 + c] = (uint8_t)((acc[c] * mul + 0x8000) >> 16);
+      acc[c] = acc[c] + add[c] - sub[c];
+    }
+  }
+}
+
+/**
+ * @brief Vertical running-sum box filter over a band of rows.
+ *
+ * The accumulator holds one column sum per byte of a row, so every inner loop
+ * walks a contiguous row and is vectorised by the compiler.
+ */
+static void blur_band_vertical(const struct BlurJob *job, int row_start,
+                               int row_end, uint32_t mul, uint32_t *acc) {
+  const int row_bytes = job->width * 4;
+  const int last = job->height - 1;
+  const int radius = job->radius;
+  const uint8_t *src = job->scratch;
+
+  memset(acc, 0, (size_t)row_bytes * sizeof(uint32_t));
+  for (int k = -radius; k <= radius; k++) {
+    const uint8_t *restrict row =
+        src + (size_t)clamp_index(row_start + k, last) * job->stride;
+    for (int i = 0; i < row_bytes; i++) {
+      acc[i] += row[i];
+    }
+  }
+
+  for (int y = row_start; y < row_end; y++) {
+    uint8_t *restrict dst = job->pixels + (size_t)y * job->stride;
+    const uint8_t *restrict add =
+        src + (size_t)clamp_index(y + radius + 1, last) * job->stride;
+    const uint8_t *restrict sub =
+        src + (size_t)clamp_index(y - radius, last) * job->stride;
+    for (int i = 0; i < row_bytes; i++) {
+      dst[i] = (uint8_t)((acc[i] * mul + 0x8000) >> 16);
+      acc[i] = acc[i] + add[i] - sub[i];
+    }
+  }
+}
+
+/**
+ * @brief Thread entry point: downscale (optional) then blur one band.
+ */
+static void *blur_band_worker(void *arg) {
+  struct BlurBand *band = (struct BlurBand *)arg;
+  struct BlurJob *job = band->job;
+
+  pthread_mutex_lock(&job->gate_lock);
+  while (!job->gate_open) {
+    pthread_cond_wait(&job->gate_cond, &job->gate_lock);
+  }
+  pthread_mutex_unlock(&job->gate_lock);
+
+  const uint32_t diameter = (uint32_t)(2 * job->radius + 1);
+  const uint32_t mul = (65536 + diameter / 2) / diameter;
+
+  /* Sized for a full source row when downscaling, one output row otherwise. */
+  size_t acc_len = (size_t)job->width * 4 * (job->source ? job->factor : 1);
+  uint32_t *acc = malloc(acc_len * sizeof(uint32_t));
+
+  if (job->source && acc) {
+    /* Sums of BLUR_DOWNSCALE rows of bytes fit comfortably in 16 bits. */
+    downscale_rows(job, band->row_start, band->row_end, (uint16_t *)acc);
+  }
+  pthread_barrier_wait(&job->barrier);
+
+  for (int pass = 0; pass < job->passes && acc; pass++) {
+    for (int y = band->row_start; y < band->row_end; y++) {
+      blur_row_horizontal(job->pixels + (size_t)y * job->stride,
+                          job->scratch + (size_t)y * job->stride, job->width,
+                          job->radius, mul);
+    }
+    /* The vertical sweep reads scratch rows owned by neighbouring bands. */
+    pthread_barrier_wait(&job->barrier);
+    blur_band_vertical(job, band->row_start, band->row_end, mul, acc);
+    /* The next horizontal sweep overwrites rows other bands may still read. */
+    pthread_barrier_wait(&job->barrier);
+  }
+
+  if (!acc) {
+    /* Keep the barrier count consistent even though we did no work. */
+    for (int pass = 0; pass < job->passes; pass++) {
+      pthread_barrier_wait(&job->barrier);
+      pthread_barrier_wait(&job->barrier);
+    }
+  }
+  free(acc);
+  return NULL;
+}
+
+/**
+ * @brief Splits a blur job into row bands and runs them on all cores.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int run_blur_job(struct BlurJob *job) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int num_threads = (cores > 0) ? (int)cores : 1;
+  int max_by_rows = job->height / BLUR_MIN_BAND_ROWS;
+  if (num_threads > max_by_rows) {
+    num_threads = max_by_rows;
+  }
+  if (num_threads > BLUR_MAX_THREADS) {
+    num_threads = BLUR_MAX_THREADS;
+  }
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
+  job->scratch = malloc((size_t)job->stride * job->height);
+  if (!job->scratch) {
+    fprintf(stderr, "Failed to allocate blur scratch buffer.\n");
+    return -1;
+  }
+
+  pthread_t threads[BLUR_MAX_THREADS];
+  struct BlurBand bands[BLUR_MAX_THREADS];
+  pthread_mutex_init(&job->gate_lock, NULL);
+  pthread_cond_init(&job->gate_cond, NULL);
+  job->gate_open = 0;
+
+  /*
+   * Start the helpers first; they wait at the gate until we know how many
+   * actually started, so a failed pthread_create() only means fewer bands.
+   * The calling thread takes band 0 itself.
+   */
+  int started = 1;
+  for (int i = 1; i < num_threads; i++) {
+    bands[i].job = job;
+    if (pthread_create(&threads[i], NULL, blur_band_worker, &bands[i]) != 0) {
+      break;
+    }
+    started++;
+  }
+
+  int rows_per_band = (job->height + started - 1) / started;
+  for (int i = 0; i < started; i++) {
+    bands[i].job = job;
+    bands[i].row_start = i * rows_per_band;
+    bands[i].row_end = (i + 1) * rows_per_band;
+    if (bands[i].row_end > job->height) {
+      bands[i].row_end = job->height;
+    }
+  }
+  pthread_barrier_init(&job->barrier, NULL, (unsigned)started);
+
+  pthread_mutex_lock(&job->gate_lock);
+  job->gate_open = 1;
+  pthread_cond_broadcast(&job->gate_cond);
+  pthread_mutex_unlock(&job->gate_lock);
+
+  blur_band_worker(&bands[0]);
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&job->gate_cond);
+  pthread_mutex_destroy(&job->gate_lock);
+  pthread_barrier_destroy(&job->barrier);
+  free(job->scratch);
+  job->scratch = NULL;
+  return 0;
+}
+
+/**
+ * @brief Grabs a region of the root window, preferring MIT-SHM.
+ *
+ * @param shm_info Filled in when the shared memory path is used; the caller
+ *                 must release it with release_capture().
+ * @return The captured image, or NULL on failure.
+ */
+static XImage *capture_root_region(int x, int y, int width, int height,
+                                   XShmSegmentInfo *shm_info) {
+  Display *display = display_config->display;
+  int screen = DefaultScreen(display);
+  Window root = RootWindow(display, screen);
+
+  shm_info->shmid = -1;
+  shm_info->shmaddr = NULL;
+
+  if (XShmQueryExtension(display)) {
+    XImage *image = XShmCreateImage(display, DefaultVisual(display, screen),
+                                    DefaultDepth(display, screen), ZPixmap,
+                                    NULL, shm_info, width, height);
+    if (image) {
+      shm_info->shmid = shmget(IPC_PRIVATE,
+                               (size_t)image->bytes_per_line * image->height,
+                               IPC_CREAT | 0600);
+      if (shm_info->shmid >= 0) {
+        shm_info->shmaddr = image->data = shmat(shm_info->shmid, NULL, 0);
+        shm_info->readOnly = False;
+        if (shm_info->shmaddr != (char *)-1 && XShmAttach(display, shm_info)) {
+          /* Mark for removal now; it is freed once both sides detach. */
+          shmctl(shm_info->shmid, IPC_RMID, NULL);
+          if (XShmGetImage(display, root, image, x, y, AllPlanes)) {
+            return image;
+          }
+          XShmDetach(display, shm_info);
+        } else {
+          shmctl(shm_info->shmid, IPC_RMID, NULL);
+        }
+        if (shm_info->shmaddr != (char *)-1) {
+          shmdt(shm_info->shmaddr);
+        }
+      }
+      image->data = NULL;
+      XDestroyImage(image);
+      shm_info->shmid = -1;
+      shm_info->shmaddr = NULL;
+    }
+  }
+
+  /* Fall back to a plain round-trip through the X socket. */
+  return XGetImage(display, root, x, y, (unsigned)width, (unsigned)height,
+                   AllPlanes, ZPixmap);
+}
+
+/**
+ * @brief Releases an image returned by capture_root_region().
+ */
+static void release_capture(XImage *image, XShmSegmentInfo *shm_info) {
+  if (shm_info->shmaddr) {
+    XShmDetach(display_config->display, shm_info);
+    shmdt(shm_info->shmaddr);
+    image->data = NULL;
+  }
+  XDestroyImage(image);
+}
+
+#ifdef DEBUG
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1000.0 +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+#endif
+
+/**
+ * @brief Captures the screen's current contents.
+ *
+ * @return The image (32 bpp), or NULL on failure.
+ */
+static XImage *capture_screen(int screen_num, XShmSegmentInfo *shm_info) {
+  const XineramaScreenInfo *info = &display_config->screen_info[screen_num];
+  XImage *image = capture_root_region(info->x_org, info->y_org, info->width,
+                                      info->height, shm_info);
+  if (!image) {
+    fprintf(stderr, "Failed to capture screen %d for blur.\n", screen_num);
+    return NULL;
+  }
+  if (image->bits_per_pixel != 32) {
+    fprintf(stderr, "Blur needs a 32 bpp root window (got %d bpp).\n",
+            image->bits_per_pixel);
+    release_capture(image, shm_info);
+    return NULL;
+  }
+  return image;
+}
+
+/**
+ * @brief Downscales and blurs a capture. Touches neither X nor the screens,
+ *        so it may run on any thread.
+ *
+ * @param factor Downscale factor.
+ * @param radius Box radius in downscaled pixels.
+ * @param passes Number of box passes.
+ * @return The blurred image (1/factor of the screen), or NULL on failure.
+ */
+static cairo_surface_t *blur_capture(int screen_num, const XImage *image,
+                                     int factor, int radius, int passes) {
+  const XineramaScreenInfo *info = &display_config->screen_info[screen_num];
+  int low_width = info->width / factor;
+  int low_height = info->height / factor;
+  if (low_width < 1 || low_height < 1) {
+    return NULL;
+  }
+
+  cairo_surface_t *blurred =
+      cairo_image_surface_create(CAIRO_FORMAT_RGB24, low_width, low_height);
+  if (cairo_surface_status(blurred) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(blurred);
+    return NULL;
+  }
+
+  cairo_surface_flush(blurred);
+  struct BlurJob job = {
+      .pixels = cairo_image_surface_get_data(blurred),
+      .width = low_width,
+      .height = low_height,
+      .stride = cairo_image_surface_get_stride(blurred),
+      .radius = radius,
+      .passes = passes,
+      .source = (const uint8_t *)image->data,
+      .source_stride = image->bytes_per_line,
+      .factor = factor,
+  };
+  int result = run_blur_job(&job);
+  cairo_surface_mark_dirty(blurred);
+
+  if (result != 0) {
+    cairo_surface_destroy(blurred);
+    return NULL;
+  }
+  return blurred;
+}
+
+/**
+ * @brief Installs a blurred image from blur_capture() as the screen's
+ *        background source. Main thread only.
+ *
+ * @param text_color Non-zero to also pick the text color from the image.
+ */
+static void install_blurred_surface(int screen_num, cairo_surface_t *blurred,
+                                    int text_color) {
+  const XineramaScreenInfo *info = &display_config->screen_info[screen_num];
+  int low_width = cairo_image_surface_get_width(blurred);
+  int low_height = cairo_image_surface_get_height(blurred);
+
+  /* Stretch the small blurred image back over the whole screen. */
+  cairo_pattern_t *pattern = cairo_pattern_create_for_surface(blurred);
+  cairo_matrix_t matrix;
+  cairo_matrix_init_scale(&matrix, (double)low_width / info->width,
+                          (double)low_height / info->height);
+  cairo_pattern_set_matrix(pattern, &matrix);
+  cairo_pattern_set_filter(pattern, CAIRO_FILTER_BILINEAR);
+  cairo_pattern_set_extend(pattern, CAIRO_EXTEND_PAD);
+
+  /*
+   * The small image is uploaded and stretched on the server once; later
+   * repaints reuse the result rather than scaling it again.
+   */
+  install_background(screen_num, pattern);
+
+  if (text_color) {
+    determine_text_color(blurred, low_width, low_height);
+  }
+  cairo_pattern_destroy(pattern);
+}
+
+/**
+ * @brief Downscales and blurs a capture and installs the result as the
+ *        screen's background source. Main thread only.
+ *
+ * @param text_color Non-zero to also pick the text color from the result.
+ * @return 0 on success, non-zero on failure (the previous background stays).
+ */
+static int install_blurred(int screen_num, const XImage *image, int factor,
+                           int radius, int passes, int text_color) {
+  cairo_surface_t *blurred =
+      blur_capture(screen_num, image, factor, radius, passes);
+  if (!blurred) {
+    return -1;
+  }
+  install_blurred_surface(screen_num, blurred, text_color);
+  cairo_surface_destroy(blurred);
+  return 0;
+}
+
+/**
+ * @brief Thread function that computes the full-quality blur of every
+ *        pending capture, then wakes the main thread with EVENT_REFINED.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+static void *refine_worker(void *arg __attribute__((unused))) {
+  for (int i = 0; i < display_config->num_screens; i++) {
+    if (atomic_load(&g_refine_cancel)) {
+      return NULL;
+    }
+    struct PendingCapture *pending = &g_pending[i];
+    if (pending->image) {
+      pending->refined = blur_capture(i, pending->image, BLUR_DOWNSCALE,
+                                      BLUR_RADIUS, BLUR_PASSES);
+    }
+  }
+  if (event_post(EVENT_REFINED) != 0) {
+    fprintf(stderr, "Failed to hand over the refined backgrounds.\n");
+  }
+  return NULL;
+}
+
+/**
+ * @brief Waits for the refine worker, if one was started.
+ */
+static void join_refine_worker(void) {
+  if (g_refine_started) {
+    pthread_join(g_refine_thread, NULL);
+    g_refine_started = 0;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reports whether the blurred-screenshot background mode is enabled.
+ *
+ * @return 1 if enabled, 0 otherwise.
+ */
+int blur_background_enabled(void) {
+  struct Options options;
+  get_options(&options);
+  return options.blur;
+}
+
+/**
+ * @brief Captures the screen's current contents, blurs them and installs the
+ *        result as the screen's background source.
+ *
+ * Must be called from the main thread, before the lock windows are mapped.
+ *
+ * @param screen_num Index of the screen to capture.
+ * @return 0 on success, non-zero on failure (the previous background stays).
+ */
+int capture_blurred_background(int screen_num) {
+#ifdef DEBUG
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  XShmSegmentInfo shm_info;
+  XImage *image = capture_screen(screen_num, &shm_info);
+  if (!image) {
+    return -1;
+  }
+  int result = install_blurred(screen_num, image, BLUR_DOWNSCALE, BLUR_RADIUS,
+                               BLUR_PASSES, 1);
+  release_capture(image, &shm_info);
+
+#ifdef DEBUG
+  const XineramaScreenInfo *info = &display_config->screen_info[screen_num];
+  fprintf(stderr, "Blurred screen %d (%dx%d) in %.2f ms\n", screen_num,
+          info->width, info->height, elapsed_ms(&start));
+#endif
+  return result;
+}
+
+/**
+ * @brief Like capture_blurred_background(), but installs a cheap placeholder
+ *        and keeps the capture for refine_blurred_backgrounds().
+ *
+ * Must be called from the main thread, before the lock windows are mapped.
+ *
+ * @param screen_num Index of the screen to capture.
+ * @return 0 on success, non-zero on failure (the previous background stays).
+ */
+int capture_blurred_placeholder(int screen_num) {
+  if (!g_pending) {
+    g_pending = calloc((size_t)display_config->num_screens, sizeof(*g_pending));
+    if (!g_pending) {
+      return capture_blurred_background(screen_num);
+    }
+  }
+  struct PendingCapture *pending = &g_pending[screen_num];
+  if (pending->image) {
+    release_capture(pending->image, &pending->shm_info);
+    pending->image = NULL;
+  }
+
+  XImage *image = capture_screen(screen_num, &pending->shm_info);
+  if (!image) {
+    return -1;
+  }
+  if (install_blurred(screen_num, image, BLUR_PLACEHOLDER_DOWNSCALE,
+                      BLUR_PLACEHOLDER_RADIUS, BLUR_PLACEHOLDER_PASSES,
+                      1) != 0) {
+    release_capture(image, &pending->shm_info);
+    return -1;
+  }
+  pending->image = image;
+  return 0;
+}
+
+/**
+ * @brief Starts computing the full-quality blur of every placeholder's
+ *        capture on a worker thread. Main thread only.
+ *
+ * EVENT_REFINED is posted once the results are ready for
+ * install_refined_backgrounds().
+ *
+ * @return 0 if the worker was started, -1 if there is nothing to refine
+ *         (or no thread could be started; the placeholders then stay).
+ */
+int refine_blurred_backgrounds(void) {
+  if (!g_pending || g_refine_started) {
+    return -1;
+  }
+  atomic_store(&g_refine_cancel, 0);
+  if (pthread_create(&g_refine_thread, NULL, refine_worker, NULL) != 0) {
+    perror("pthread_create");
+    return -1;
+  }
+  g_refine_started = 1;
+  return 0;
+}
+
+/**
+ * @brief Replaces every placeholder with the worker's full-quality blur of
+ *        the same capture, and releases the captures. Main thread only; call
+ *        on EVENT_REFINED.
+ *
+ * The text color picked for the placeholder is kept, so the modules need
+ * not be rendered again.
+ *
+ * @return The number of screens whose background changed.
+ */
+int install_refined_backgrounds(void) {
+  if (!g_pending || !g_refine_started) {
+    return 0;
+  }
+  join_refine_worker();
+  int refined = 0;
+  for (int i = 0; i < display_config->num_screens; i++) {
+    struct PendingCapture *pending = &g_pending[i];
+    if (pending->refined) {
+      install_blurred_surface(i, pending->refined, 0);
+      cairo_surface_destroy(pending->refined);
+      pending->refined = NULL;
+      refined++;
+    }
+    if (pending->image) {
+      release_capture(pending->image, &pending->shm_info);
+      pending->image = NULL;
+    }
+  }
+  return refined;
+}
+
+/**
+ * @brief Drops captures that were never refined, e.g. because the lock
+ *        ended first, stopping the worker if it is still busy. Called when
+ *        a lock ends.
+ */
+void discard_blurred_placeholders(void) {
+  if (!g_pending) {
+    return;
+  }
+  atomic_store(&g_refine_cancel, 1);
+  join_refine_worker();
+  for (int i = 0; i < display_config->num_screens; i++) {
+    if (g_pending[i].refined) {
+      cairo_surface_destroy(g_pending[i].refined);
+    }
+    if (g_pending[i].image) {
+      release_capture(g_pending[i].image, &g_pending[i].shm_info);
+    }
+  }
+  free(g_pending);
+  g_pending = NULL;
+}
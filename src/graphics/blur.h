@@ -0,0 +1,20 @@
+#ifndef BLUR_H
+#define BLUR_H
+
+/**
+ * @file blur.h
+ * @brief Declarations for the blurred-screenshot background mode.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int blur_background_enabled(void);
+int capture_blurred_background(int screen_num);
+int capture_blurred_placeholder(int screen_num);
+int refine_blurred_backgrounds(void);
+int install_refined_backgrounds(void);
+void discard_blurred_placeholders(void);
+
+#endif /* BLUR_H */
@@ -0,0 +1,205 @@
+/**
+ * @file fonts.c
+ * @brief Resolves the lockscreen font once and shares its scaled fonts.
+ *
+ * The configured family is matched through fontconfig a single time at
+ * startup and wrapped in one cairo font face. Screens and modules then draw
+ * with a few shared cairo_scaled_font_t objects, one per size, instead of
+ * going through the toy font API, which looks the font up again for every
+ * context and every cairo_set_font_size(). The time spent in fontconfig is
+ * printed at startup.
+ */
+
+#include "fonts.h"
+#include "../lockscreen.h"
+#include <cairo/cairo-ft.h>
+#include <cairo/cairo.h>
+#include <fontconfig/fontconfig.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+/* Sizes kept as shared scaled fonts; others go through cairo's own cache. */
+#define SCALED_FONT_SLOTS 8
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief The font face at one size.
+ */
+struct ScaledFontSlot {
+  double size;
+  cairo_scaled_font_t *font;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/* All of these are only touched from the main thread. */
+static cairo_font_face_t *g_face = NULL;
+static cairo_font_options_t *g_font_options = NULL;
+static struct ScaledFontSlot g_scaled[SCALED_FONT_SLOTS];
+static int g_scaled_count = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Matches a fontconfig pattern ("Family", "Family:bold", ...) to an
+ *        installed font and creates a cairo face for it.
+ *
+ * @return The face, or NULL if nothing matched.
+ */
+static cairo_font_face_t *match_font(const char *family) {
+  FcPattern *pattern = FcNameParse((const FcChar8 *)family);
+  if (!pattern) {
+    return NULL;
+  }
+  FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+  FcDefaultSubstitute(pattern);
+
+  FcResult result;
+  FcPattern *match = FcFontMatch(NULL, pattern, &result);
+  FcPatternDestroy(pattern);
+  if (!match) {
+    return NULL;
+  }
+
+  FcChar8 *file = NULL;
+  if (FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch) {
+    printf("Font '%s' is %s.\n", family, (const char *)file);
+  }
+  /* cairo keeps its own copy of the pattern. */
+  cairo_font_face_t *face = cairo_ft_font_face_create_for_pattern(match);
+  FcPatternDestroy(match);
+  if (cairo_font_face_status(face) != CAIRO_STATUS_SUCCESS) {
+    cairo_font_face_destroy(face);
+    return NULL;
+  }
+  return face;
+}
+
+/**
+ * @brief Returns the shared scaled font for a size, creating it if a slot
+ *        is free.
+ *
+ * @return The scaled font, or NULL if the size is not shared.
+ */
+static cairo_scaled_font_t *scaled_font(double size) {
+  for (int i = 0; i < g_scaled_count; i++) {
+    if (g_scaled[i].size == size) {
+      return g_scaled[i].font;
+    }
+  }
+  if (!g_face || g_scaled_count == SCALED_FONT_SLOTS) {
+    return NULL;
+  }
+
+  /* Render like the toy API would on the screens: same hinting, AA, ... */
+  if (!g_font_options) {
+    g_font_options = cairo_font_options_create();
+    cairo_surface_get_font_options(screen_configs[0].surface, g_font_options);
+  }
+  cairo_matrix_t font_matrix;
+  cairo_matrix_t ctm;
+  cairo_matrix_init_scale(&font_matrix, size, size);
+  cairo_matrix_init_identity(&ctm);
+  cairo_scaled_font_t *font =
+      cairo_scaled_font_create(g_face, &font_matrix, &ctm, g_font_options);
+  if (cairo_scaled_font_status(font) != CAIRO_STATUS_SUCCESS) {
+    cairo_scaled_font_destroy(font);
+    return NULL;
+  }
+  g_scaled[g_scaled_count++] = (struct ScaledFontSlot){size, font};
+  return font;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Resolves the lockscreen font. Call once at startup, before any
+ *        text is measured or drawn.
+ *
+ * Falls back to cairo's toy font API (which does its own matching) if
+ * fontconfig finds nothing.
+ *
+ * @param family A fontconfig pattern, usually just the family name.
+ */
+void fonts_init(const char *family) {
+  int64_t start_ns = monotonic_ns();
+  if (!FcInit()) {
+    fprintf(stderr, "Failed to initialize fontconfig.\n");
+  }
+  int64_t loaded_ns = monotonic_ns();
+  g_face = match_font(family);
+  int64_t matched_ns = monotonic_ns();
+
+  if (!g_face) {
+    fprintf(stderr, "No font matches '%s'; using cairo's default.\n",
+            family);
+    g_face = cairo_toy_font_face_create(family, CAIRO_FONT_SLANT_NORMAL,
+                                        CAIRO_FONT_WEIGHT_NORMAL);
+  }
+  printf("Fontconfig took %.1f ms (%.1f ms loading its configuration, "
+         "%.1f ms matching).\n",
+         (double)(matched_ns - start_ns) / 1e6,
+         (double)(loaded_ns - start_ns) / 1e6,
+         (double)(matched_ns - loaded_ns) / 1e6);
+  fflush(stdout);
+}
+
+/**
+ * @brief Releases the shared fonts, ahead of FcFini().
+ */
+void fonts_cleanup(void) {
+  for (int i = 0; i < g_scaled_count; i++) {
+    cairo_scaled_font_destroy(g_scaled[i].font);
+  }
+  g_scaled_count = 0;
+  if (g_font_options) {
+    cairo_font_options_destroy(g_font_options);
+    g_font_options = NULL;
+  }
+  if (g_face) {
+    cairo_font_face_destroy(g_face);
+    g_face = NULL;
+  }
+}
+
+/**
+ * @brief The lockscreen font face, for contexts that set their own size.
+ */
+cairo_font_face_t *fonts_face(void) { return g_face; }
+
+/**
+ * @brief Selects the lockscreen font at the given size on a context, using
+ *        the shared scaled font for that size. Main thread only.
+ *
+ * @param cr The context to draw or measure with.
+ * @param size Font size in user units.
+ */
+void fonts_set_size(cairo_t *cr, double size) {
+  cairo_scaled_font_t *font = scaled_font(size);
+  if (font) {
+    cairo_set_scaled_font(cr, font);
+    return;
+  }
+  cairo_set_font_face(cr, g_face);
+  cairo_set_font_size(cr, size);
+}
@@ -0,0 +1,21 @@
+#ifndef FONTS_H
+#define FONTS_H
+
+/**
+ * @file fonts.h
+ * @brief Declarations for the lockscreen font, resolved once and shared by
+ *        every screen and module.
+ */
+
+#include <cairo/cairo.h>
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void fonts_init(const char *family);
+void fonts_cleanup(void);
+cairo_font_face_t *fonts_face(void);
+void fonts_set_size(cairo_t *cr, double size);
+
+#endif /* FONTS_H */
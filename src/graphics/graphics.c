@@ -6,13 +6,20 @@
  */
 
 #include "graphics.h"
-#include "../args.h"
+#include "../config.h"
+#include "../events.h"
 #include "../lockscreen.h"
 #include "../utils.h"
+#include "animation.h"
+#include "fonts.h"
+#include "modules/module.h"
+#include "shared_background.h"
+#include "slideshow.h"
 #include <X11/Xlib.h>
 #include <cairo/cairo-xlib.h>
 #include <cairo/cairo.h>
 #include <ctype.h>
+#include <limits.h>
 #include <malloc.h>
 #include <pthread.h>
 #include <stdio.h>
@@ -21,27 +28,33 @@
 /* ------------------------------------------------------------------------- */
 /* Forward Declarations                                                      */
 /* ------------------------------------------------------------------------- */
-static cairo_surface_t *load_background_image(void);
+static cairo_surface_t *load_background_image(const char *image_path);
 static int setup_screen(int screen_num, cairo_surface_t *image_surface);
+static void setup_background(int screen_num, cairo_surface_t *image_surface);
+static cairo_surface_t *prepare_background(const struct Options *options);
+static int shared_backgrounds_cover_screens(void);
 static void parse_color_to_rgba(const char *color_str, double *r, double *g,
                                 double *b, double *a);
-static const char *g_color_arg = NULL;
+static char g_color[16] = "#000000";
+/* The image option (file or slideshow source) the backgrounds came from. */
+static char g_image_source[PATH_MAX] = "";
+/* A background was installed since the last frame, erasing the modules. */
+static int g_background_installed = 0;
 
 /* ------------------------------------------------------------------------- */
 /* Function Definitions                                                      */
 /* ------------------------------------------------------------------------- */
 
 /**
- * @brief Loads a background image from the file path specified by the
- *        "--image" command-line argument.
+ * @brief Loads a background image from the configured file path.
  *
+ * @param image_path Path to the PNG image, or an empty string for none.
  * @return A pointer to the created Cairo surface, or NULL if loading failed
- *         or no image argument was provided.
+ *         or no image was configured.
  */
-static cairo_surface_t *load_background_image(void) {
-  const char *image_path = retrieve_command_arg("--image");
-  if (!image_path) {
-    /* No --image argument provided at all. */
+static cairo_surface_t *load_background_image(const char *image_path) {
+  if (image_path[0] == '\0') {
+    /* No image configured at all. */
     return NULL;
   }
 
@@ -126,6 +139,80 @@ static void parse_color_to_rgba(const char *color_str, double *r, double *g,
   }
 }
 
+/**
+ * @brief Paints one screen's background_buffer from the image surface, or
+ *        from the configured color when there is no image.
+ *
+ * @param screen_num Index of the screen to paint.
+ * @param image_surface The loaded background image, or NULL.
+ */
+static void setup_background(int screen_num, cairo_surface_t *image_surface) {
+  /* Replace, never blend with, whatever background was there before. */
+  cairo_set_operator(screen_configs[screen_num].background_buffer,
+                     CAIRO_OPERATOR_SOURCE);
+
+  int width = display_config->screen_info[screen_num].width;
+  int height = display_config->screen_info[screen_num].height;
+  cairo_surface_t *shared = shared_background_lookup(width, height);
+  if (shared) {
+    /* Already decoded and scaled for this size by the supervisor. */
+    cairo_pattern_t *pattern = cairo_pattern_create_for_surface(shared);
+    install_background(screen_num, pattern);
+    cairo_pattern_destroy(pattern);
+    determine_text_color(shared, width, height);
+    cairo_surface_destroy(shared);
+    return;
+  }
+
+  if (image_surface) {
+    /*
+     * Create a pattern from the loaded image surface, scale it to fit, and
+     * upload the result to the server once.
+     */
+    cairo_pattern_t *pattern = cairo_pattern_create_for_surface(image_surface);
+
+    /* Calculate scaling so the image fits the screen. */
+    double image_width = (double)cairo_image_surface_get_width(image_surface);
+    double image_height = (double)cairo_image_surface_get_height(image_surface);
+    double screen_width = (double)display_config->screen_info[screen_num].width;
+    double screen_height =
+        (double)display_config->screen_info[screen_num].height;
+
+    double x_scale = image_width / screen_width;
+    double y_scale = image_height / screen_height;
+    double scale_factor = (x_scale < y_scale) ? x_scale : y_scale;
+
+    /* Invert the scale factor so we scale the pattern down to the screen size.
+     */
+    cairo_matrix_t matrix;
+    cairo_matrix_init_scale(&matrix, scale_factor, scale_factor);
+    cairo_pattern_set_matrix(pattern, &matrix);
+
+    install_background(screen_num, pattern);
+    cairo_pattern_destroy(pattern);
+
+    /*
+     * Optionally analyze the loaded background for text color.
+     * Must happen before the 'image_surface' is destroyed.
+     */
+    determine_text_color(image_surface,
+                         display_config->screen_info[screen_num].width,
+                         display_config->screen_info[screen_num].height);
+  } else {
+    /*
+     * Fill the background with the provided color if image_surface is NULL.
+     */
+    double r, g, b, a;
+    parse_color_to_rgba(g_color, &r, &g, &b, &a);
+
+    cairo_pattern_t *pattern = cairo_pattern_create_rgba(r, g, b, a);
+    install_background(screen_num, pattern);
+    cairo_pattern_destroy(pattern);
+
+    determine_text_color_for_color(r, g, b);
+  }
+}
+
 /**
  * @brief Sets up the graphics objects (surfaces, contexts, patterns) for
  *        one screen, based on the given background image surface or a color.
@@ -171,105 +258,135 @@ static int setup_screen(int screen_num, cairo_surface_t *image_surface) {
   screen_configs[screen_num].background_buffer =
       cairo_create(screen_configs[screen_num].off_screen_buffer);
 
-  /* Set a font face on overlay context (just an example). */
-  cairo_font_face_t *font_face = cairo_toy_font_face_create(
-      "JetBrainsMono NF", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_face(screen_configs[screen_num].overlay_buffer, font_face);
-  cairo_font_face_destroy(font_face); // the context holds its own reference
+  /* Every screen shares the font resolved by fonts_init(). */
+  cairo_set_font_face(screen_configs[screen_num].overlay_buffer, fonts_face());
 
-  if (image_surface) {
-    /*
-     * Create a pattern from the loaded image surface, scale to fit,
-     * and paint onto a temporary surface. Then copy the result
-     * to the background_buffer.
-     */
-    cairo_surface_t *temp_surface = cairo_surface_create_similar(
-        screen_configs[screen_num].surface, CAIRO_CONTENT_COLOR_ALPHA,
-        display_config->screen_info[screen_num].width,
-        display_config->screen_info[screen_num].height);
-
-    cairo_t *temp_cr = cairo_create(temp_surface);
-
-    cairo_pattern_t *pattern = cairo_pattern_create_for_surface(image_surface);
-
-    /* Calculate scaling so the image fits the screen. */
-    double image_width = (double)cairo_image_surface_get_width(image_surface);
-    double image_height = (double)cairo_image_surface_get_height(image_surface);
-    double screen_width = (double)display_config->screen_info[screen_num].width;
-    double screen_height =
-        (double)display_config->screen_info[screen_num].height;
-
-    double x_scale = image_width / screen_width;
-    double y_scale = image_height / screen_height;
-    double scale_factor = (x_scale < y_scale) ? x_scale : y_scale;
-
-    /* Invert the scale factor so we scale the pattern down to the screen size.
-     */
-    cairo_matrix_t matrix;
-    cairo_matrix_init_scale(&matrix, scale_factor, scale_factor);
-    cairo_pattern_set_matrix(pattern, &matrix);
-
-    /* Paint onto the temporary context. */
-    cairo_set_source(temp_cr, pattern);
-    cairo_paint(temp_cr);
-
-    /* Copy the temporary surface into the long-lived background_buffer. */
-    cairo_set_source_surface(screen_configs[screen_num].background_buffer,
-                             temp_surface, 0, 0);
-    cairo_paint(screen_configs[screen_num].background_buffer);
-
-    /* Cleanup temporary resources. */
-    cairo_destroy(temp_cr);
-    cairo_surface_destroy(temp_surface);
-    cairo_pattern_destroy(pattern);
+  setup_background(screen_num, image_surface);
+  return 0; // Success
+}
 
-    /*
-     * Optionally analyze the loaded background for text color.
-     * Must happen before the 'image_surface' is destroyed.
-     */
-    determine_text_color(image_surface,
-                         display_config->screen_info[screen_num].width,
-                         display_config->screen_info[screen_num].height);
-  } else {
-    /*
-     * Fill the background with the provided color if image_surface is NULL.
-     */
-    double r, g, b, a;
-    parse_color_to_rgba(g_color_arg, &r, &g, &b, &a);
+/**
+ * @brief Scales an image so it covers a screen of the given size, the same
+ *        way setup_screen() scales the static background.
+ *
+ * Only touches image surfaces, so it is safe to call from worker threads.
+ *
+ * @param image_surface The source image.
+ * @param width Target width in pixels.
+ * @param height Target height in pixels.
+ * @return A new RGB24 image surface, or NULL on failure.
+ */
+cairo_surface_t *create_scaled_image(cairo_surface_t *image_surface, int width,
+                                     int height) {
+  cairo_surface_t *scaled =
+      cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  if (cairo_surface_status(scaled) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(scaled);
+    return NULL;
+  }
 
-    cairo_set_source_rgba(screen_configs[screen_num].background_buffer, r, g, b,
-                          a);
-    cairo_paint(screen_configs[screen_num].background_buffer);
+  double x_scale =
+      (double)cairo_image_surface_get_width(image_surface) / (double)width;
+  double y_scale =
+      (double)cairo_image_surface_get_height(image_surface) / (double)height;
+  double scale_factor = (x_scale < y_scale) ? x_scale : y_scale;
+
+  cairo_pattern_t *pattern = cairo_pattern_create_for_surface(image_surface);
+  cairo_matrix_t matrix;
+  cairo_matrix_init_scale(&matrix, scale_factor, scale_factor);
+  cairo_pattern_set_matrix(pattern, &matrix);
+
+  cairo_t *cr = cairo_create(scaled);
+  cairo_set_source(cr, pattern);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_pattern_destroy(pattern);
+
+  return scaled;
+}
 
-    determine_text_color_for_color(r, g, b);
+/**
+ * @brief Checks whether the supervisor handed down a decoded background for
+ *        every screen, in which case the image need not be loaded here.
+ */
+static int shared_backgrounds_cover_screens(void) {
+  if (!shared_backgrounds_available()) {
+    return 0;
   }
-  return 0; // Success
+  for (int i = 0; i < display_config->num_screens; i++) {
+    cairo_surface_t *shared =
+        shared_background_lookup(display_config->screen_info[i].width,
+                                 display_config->screen_info[i].height);
+    if (!shared) {
+      return 0;
+    }
+    cairo_surface_destroy(shared);
+  }
+  return 1;
 }
 
 /**
- * @brief Initializes graphics resources for the lockscreen.
+ * @brief Loads the configured background image (the first wallpaper of a
+ *        slideshow, which is restarted), or records the configured color
+ *        when there is no usable image.
  *
- * This includes setting up surfaces, contexts, and loading the background
- * image exactly once. If the image fails or isn't provided, we use a color.
+ * @param options The options to take the image path and color from.
+ * @return The loaded image surface, or NULL if the color should be used.
  */
-void initialize_graphics(void) {
-  /* 1) Try loading the background image from the command-line argument. */
-  display_config->image_surface = load_background_image();
+static cairo_surface_t *prepare_background(const struct Options *options) {
+  /* 1) Try loading the background image. */
+  char first[PATH_MAX];
+  const char *image_path = options->image;
+  slideshow_close();
+  switch (slideshow_open(options->image, first, sizeof(first))) {
+  case 1:
+    image_path = first;
+    break;
+  case -1:
+    image_path = "";
+    break;
+  default:
+    break;
+  }
+  cairo_surface_t *image_surface = load_background_image(image_path);
 
   /*
-   * 2) If there's no valid surface, check the --color argument.
+   * 2) If there's no valid surface, use the configured color.
    *    If that is missing too, we use a black background.
    */
-  if (!display_config->image_surface) {
-    g_color_arg = retrieve_command_arg("--color");
-    if (!g_color_arg) {
+  if (!image_surface) {
+    if (options->color[0] != '\0') {
+      snprintf(g_color, sizeof(g_color), "%s", options->color);
+    } else {
       fprintf(
           stderr,
           "No --color or --image argument provided. Using black background\n");
       // black background by default
-      g_color_arg = "#000000";
+      snprintf(g_color, sizeof(g_color), "%s", "#000000");
     }
   }
+  return image_surface;
+}
+
+/**
+ * @brief Initializes graphics resources for the lockscreen.
+ *
+ * This includes setting up surfaces, contexts, and loading the background
+ * image exactly once. If the image fails or isn't provided, we use a color.
+ */
+void initialize_graphics(void) {
+  struct Options options;
+  get_options(&options);
+
+  /* Match the font once, for every screen and module. */
+  fonts_init(options.font);
+
+  /* 1) and 2) Load the background image, or fall back to a color. */
+  snprintf(g_image_source, sizeof(g_image_source), "%s", options.image);
+  display_config->image_surface = shared_backgrounds_cover_screens()
+                                      ? NULL
+                                      : prepare_background(&options);
 
   /* 3) Initialize each screen using the loaded image or color. */
   for (int screen_num = 0; screen_num < display_config->num_screens;
@@ -279,6 +396,9 @@ void initialize_graphics(void) {
       return;
     }
   }
+  if (modules_init() != 0) {
+    return;
+  }
 
   /*
    * 4) Now that each screen’s background_buffer has a copy of the image
@@ -293,49 +413,151 @@ void initialize_graphics(void) {
 }
 
 /**
- * @brief Sends a custom X event to the root window to trigger a redraw on all
- * screens.
+ * @brief Rebuilds every screen's background after the image or color
+ *        option changed, leaving windows, surfaces and fonts untouched.
  *
- * @param display Pointer to the X display.
- * @param root_window The root window of the X display.
+ * Must be called from the main thread while the screen is not locked.
  */
-void request_redraw(Display *display) {
-  XClientMessageEvent ev = {0};
-  ev.type = ClientMessage;
-  ev.message_type = redraw_atom; // The custom atom
-  ev.format = 32;                // Data format (32 bits)
-  ev.data.l[0] = 0; // Can be used to pass additional data if needed
-
-  // Dispatch the event to each lockscreen window
-  for (int i = 0; i < display_config->num_screens; i++) {
-    ev.window = screen_configs[i].window;
-    XSendEvent(display, screen_configs[i].window, False, StructureNotifyMask,
-               (XEvent *)&ev);
+void reload_backgrounds(void) {
+  struct Options options;
+  get_options(&options);
+
+  /*
+   * Copies shared by a supervisor show the old image once it changed; for
+   * anything else (the color, the slideshow interval) they stay valid.
+   */
+  if (strcmp(options.image, g_image_source) != 0) {
+    shared_backgrounds_release();
+    snprintf(g_image_source, sizeof(g_image_source), "%s", options.image);
   }
+  cairo_surface_t *image_surface =
+      shared_backgrounds_cover_screens() ? NULL : prepare_background(&options);
+  for (int screen_num = 0; screen_num < display_config->num_screens;
+       screen_num++) {
+    setup_background(screen_num, image_surface);
+  }
+  if (image_surface) {
+    cairo_surface_destroy(image_surface);
+  }
+  malloc_trim(0);
+}
 
-  XFlush(display); // Ensure events are sent immediately
+/**
+ * @brief Makes a pattern the background of one screen.
+ *
+ * The pattern is rendered once into a server-side picture (an X Pixmap)
+ * which becomes the background_buffer's source. repaint_background_at()
+ * then restores areas with a server-side composite instead of sending
+ * pixels, however often modules are redrawn. Main thread only.
+ *
+ * @param screen_num Index of the screen.
+ * @param pattern The new background, in screen coordinates.
+ */
+void install_background(int screen_num, cairo_pattern_t *pattern) {
+  struct ScreenConfig *screen = &screen_configs[screen_num];
+  if (!screen->background_picture) {
+    screen->background_picture = cairo_surface_create_similar(
+        screen->surface, CAIRO_CONTENT_COLOR_ALPHA,
+        display_config->screen_info[screen_num].width,
+        display_config->screen_info[screen_num].height);
+  }
+
+  cairo_t *cr = cairo_create(screen->background_picture);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source(cr, pattern);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+
+  /*
+   * The background_buffer's source is what repaint_background_at() restores.
+   * Paint it under the modules right away too.
+   */
+  cairo_t *bg_cr = screen->background_buffer;
+  cairo_set_source_surface(bg_cr, screen->background_picture, 0, 0);
+  cairo_save(bg_cr);
+  cairo_set_operator(bg_cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(bg_cr);
+  cairo_restore(bg_cr);
+  g_background_installed = 1;
+}
+
+/**
+ * @brief Uploads the glyphs a module is going to draw to the X server ahead
+ *        of time, so the first lock does not pay for it. Call from a
+ *        module's init().
+ *
+ * cairo keeps one server-side glyph set per font and size for the
+ * connection, so drawing the characters once anywhere is enough.
+ *
+ * @param font_size Size the module draws at.
+ * @param text The characters it may draw.
+ */
+void preload_glyphs(double font_size, const char *text) {
+  cairo_surface_t *scratch = cairo_surface_create_similar(
+      screen_configs[0].surface, CAIRO_CONTENT_ALPHA, 1, 1);
+  cairo_t *cr = cairo_create(scratch);
+  fonts_set_size(cr, font_size);
+  cairo_move_to(cr, 0, 0);
+  cairo_show_text(cr, text);
+  cairo_destroy(cr);
+  cairo_surface_destroy(scratch);
 }
 
+/**
+ * @brief Asks the main thread to draw a frame. Safe to call from any thread;
+ *        does not talk to the X server.
+ */
+void request_redraw(void) { event_post(EVENT_REDRAW); }
+
 /**
  * @brief Draw the final screen content by compositing the off-screen buffers
  *        onto the on-screen surfaces.
+ *
+ * Only modules whose output changed are rendered again, a new background
+ * frame just blends the cached module layers back on top, and only the
+ * damaged area is copied to the windows, so a redraw with nothing to do is
+ * free.
  * This function should never be called outside the main thread as cairo is not
  * thread-safe, instead use request_redraw().
+ *
+ * @param full_repaint Non-zero to copy the whole off-screen buffer, e.g.
+ *                     after an Expose or for the first frame of a lock.
  */
-void draw_graphics(void) {
-  /* Redraw UI elements on each screen. */
+void draw_graphics(int full_repaint) {
+  /* Swap in the next animation frame, if one is due. */
+  animation_present();
+  /* That, or e.g. a refined blur, needs the module layers blended again. */
+  int background_changed = g_background_installed;
+  g_background_installed = 0;
+  modules_update();
+  if (background_changed) {
+    full_repaint = 1;
+  }
+
   for (int screen_num = 0; screen_num < display_config->num_screens;
        screen_num++) {
-    /* First draw overlay components like password entry and clock. */
-    draw_password_entry(screen_num);
-    draw_clock(screen_num);
+    /* First bring the module layers up to date and blend them. */
+    struct ModuleBounds damage;
+    int damaged = modules_render(screen_num, background_changed, &damage);
+    if (!damaged && !full_repaint) {
+      continue;
+    }
 
     /* Paint the off-screen content onto the on-screen context. */
-    cairo_set_source_surface(screen_configs[screen_num].screen_buffer,
+    cairo_t *screen_cr = screen_configs[screen_num].screen_buffer;
+    cairo_save(screen_cr);
+    if (!full_repaint) {
+      cairo_rectangle(screen_cr, damage.x, damage.y, damage.width,
+                      damage.height);
+      cairo_clip(screen_cr);
+    }
+    cairo_set_source_surface(screen_cr,
                              screen_configs[screen_num].off_screen_buffer, 0,
                              0);
-    cairo_paint(screen_configs[screen_num].screen_buffer);
+    cairo_paint(screen_cr);
+    cairo_restore(screen_cr);
   }
+  modules_frame_done();
 }
 
 /**
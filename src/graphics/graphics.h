@@ -14,12 +14,15 @@
 /* Function Declarations                                                     */
 /* ------------------------------------------------------------------------- */
 
-void draw_password_entry(int screen_num);
-void draw_clock(int screen_num);
 void initialize_graphics(void);
-void draw_graphics(void);
+void reload_backgrounds(void);
+void draw_graphics(int full_repaint);
 int get_opposite_color(int color);
 void repaint_background_at(int x, int y, int width, int height, int screen_num);
 void exit_cleanup(void);
-void request_redraw(Display *display);
+void request_redraw(void);
+void install_background(int screen_num, cairo_pattern_t *pattern);
+void preload_glyphs(double font_size, const char *text);
+cairo_surface_t *create_scaled_image(cairo_surface_t *image_surface, int width,
+                                     int height);
 #endif /* GRAPHICS_H */
@@ -0,0 +1,457 @@
+/**
+ * @file battery.c
+ * @brief Shows the battery level and AC state on the lockscreen.
+ *
+ * Nothing is polled. A watcher thread sleeps on a NETLINK_KOBJECT_UEVENT
+ * socket and rereads /sys/class/power_supply only when the kernel reports a
+ * power_supply event. The supply directories are also watched with inotify:
+ * real sysfs never fires there, but a fake tree (see SYSFS_ROOT_ENV) does, so
+ * the module can be driven by writing files. A redraw is requested only when
+ * the rounded value on screen would change.
+ */
+
+#include "battery.h"
+#include "../../lockscreen.h"
+#include "../fonts.h"
+#include "../graphics.h"
+#include <dirent.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const double FONT_SIZE = 24.0;
+/* Environment variable pointing at an alternative sysfs root, for testing. */
+static const char *const SYSFS_ROOT_ENV = "MINIMALIST_LOCKSCREEN_SYSFS";
+static const char *const POWER_SUPPLY_SUBPATH = "class/power_supply";
+/* Kernel (not udev) uevent multicast group. */
+static const unsigned int UEVENT_KERNEL_GROUP = 1;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief What the module displays. Compared as a whole to decide whether a
+ *        redraw is needed, so it only holds rounded values.
+ */
+struct BatteryState {
+  int present;  /**< At least one battery was found. */
+  int percent;  /**< Combined charge, rounded to a whole percent. */
+  int charging; /**< A battery reports "Charging". */
+  int on_ac;    /**< A non-battery supply is online. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static char g_supply_path[PATH_MAX];
+static pthread_t g_watch_thread;
+static int g_watch_started = 0;
+/* Written by the watcher thread, read by update() on the main thread. */
+static struct BatteryState g_latest;
+static pthread_mutex_t g_latest_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Main thread only. */
+static struct BatteryState g_shown;
+static char g_text[64];
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reads the first line of <supply>/<attribute>, without the newline.
+ *
+ * @return 0 on success, -1 if the attribute is missing or unreadable.
+ */
+static int read_attribute(const char *supply, const char *attribute,
+                          char *out, size_t size) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", g_supply_path, supply, attribute);
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return -1;
+  }
+  int ok = fgets(out, (int)size, file) != NULL;
+  fclose(file);
+  if (!ok) {
+    return -1;
+  }
+  out[strcspn(out, "\n")] = '\0';
+  return 0;
+}
+
+static long read_long_attribute(const char *supply, const char *attribute) {
+  char value[32];
+  if (read_attribute(supply, attribute, value, sizeof(value)) != 0) {
+    return -1;
+  }
+  return strtol(value, NULL, 10);
+}
+
+/**
+ * @brief Reads every supply and combines the batteries into one state.
+ *
+ * Batteries are weighted by capacity (energy or charge) when the driver
+ * exposes it, otherwise their "capacity" percentages are averaged.
+ */
+static void read_battery_state(struct BatteryState *state) {
+  memset(state, 0, sizeof(*state));
+
+  DIR *dir = opendir(g_supply_path);
+  if (!dir) {
+    return;
+  }
+
+  double now_total = 0.0;
+  double full_total = 0.0;
+  long percent_total = 0;
+  int percent_count = 0;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    char type[32];
+    if (read_attribute(entry->d_name, "type", type, sizeof(type)) != 0) {
+      continue;
+    }
+
+    if (strcmp(type, "Battery") != 0) {
+      if (read_long_attribute(entry->d_name, "online") == 1) {
+        state->on_ac = 1;
+      }
+      continue;
+    }
+    if (read_long_attribute(entry->d_name, "present") == 0) {
+      continue;
+    }
+    state->present = 1;
+
+    char status[32];
+    if (read_attribute(entry->d_name, "status", status, sizeof(status)) == 0 &&
+        strcmp(status, "Charging") == 0) {
+      state->charging = 1;
+    }
+
+    long now = read_long_attribute(entry->d_name, "energy_now");
+    long full = read_long_attribute(entry->d_name, "energy_full");
+    if (now < 0 || full <= 0) {
+      now = read_long_attribute(entry->d_name, "charge_now");
+      full = read_long_attribute(entry->d_name, "charge_full");
+    }
+    if (now >= 0 && full > 0) {
+      now_total += (double)now;
+      full_total += (double)full;
+      continue;
+    }
+
+    long percent = read_long_attribute(entry->d_name, "capacity");
+    if (percent >= 0) {
+      percent_total += percent;
+      percent_count++;
+    }
+  }
+  closedir(dir);
+
+  if (full_total > 0.0) {
+    state->percent = (int)(now_total * 100.0 / full_total + 0.5);
+  } else if (percent_count > 0) {
+    state->percent =
+        (int)((percent_total + percent_count / 2) / percent_count);
+  }
+  if (state->percent > 100) {
+    state->percent = 100;
+  }
+}
+
+/**
+ * @brief Publishes a fresh reading and, if it changed what is on screen,
+ *        asks for a redraw.
+ */
+static void refresh_state(void) {
+  struct BatteryState state;
+  read_battery_state(&state);
+
+  pthread_mutex_lock(&g_latest_lock);
+  int changed = memcmp(&state, &g_latest, sizeof(state)) != 0;
+  g_latest = state;
+  pthread_mutex_unlock(&g_latest_lock);
+
+  if (changed) {
+    module_invalidate(&battery_module);
+    if (atomic_load(&lockscreen_running)) {
+      request_redraw();
+    }
+  }
+}
+
+/**
+ * @brief Checks whether a uevent datagram is about a power supply.
+ *
+ * Kernel uevents are "action@devpath" followed by NUL-separated KEY=VALUE
+ * pairs.
+ */
+static int is_power_supply_event(const char *buffer, ssize_t len) {
+  for (const char *field = buffer; field < buffer + len;
+       field += strlen(field) + 1) {
+    if (strcmp(field, "SUBSYSTEM=power_supply") == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Watches the supply directories, so that writes to a fake tree are
+ *        noticed. Also picks up supplies appearing or disappearing.
+ */
+static void add_inotify_watches(int inotify_fd) {
+  inotify_add_watch(inotify_fd, g_supply_path,
+                    IN_CREATE | IN_DELETE | IN_MOVED_TO);
+
+  DIR *dir = opendir(g_supply_path);
+  if (!dir) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_supply_path, entry->d_name);
+    inotify_add_watch(inotify_fd, path, IN_CLOSE_WRITE | IN_MOVED_TO);
+  }
+  closedir(dir);
+}
+
+static void close_fd(void *arg) {
+  int fd = *(int *)arg;
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/**
+ * @brief Thread function that blocks until the kernel (or the fake tree)
+ *        reports a power supply change.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+static void *battery_watch_loop(void *arg __attribute__((unused))) {
+  int uevent_fd =
+      socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (uevent_fd >= 0) {
+    struct sockaddr_nl addr = {.nl_family = AF_NETLINK,
+                               .nl_groups = UEVENT_KERNEL_GROUP};
+    if (bind(uevent_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      perror("Failed to subscribe to power supply uevents");
+      close(uevent_fd);
+      uevent_fd = -1;
+    }
+  }
+
+  int inotify_fd = inotify_init1(IN_CLOEXEC);
+  if (inotify_fd >= 0) {
+    add_inotify_watches(inotify_fd);
+  }
+
+  /* Catch up on anything that changed before the socket was bound. */
+  refresh_state();
+
+  pthread_cleanup_push(close_fd, &uevent_fd);
+  pthread_cleanup_push(close_fd, &inotify_fd);
+  struct pollfd fds[2] = {{.fd = uevent_fd, .events = POLLIN},
+                          {.fd = inotify_fd, .events = POLLIN}};
+  char buffer[8192]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;) {
+    /* poll() is a cancellation point; battery_destroy() cancels us. */
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    int relevant = 0;
+    if (fds[0].revents & POLLIN) {
+      ssize_t len = recv(uevent_fd, buffer, sizeof(buffer) - 1, 0);
+      if (len > 0) {
+        buffer[len] = '\0';
+        relevant = is_power_supply_event(buffer, len);
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+      if (len > 0) {
+        relevant = 1;
+        /* A supply may have appeared; watching twice is harmless. */
+        add_inotify_watches(inotify_fd);
+      }
+    }
+    if (relevant) {
+      refresh_state();
+    }
+  }
+  pthread_cleanup_pop(1);
+  pthread_cleanup_pop(1);
+
+  return NULL;
+}
+
+/**
+ * @brief Places the text centered near the bottom of the screen.
+ */
+static void layout_text(int screen_num, double *x, double *y,
+                        cairo_text_extents_t *extents) {
+  cairo_t *cr = screen_configs[screen_num].overlay_buffer;
+  fonts_set_size(cr, FONT_SIZE);
+  cairo_text_extents(cr, g_text, extents);
+  *x = (display_config->screen_info[screen_num].width / 2.0) -
+       (extents->width / 2.0) - extents->x_bearing;
+  *y = display_config->screen_info[screen_num].height * 0.9;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Module Callbacks                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Starts watching if the machine has a battery.
+ *
+ * @return 0 on success, -1 if there is nothing to show.
+ */
+static int battery_init(void) {
+  const char *root = getenv(SYSFS_ROOT_ENV);
+  snprintf(g_supply_path, sizeof(g_supply_path), "%s/%s",
+           (root && root[0] != '\0') ? root : "/sys", POWER_SUPPLY_SUBPATH);
+
+  read_battery_state(&g_latest);
+  if (!g_latest.present) {
+    return -1;
+  }
+
+  if (pthread_create(&g_watch_thread, NULL, battery_watch_loop, NULL) != 0) {
+    fprintf(stderr, "Failed to create battery watcher thread.\n");
+    return -1;
+  }
+  g_watch_started = 1;
+  preload_glyphs(FONT_SIZE, "0123456789% ChargingPlugged inBattery");
+  return 0;
+}
+
+static void battery_destroy(void) {
+  if (g_watch_started) {
+    pthread_cancel(g_watch_thread);
+    pthread_join(g_watch_thread, NULL);
+    g_watch_started = 0;
+  }
+}
+
+/**
+ * @brief Takes the latest reading from the watcher thread.
+ *
+ * @return 1 if the displayed text changed, 0 otherwise.
+ */
+static int battery_update(void) {
+  pthread_mutex_lock(&g_latest_lock);
+  struct BatteryState state = g_latest;
+  pthread_mutex_unlock(&g_latest_lock);
+
+  if (g_text[0] != '\0' && memcmp(&state, &g_shown, sizeof(state)) == 0) {
+    return 0;
+  }
+  g_shown = state;
+
+  if (!state.present) {
+    g_text[0] = '\0';
+  } else if (state.charging) {
+    snprintf(g_text, sizeof(g_text), "Charging %d%%", state.percent);
+  } else if (state.on_ac) {
+    snprintf(g_text, sizeof(g_text), "Plugged in %d%%", state.percent);
+  } else {
+    snprintf(g_text, sizeof(g_text), "Battery %d%%", state.percent);
+  }
+  return 1;
+}
+
+static void battery_measure(int screen_num, struct ModuleBounds *bounds) {
+  *bounds = (struct ModuleBounds){0, 0, 0, 0};
+  if (g_text[0] == '\0') {
+    return;
+  }
+  double x, y;
+  cairo_text_extents_t extents;
+  layout_text(screen_num, &x, &y, &extents);
+  module_text_bounds(bounds, x, y, &extents);
+}
+
+/**
+ * @brief Draws the battery line on the specified screen.
+ *
+ * @param cr The module's layer.
+ * @param screen_num Index of the screen to draw on.
+ */
+static void battery_render(cairo_t *cr, int screen_num) {
+  if (g_text[0] == '\0') {
+    return;
+  }
+  double x, y;
+  cairo_text_extents_t extents;
+  layout_text(screen_num, &x, &y, &extents);
+
+  fonts_set_size(cr, FONT_SIZE);
+  cairo_set_source_rgba(cr, screen_configs->text_color,
+                        screen_configs->text_color, screen_configs->text_color,
+                        0.8);
+  cairo_move_to(cr, x, y);
+  cairo_show_text(cr, g_text);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reports whether the machine is currently running off its battery.
+ *        Safe to call from any thread.
+ *
+ * @return 1 if a battery is present and no external supply is online, 0
+ *         otherwise (including when there is no battery at all).
+ */
+int battery_discharging(void) {
+  pthread_mutex_lock(&g_latest_lock);
+  int discharging = g_latest.present && !g_latest.on_ac && !g_latest.charging;
+  pthread_mutex_unlock(&g_latest_lock);
+  return discharging;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Module Definition                                                         */
+/* ------------------------------------------------------------------------- */
+
+/* No cadence: the watcher thread invalidates it when the value changes. */
+struct Module battery_module = {
+    .name = "battery",
+    .init = battery_init,
+    .update = battery_update,
+    .measure = battery_measure,
+    .render = battery_render,
+    .destroy = battery_destroy,
+};
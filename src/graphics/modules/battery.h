@@ -0,0 +1,15 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+/**
+ * @file battery.h
+ * @brief Declares the battery/power status module.
+ */
+
+#include "module.h"
+
+extern struct Module battery_module;
+
+int battery_discharging(void);
+
+#endif /* BATTERY_H */
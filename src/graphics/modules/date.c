@@ -1,13 +1,30 @@
 /**
- * @file clock.c
+ * @file date.c
  * @brief Handles displaying the date and time on a lockscreen.
  */
 
+#include "date.h"
 #include "../../lockscreen.h"
+#include "../fonts.h"
 #include "../graphics.h"
 #include <cairo/cairo.h>
+#include <string.h>
 #include <time.h>
-#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const double SMALL_FONT_SIZE = 30.0;
+static const double LARGE_FONT_SIZE = 150.0;
+/* Characters worth uploading ahead of the first lock. */
+static const char *const CLOCK_GLYPHS = "0123456789:";
+static const char *const DATE_GLYPHS =
+    "0123456789, ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
 
 /* Global structure to hold date/time strings. */
 struct DateData {
@@ -17,34 +34,92 @@ struct DateData {
 static struct DateData g_date_data;
 
 /**
- * @brief Thread function to continuously update the date/time strings.
+ * @brief Where the two lines of text go on a given screen.
+ */
+struct DateLayout {
+  double date_x;
+  double date_y;
+  double clock_x;
+  double clock_y;
+  struct ModuleBounds bounds;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Positions the date (smaller text) and, below it, the clock (larger
+ *        text), centered at 1/5 of the screen height.
+ */
+static void layout_date(int screen_num, struct DateLayout *layout) {
+  cairo_t *cr = screen_configs[screen_num].overlay_buffer;
+  double screen_width = display_config->screen_info[screen_num].width;
+  double screen_height = display_config->screen_info[screen_num].height;
+  layout->bounds = (struct ModuleBounds){0, 0, 0, 0};
+
+  cairo_text_extents_t date_extents;
+  fonts_set_size(cr, SMALL_FONT_SIZE);
+  cairo_text_extents(cr, g_date_data.date, &date_extents);
+  layout->date_x =
+      (screen_width / 2.0) - (date_extents.width / 2.0) - date_extents.x_bearing;
+  layout->date_y = screen_height / 5.0;
+  module_text_bounds(&layout->bounds, layout->date_x, layout->date_y,
+                     &date_extents);
+
+  cairo_text_extents_t clock_extents;
+  fonts_set_size(cr, LARGE_FONT_SIZE);
+  cairo_text_extents(cr, g_date_data.clock, &clock_extents);
+  layout->clock_x = (screen_width / 2.0) - (clock_extents.width / 2.0) -
+                    clock_extents.x_bearing;
+  /* Position clock below the date; add date_extents.height and
+   * clock_extents.height. */
+  layout->clock_y =
+      layout->date_y + date_extents.height + clock_extents.height;
+  module_text_bounds(&layout->bounds, layout->clock_x, layout->clock_y,
+                     &clock_extents);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Module Callbacks                                                          */
+/* ------------------------------------------------------------------------- */
+
+static int date_init(void) {
+  preload_glyphs(SMALL_FONT_SIZE, DATE_GLYPHS);
+  preload_glyphs(LARGE_FONT_SIZE, CLOCK_GLYPHS);
+  return 0;
+}
+
+/**
+ * @brief Refreshes the date/time strings.
  *
- * @param unused Unused argument (required for pthread signature).
- * @return Always returns NULL.
+ * @return 1 if the displayed text changed, 0 otherwise.
  */
-void *date_loop(void *unused __attribute__((unused))) {
-  while (atomic_load(&lockscreen_running)) {
-    time_t current_time = time(NULL);
-    struct tm const *local_tm = localtime(&current_time);
-
-    if (local_tm == NULL) {
-      /* If localtime() fails, just sleep briefly and continue. */
-      sleep(1);
-      continue;
-    }
-
-    /* Format: e.g., "Monday, 01 January" */
-    strftime(g_date_data.date, sizeof(g_date_data.date), "%A, %d %B", local_tm);
-    /* Format: e.g., "08:05" in 12-hour format */
-    strftime(g_date_data.clock, sizeof(g_date_data.clock), "%I:%M", local_tm);
-
-    // Trigger a redraw event
-    request_redraw(display_config->display);
-    /* Update once per second. */
-    sleep(1);
+static int date_update(void) {
+  time_t current_time = time(NULL);
+  struct tm local_tm;
+  if (localtime_r(&current_time, &local_tm) == NULL) {
+    return 0;
   }
 
-  return NULL;
+  struct DateData fresh;
+  /* Format: e.g., "Monday, 01 January" */
+  strftime(fresh.date, sizeof(fresh.date), "%A, %d %B", &local_tm);
+  /* Format: e.g., "08:05" in 12-hour format */
+  strftime(fresh.clock, sizeof(fresh.clock), "%I:%M", &local_tm);
+
+  if (strcmp(fresh.date, g_date_data.date) == 0 &&
+      strcmp(fresh.clock, g_date_data.clock) == 0) {
+    return 0;
+  }
+  g_date_data = fresh;
+  return 1;
+}
+
+static void date_measure(int screen_num, struct ModuleBounds *bounds) {
+  struct DateLayout layout;
+  layout_date(screen_num, &layout);
+  *bounds = layout.bounds;
 }
 
 /**
@@ -54,70 +129,37 @@ void *date_loop(void *unused __attribute__((unused))) {
  *   1. The formatted date (smaller text).
  *   2. The clock (larger text).
  *
+ * @param cr The module's layer.
  * @param screen_num Index of the screen where the date/time will be drawn.
  */
-void draw_clock(int screen_num) {
+static void date_render(cairo_t *cr, int screen_num) {
+  struct DateLayout layout;
+  layout_date(screen_num, &layout);
+
   /* Set up text color with some transparency. */
-  cairo_set_source_rgba(screen_configs[screen_num].overlay_buffer,
+  cairo_set_source_rgba(cr, screen_configs->text_color,
                         screen_configs->text_color, screen_configs->text_color,
-                        screen_configs->text_color, 0.8);
+                        0.8);
 
-  /* --- Draw Date --- */
-  const double small_font_size = 30.0;
-  cairo_set_font_size(screen_configs[screen_num].overlay_buffer,
-                      small_font_size);
+  fonts_set_size(cr, SMALL_FONT_SIZE);
+  cairo_move_to(cr, layout.date_x, layout.date_y);
+  cairo_show_text(cr, g_date_data.date);
 
-  cairo_text_extents_t date_extents;
-  cairo_text_extents(screen_configs[screen_num].overlay_buffer,
-                     g_date_data.date, &date_extents);
-
-  /* Retrieve font extents, though not strictly used here except as an example.
-   */
-  cairo_font_extents_t font_extents;
-  cairo_font_extents(screen_configs[screen_num].overlay_buffer, &font_extents);
-
-  /* Center the text horizontally and place it at 1/5 of the screen height. */
-  double date_x = (display_config->screen_info[screen_num].width / 2.0) -
-                  (date_extents.width / 2.0) - date_extents.x_bearing;
-  double date_y = (display_config->screen_info[screen_num].height / 5.0);
-
-  /* Repaint background to ensure old text is cleared. */
-  int repaint_x = (int)(date_x + date_extents.x_bearing);
-  int repaint_y = (int)(date_y + date_extents.y_bearing);
-  int repaint_width = (int)date_extents.width + (int)font_extents.max_x_advance;
-  int repaint_height =
-      (int)date_extents.height + (int)font_extents.max_y_advance;
-  repaint_background_at(repaint_x, repaint_y, repaint_width, repaint_height,
-                        screen_num);
-
-  cairo_move_to(screen_configs[screen_num].overlay_buffer, date_x, date_y);
-  cairo_show_text(screen_configs[screen_num].overlay_buffer,
-                    g_date_data.date);
-
-  /* --- Draw Clock --- */
-  const double large_font_size = 150.0;
-  cairo_set_font_size(screen_configs[screen_num].overlay_buffer,
-                      large_font_size);
-
-  cairo_text_extents_t clock_extents;
-  cairo_text_extents(screen_configs[screen_num].overlay_buffer,
-                     g_date_data.clock, &clock_extents);
-
-  double clock_x = (display_config->screen_info[screen_num].width / 2.0) -
-                   (clock_extents.width / 2.0) - clock_extents.x_bearing;
-  /* Position clock below the date; add date_extents.height and
-   * clock_extents.height. */
-  double clock_y = (display_config->screen_info[screen_num].height / 5.0) +
-                   date_extents.height + clock_extents.height;
-
-  repaint_x = (int)(clock_x + clock_extents.x_bearing);
-  repaint_y = (int)(clock_y + clock_extents.y_bearing);
-  repaint_width = (int)clock_extents.width + (int)font_extents.max_x_advance;
-  repaint_height = (int)clock_extents.height + (int)font_extents.max_y_advance;
-  repaint_background_at(repaint_x, repaint_y, repaint_width, repaint_height,
-                        screen_num);
-
-  cairo_move_to(screen_configs[screen_num].overlay_buffer, clock_x, clock_y);
-  cairo_show_text(screen_configs[screen_num].overlay_buffer,
-                    g_date_data.clock);
+  fonts_set_size(cr, LARGE_FONT_SIZE);
+  cairo_move_to(cr, layout.clock_x, layout.clock_y);
+  cairo_show_text(cr, g_date_data.clock);
 }
+
+/* ------------------------------------------------------------------------- */
+/* Module Definition                                                         */
+/* ------------------------------------------------------------------------- */
+
+/* The clock shows minutes, so it only needs to wake on the minute. */
+struct Module date_module = {
+    .name = "date",
+    .interval_ms = 60 * 1000,
+    .init = date_init,
+    .update = date_update,
+    .measure = date_measure,
+    .render = date_render,
+};
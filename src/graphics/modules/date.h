@@ -3,9 +3,11 @@
 
 /**
  * @file date.h
- * @brief Contains declarations for managing date and time updates.
+ * @brief Declares the date and time module.
  */
 
-void *date_loop(void *arg);
+#include "module.h"
+
+extern struct Module date_module;
 
 #endif /* DATE_H */
@@ -0,0 +1,619 @@
+/**
+ * @file module.c
+ * @brief Registry, scheduler and layer compositor for lockscreen modules.
+ *
+ * A single scheduler thread sleeps until the earliest module is due, flags
+ * it and asks the main thread for a redraw; it never touches cairo. On the
+ * main thread, modules_update() runs the due update() callbacks, and only
+ * the modules whose output changed are rendered again, each into its own
+ * cached layer (a server-side pixmap). modules_render() then restores the
+ * background under the damaged area and blends the layers that overlap it
+ * back on top, so a new background frame, a moved or faded layer, or a
+ * neighbour's change costs a composite, never text rasterisation. Idle
+ * frames cost nothing however many modules are registered, and a module
+ * with no cadence adds no wakeups at all.
+ */
+
+#include "module.h"
+#include "../../lockscreen.h"
+#include "../../profile.h"
+#include "../fonts.h"
+#include "../graphics.h"
+#include "battery.h"
+#include "date.h"
+#include "password_entry.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Registered modules, in drawing (z) order. The password entry is always
+ * built; the others can be left out of a static profile (see profile.h).
+ */
+static struct Module *const MODULES[] = {
+    &password_entry_module,
+#if PROFILE_MODULE_DATE
+    &date_module,
+#endif
+#if PROFILE_MODULE_BATTERY
+    &battery_module,
+#endif
+};
+#define MODULE_COUNT (sizeof(MODULES) / sizeof(MODULES[0]))
+
+/* Extra margin around text ink extents to cover antialiasing. */
+static const int TEXT_BOUNDS_PADDING = 2;
+
+/*
+ * Timer slack for the scheduler in low-power mode: the kernel may fire a
+ * tick this late so it can share a CPU wakeup with other timers.
+ */
+static const unsigned long LOW_POWER_TIMER_SLACK_NS = 1000000000UL;
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static pthread_t g_scheduler_thread;
+static int g_scheduler_started = 0;
+static int g_scheduler_running = 0;
+static int g_scheduler_paused = 0;
+static int g_scheduler_low_power = 0;
+static pthread_mutex_t g_scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Default (CLOCK_REALTIME) condition: wall-clock deadlines survive suspend. */
+static pthread_cond_t g_scheduler_wake = PTHREAD_COND_INITIALIZER;
+/* The layers and off-screen buffers are ready for the next lock. */
+static int g_prerendered = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Next multiple of the module's interval after now, so that e.g. a
+ *        60 s clock ticks exactly on the minute.
+ */
+static int64_t next_deadline(const struct Module *module, int64_t now) {
+  int64_t interval = (int64_t)module->interval_ms * 1000000LL;
+  return (now / interval + 1) * interval;
+}
+
+/**
+ * @brief Reschedules every ticking module from now, e.g. after the cadence
+ *        changed. Called with g_scheduler_lock held (or before the thread
+ *        starts).
+ *
+ * @param due Non-zero to also flag them due for the next frame.
+ */
+static void reschedule_modules(int due) {
+  int64_t now = realtime_ns();
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    if (module->enabled && module->interval_ms > 0) {
+      if (due) {
+        atomic_store(&module->due, 1);
+      }
+      module->next_due_ns = next_deadline(module, now);
+    }
+  }
+}
+
+static int bounds_empty(const struct ModuleBounds *bounds) {
+  return bounds->width <= 0 || bounds->height <= 0;
+}
+
+static int bounds_intersect(const struct ModuleBounds *a,
+                            const struct ModuleBounds *b) {
+  return !bounds_empty(a) && !bounds_empty(b) && a->x < b->x + b->width &&
+         b->x < a->x + a->width && a->y < b->y + b->height &&
+         b->y < a->y + a->height;
+}
+
+static void bounds_union(struct ModuleBounds *acc,
+                         const struct ModuleBounds *add) {
+  if (bounds_empty(add)) {
+    return;
+  }
+  if (bounds_empty(acc)) {
+    *acc = *add;
+    return;
+  }
+  int x1 = (acc->x < add->x) ? acc->x : add->x;
+  int y1 = (acc->y < add->y) ? acc->y : add->y;
+  int x2 = (acc->x + acc->width > add->x + add->width) ? acc->x + acc->width
+                                                       : add->x + add->width;
+  int y2 = (acc->y + acc->height > add->y + add->height)
+               ? acc->y + acc->height
+               : add->y + add->height;
+  acc->x = x1;
+  acc->y = y1;
+  acc->width = x2 - x1;
+  acc->height = y2 - y1;
+}
+
+/**
+ * @brief Thread function that flags modules as they come due.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+static void *scheduler_loop(void *arg __attribute__((unused))) {
+  int slack_low_power = 0;
+  pthread_mutex_lock(&g_scheduler_lock);
+  while (g_scheduler_running) {
+    if (slack_low_power != g_scheduler_low_power) {
+      /* Timer slack is per thread; 0 restores the default. */
+      slack_low_power = g_scheduler_low_power;
+      prctl(PR_SET_TIMERSLACK, slack_low_power ? LOW_POWER_TIMER_SLACK_NS : 0,
+            0, 0, 0);
+    }
+    if (g_scheduler_paused) {
+      pthread_cond_wait(&g_scheduler_wake, &g_scheduler_lock);
+      continue;
+    }
+
+    int64_t now = realtime_ns();
+    int64_t earliest = INT64_MAX;
+    int fired = 0;
+
+    for (size_t i = 0; i < MODULE_COUNT; i++) {
+      struct Module *module = MODULES[i];
+      if (!module->enabled || module->interval_ms <= 0) {
+        continue;
+      }
+      if (module->next_due_ns <= now) {
+        atomic_store(&module->due, 1);
+        module->next_due_ns = next_deadline(module, now);
+        fired = 1;
+      }
+      if (module->next_due_ns < earliest) {
+        earliest = module->next_due_ns;
+      }
+    }
+
+    if (fired) {
+      pthread_mutex_unlock(&g_scheduler_lock);
+      request_redraw();
+      pthread_mutex_lock(&g_scheduler_lock);
+      continue;
+    }
+
+    if (earliest == INT64_MAX) {
+      pthread_cond_wait(&g_scheduler_wake, &g_scheduler_lock);
+    } else {
+      struct timespec deadline = {.tv_sec = earliest / 1000000000LL,
+                                  .tv_nsec = earliest % 1000000000LL};
+      pthread_cond_timedwait(&g_scheduler_wake, &g_scheduler_lock, &deadline);
+    }
+  }
+  pthread_mutex_unlock(&g_scheduler_lock);
+  return NULL;
+}
+
+/**
+ * @brief Renders a dirty module into its layer on one screen, growing the
+ *        layer's pixmap if the content no longer fits.
+ *
+ * @return 0 on success, -1 if the pixmap could not be allocated.
+ */
+static int rasterize_layer(struct Module *module, int screen_num,
+                           const struct ModuleBounds *bounds) {
+  struct ModuleLayer *layer = &module->layers[screen_num];
+  layer->bounds = *bounds;
+  if (bounds_empty(bounds) || !module->render) {
+    return 0;
+  }
+
+  if (!layer->surface || layer->surface_width < bounds->width ||
+      layer->surface_height < bounds->height) {
+    cairo_surface_destroy(layer->surface);
+    layer->surface = cairo_surface_create_similar(
+        screen_configs[screen_num].surface, CAIRO_CONTENT_COLOR_ALPHA,
+        bounds->width, bounds->height);
+    if (cairo_surface_status(layer->surface) != CAIRO_STATUS_SUCCESS) {
+      fprintf(stderr, "Failed to allocate the layer of module '%s'.\n",
+              module->name);
+      cairo_surface_destroy(layer->surface);
+      layer->surface = NULL;
+      layer->bounds = (struct ModuleBounds){0, 0, 0, 0};
+      return -1;
+    }
+    layer->surface_width = bounds->width;
+    layer->surface_height = bounds->height;
+  }
+
+  cairo_t *cr = cairo_create(layer->surface);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  cairo_set_font_face(cr, fonts_face());
+  cairo_translate(cr, -bounds->x, -bounds->y);
+  module->render(cr, screen_num);
+  cairo_destroy(cr);
+  return 0;
+}
+
+/**
+ * @brief Lists the enabled modules bottom to top.
+ *
+ * @return The number of entries written to order.
+ */
+static size_t stacking_order(struct Module **order) {
+  size_t count = 0;
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    if (!MODULES[i]->enabled) {
+      continue;
+    }
+    /* Insertion sort: stable, and there are only a handful of modules. */
+    size_t slot = count++;
+    while (slot > 0 && order[slot - 1]->z > MODULES[i]->z) {
+      order[slot] = order[slot - 1];
+      slot--;
+    }
+    order[slot] = MODULES[i];
+  }
+  return count;
+}
+
+/**
+ * @brief Blends every layer overlapping the area onto the screen's
+ *        off-screen buffer, bottom to top. Nothing is rasterised.
+ */
+static void composite_layers(int screen_num, const struct ModuleBounds *area) {
+  cairo_t *cr = screen_configs[screen_num].overlay_buffer;
+  struct Module *order[MODULE_COUNT];
+  size_t count = stacking_order(order);
+
+  for (size_t i = 0; i < count; i++) {
+    const struct ModuleLayer *layer = &order[i]->layers[screen_num];
+    if (!layer->surface || order[i]->opacity <= 0.0 ||
+        !bounds_intersect(area, &layer->bounds)) {
+      continue;
+    }
+    cairo_save(cr);
+    cairo_rectangle(cr, area->x, area->y, area->width, area->height);
+    cairo_clip(cr);
+    cairo_rectangle(cr, layer->bounds.x, layer->bounds.y, layer->bounds.width,
+                    layer->bounds.height);
+    cairo_clip(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+    cairo_set_source_surface(cr, layer->surface, layer->bounds.x,
+                             layer->bounds.y);
+    cairo_paint_with_alpha(cr, order[i]->opacity);
+    cairo_restore(cr);
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Initializes every registered module. Must be called once the
+ *        screens are set up.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int modules_init(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    module->layers =
+        calloc(display_config->num_screens, sizeof(*module->layers));
+    if (!module->layers) {
+      fprintf(stderr, "Failed to allocate module state.\n");
+      return -1;
+    }
+    module->opacity = 1.0;
+    if (module->init && module->init() != 0) {
+      fprintf(stderr, "Module '%s' failed to initialize; disabling it.\n",
+              module->name);
+      continue;
+    }
+    module->enabled = 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Destroys every registered module.
+ */
+void modules_destroy(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    if (module->enabled && module->destroy) {
+      module->destroy();
+    }
+    module->enabled = 0;
+    if (module->layers) {
+      for (int screen = 0; screen < display_config->num_screens; screen++) {
+        cairo_surface_destroy(module->layers[screen].surface);
+      }
+    }
+    free(module->layers);
+    module->layers = NULL;
+  }
+}
+
+/**
+ * @brief Marks every module due and dirty and starts the scheduler for a new
+ *        lock. Main thread only.
+ *
+ * After modules_prerender() the modules are only marked due: those whose
+ * output did not change since are not rendered again.
+ *
+ * @return 0 on success, -1 if the scheduler thread could not be started.
+ */
+int modules_start(void) {
+  int64_t now = realtime_ns();
+  int needs_scheduler = 0;
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    /* The text color may have changed with the background (blur, reload). */
+    atomic_store(&module->due, 1);
+    module->dirty = !g_prerendered;
+    if (module->enabled && module->interval_ms > 0) {
+      module->next_due_ns = next_deadline(module, now);
+      needs_scheduler = 1;
+    }
+  }
+  g_prerendered = 0;
+  if (!needs_scheduler) {
+    return 0;
+  }
+
+  g_scheduler_running = 1;
+  g_scheduler_paused = 0;
+  if (pthread_create(&g_scheduler_thread, NULL, scheduler_loop, NULL) != 0) {
+    fprintf(stderr, "Failed to create module scheduler thread.\n");
+    g_scheduler_running = 0;
+    return -1;
+  }
+  g_scheduler_started = 1;
+  return 0;
+}
+
+/**
+ * @brief Stops the scheduler at the end of a lock.
+ */
+void modules_stop(void) {
+  if (!g_scheduler_started) {
+    return;
+  }
+  pthread_mutex_lock(&g_scheduler_lock);
+  g_scheduler_running = 0;
+  pthread_cond_signal(&g_scheduler_wake);
+  pthread_mutex_unlock(&g_scheduler_lock);
+  pthread_join(g_scheduler_thread, NULL);
+  g_scheduler_started = 0;
+}
+
+/**
+ * @brief Stops or resumes module ticks, e.g. while the displays are off.
+ *
+ * On resume every ticking module is flagged due, so the next frame is up to
+ * date, and the schedule restarts from now.
+ *
+ * @param paused Non-zero to stop ticking.
+ */
+void modules_set_paused(int paused) {
+  pthread_mutex_lock(&g_scheduler_lock);
+  g_scheduler_paused = paused;
+  if (!paused) {
+    reschedule_modules(1);
+  }
+  pthread_cond_signal(&g_scheduler_wake);
+  pthread_mutex_unlock(&g_scheduler_lock);
+}
+
+/**
+ * @brief Lets the kernel coalesce module ticks with other timers while in
+ *        low power. May be called before modules_start().
+ *
+ * @param low_power Non-zero to enter low-power mode.
+ */
+void modules_set_low_power(int low_power) {
+  pthread_mutex_lock(&g_scheduler_lock);
+  if (g_scheduler_low_power != low_power) {
+    g_scheduler_low_power = low_power;
+    /* The scheduler applies the new timer slack once woken. */
+    pthread_cond_signal(&g_scheduler_wake);
+  }
+  pthread_mutex_unlock(&g_scheduler_lock);
+}
+
+/**
+ * @brief Flags a module so its update() runs (and, if it has none, it is
+ *        re-rendered) on the next frame. Safe to call from any thread;
+ *        callers off the main thread should follow up with request_redraw().
+ *
+ * @param module The module whose data changed.
+ */
+void module_invalidate(struct Module *module) {
+  atomic_store(&module->due, 1);
+}
+
+/**
+ * @brief Fades a module's layer. Takes effect on the next frame without
+ *        rendering the module again. Main thread only.
+ *
+ * @param module The module to fade.
+ * @param opacity From 0 (hidden) to 1 (opaque).
+ */
+void module_set_opacity(struct Module *module, double opacity) {
+  opacity = (opacity < 0.0) ? 0.0 : (opacity > 1.0) ? 1.0 : opacity;
+  if (module->opacity != opacity) {
+    module->opacity = opacity;
+    module->restacked = 1;
+  }
+}
+
+/**
+ * @brief Moves a module's layer up or down the stack. Takes effect on the
+ *        next frame without rendering the module again. Main thread only.
+ *
+ * @param module The module to move.
+ * @param z The new stacking order; higher is drawn on top.
+ */
+void module_set_z(struct Module *module, int z) {
+  if (module->z != z) {
+    module->z = z;
+    module->restacked = 1;
+  }
+}
+
+/**
+ * @brief Makes every module render again on the next frame, e.g. after the
+ *        text color changed with the background. Main thread only.
+ */
+void modules_restyle(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    MODULES[i]->dirty = 1;
+  }
+  g_prerendered = 0;
+}
+
+/**
+ * @brief Runs the due update() callbacks and works out which modules must
+ *        be rendered again. Main thread only.
+ */
+void modules_update(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    if (!module->enabled) {
+      continue;
+    }
+    if (atomic_exchange(&module->due, 0) &&
+        (!module->update || module->update())) {
+      module->dirty = 1;
+    }
+  }
+}
+
+/**
+ * @brief Brings one screen's off-screen buffer up to date. Main thread
+ *        only.
+ *
+ * Dirty modules are rendered into their layers; then the background is
+ * restored once over the union of their old and new areas (plus those of
+ * faded or restacked layers) and every layer overlapping it is blended back
+ * on top, so clean modules are never rendered again.
+ *
+ * @param screen_num Index of the screen to render.
+ * @param background_changed Non-zero if the whole background was just
+ *                           repainted, which erased every layer.
+ * @param damage Receives the area that changed.
+ * @return Non-zero if anything was drawn.
+ */
+int modules_render(int screen_num, int background_changed,
+                   struct ModuleBounds *damage) {
+  struct ModuleBounds area = {0, 0, 0, 0};
+
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    struct Module *module = MODULES[i];
+    if (!module->enabled) {
+      continue;
+    }
+    struct ModuleLayer *layer = &module->layers[screen_num];
+    if (module->restacked) {
+      bounds_union(&area, &layer->bounds);
+    }
+    if (!module->dirty) {
+      continue;
+    }
+    struct ModuleBounds next = layer->bounds;
+    if (module->measure) {
+      module->measure(screen_num, &next);
+    }
+    bounds_union(&area, &layer->bounds);
+    bounds_union(&area, &next);
+    rasterize_layer(module, screen_num, &next);
+  }
+
+  if (background_changed) {
+    const XineramaScreenInfo *info = &display_config->screen_info[screen_num];
+    area = (struct ModuleBounds){0, 0, info->width, info->height};
+  }
+  *damage = area;
+  if (bounds_empty(&area)) {
+    return 0;
+  }
+
+  if (!background_changed) {
+    repaint_background_at(area.x, area.y, area.width, area.height,
+                          screen_num);
+  }
+  composite_layers(screen_num, &area);
+  return 1;
+}
+
+/**
+ * @brief Renders every module into its layer and blends the layers into the
+ *        off-screen buffers ahead of a lock, so that its first frame only has
+ *        to be copied to the windows. Main thread only.
+ *
+ * Call after the lock's background is installed; a background installed
+ * later is still blended under the layers by the first frame.
+ */
+void modules_prerender(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    atomic_store(&MODULES[i]->due, 1);
+    MODULES[i]->dirty = 1;
+  }
+  modules_update();
+  for (int screen = 0; screen < display_config->num_screens; screen++) {
+    struct ModuleBounds damage;
+    modules_render(screen, 0, &damage);
+  }
+  modules_frame_done();
+  g_prerendered = 1;
+}
+
+/**
+ * @brief Forgets a modules_prerender() that no lock followed, so the next
+ *        lock renders every module again.
+ */
+void modules_release_prerender(void) { g_prerendered = 0; }
+
+/**
+ * @brief Clears the dirty flags once every screen has been rendered.
+ */
+void modules_frame_done(void) {
+  for (size_t i = 0; i < MODULE_COUNT; i++) {
+    MODULES[i]->dirty = 0;
+    MODULES[i]->restacked = 0;
+  }
+}
+
+/**
+ * @brief Grows bounds to cover a line of text drawn at (x, y), for use in
+ *        measure() callbacks.
+ *
+ * @param bounds Bounds to grow; an empty rectangle starts from scratch.
+ * @param x Text origin, as passed to cairo_move_to().
+ * @param y Text baseline, as passed to cairo_move_to().
+ * @param extents The text's extents from cairo_text_extents().
+ */
+void module_text_bounds(struct ModuleBounds *bounds, double x, double y,
+                        const cairo_text_extents_t *extents) {
+  struct ModuleBounds text;
+  text.x = (int)floor(x + extents->x_bearing) - TEXT_BOUNDS_PADDING;
+  text.y = (int)floor(y + extents->y_bearing) - TEXT_BOUNDS_PADDING;
+  text.width = (int)ceil(x + extents->x_bearing + extents->width) +
+               TEXT_BOUNDS_PADDING - text.x;
+  text.height = (int)ceil(y + extents->y_bearing + extents->height) +
+                TEXT_BOUNDS_PADDING - text.y;
+  bounds_union(bounds, &text);
+}
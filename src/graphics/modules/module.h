@@ -0,0 +1,99 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+/**
+ * @file module.h
+ * @brief Interface implemented by lockscreen widgets (clock, password entry,
+ *        ...) and the runtime that schedules and renders them.
+ */
+
+#include <cairo/cairo.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief An axis-aligned rectangle in screen coordinates.
+ */
+struct ModuleBounds {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+/**
+ * @brief A module's cached rendering on one screen.
+ */
+struct ModuleLayer {
+  cairo_surface_t *surface;   /**< Server-side pixmap, or NULL. */
+  int surface_width;          /**< Allocated size, at least bounds'. */
+  int surface_height;
+  struct ModuleBounds bounds; /**< Where the layer sits on the screen. */
+};
+
+/**
+ * @brief A lockscreen widget.
+ *
+ * All callbacks are optional and run on the main thread, which owns the
+ * cairo contexts. Each module renders into its own layer, which the runtime
+ * keeps and blends over the background with the module's opacity and in
+ * z order; render() only runs when the module's output changed.
+ */
+struct Module {
+  const char *name;
+  /** Update cadence in ms, aligned to the wall clock; 0 = only when
+   *  invalidated. */
+  int interval_ms;
+
+  /** Called once at startup; non-zero disables the module. */
+  int (*init)(void);
+  /** Refreshes the module's data; returns non-zero if its output changed. */
+  int (*update)(void);
+  /** Reports the area render() will touch on the given screen. */
+  void (*measure)(int screen_num, struct ModuleBounds *bounds);
+  /** Draws the module on the given screen into cr, a cleared layer that
+   *  takes screen coordinates. */
+  void (*render)(cairo_t *cr, int screen_num);
+  /** Releases whatever init() acquired. */
+  void (*destroy)(void);
+  /** Stacking order; higher is drawn on top, ties in registration order. */
+  int z;
+
+  /* Runtime state, owned by module.c. */
+  int enabled;
+  atomic_int due;             /**< update() should run before the next frame. */
+  int dirty;                  /**< Must be re-rendered this frame. */
+  int64_t next_due_ns;        /**< Next scheduled update (CLOCK_REALTIME). */
+  double opacity;             /**< Blending opacity, 0 to 1. */
+  int restacked;              /**< Opacity or z changed; blend again. */
+  struct ModuleLayer *layers; /**< Per-screen cached rendering. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int modules_init(void);
+void modules_destroy(void);
+int modules_start(void);
+void modules_stop(void);
+void modules_set_paused(int paused);
+void modules_set_low_power(int low_power);
+void module_invalidate(struct Module *module);
+void module_set_opacity(struct Module *module, double opacity);
+void module_set_z(struct Module *module, int z);
+void modules_restyle(void);
+void modules_update(void);
+int modules_render(int screen_num, int background_changed,
+                   struct ModuleBounds *damage);
+void modules_prerender(void);
+void modules_release_prerender(void);
+void modules_frame_done(void);
+void module_text_bounds(struct ModuleBounds *bounds, double x, double y,
+                        const cairo_text_extents_t *extents);
+
+#endif /* MODULE_H */
@@ -4,7 +4,10 @@
  *        text for password input or error messages.
  */
 
+#include "password_entry.h"
 #include "../../lockscreen.h"
+#include "../../power.h"
+#include "../fonts.h"
 #include "../graphics.h"
 #include <cairo/cairo.h>
 #include <math.h>
@@ -20,6 +23,8 @@ static const double RECTANGLE_RADIUS = 20.0;
 static const double SEMI_TRANSPARENCY_ALPHA = 0.5;
 static const double PASSWORD_TEXT_PADDING = 10.0;
 static const int FONT_DECREMENT_STEP = 1; /* Decrement in px when clamping. */
+static const char *const PLACEHOLDER_TEXT = "Enter password";
+static const char *const WRONG_PASSWORD_TEXT = "Wrong password!";
 
 /* ------------------------------------------------------------------------- */
 /* Static Helper Functions                                                   */
@@ -74,30 +79,20 @@ static void draw_rounded_rectangle_path(cairo_t *cr, double x, double y,
 static void clamp_text_to_width(cairo_t *cr, const char *text, double max_width,
                                 double *font_size, double min_font_size) {
   cairo_text_extents_t ext;
-  cairo_set_font_size(cr, *font_size);
+  fonts_set_size(cr, *font_size);
   cairo_text_extents(cr, text, &ext);
 
   while ((ext.width > max_width) && (*font_size > min_font_size)) {
     *font_size -= FONT_DECREMENT_STEP;
-    cairo_set_font_size(cr, *font_size);
+    fonts_set_size(cr, *font_size);
     cairo_text_extents(cr, text, &ext);
   }
 }
 
-/* ------------------------------------------------------------------------- */
-/* Primary Function                                                          */
-/* ------------------------------------------------------------------------- */
-
 /**
- * @brief Draws the password entry UI on the given screen. This includes a
- *        semi-transparent rounded rectangle with either placeholder text,
- *        error text, or asterisks representing the current password input.
- *
- * @param screen_num Index of the screen where the widget should be drawn.
+ * @brief Computes the rectangle of the widget, centered on the screen.
  */
-void draw_password_entry(int screen_num) {
-  cairo_t *cr = screen_configs[screen_num].overlay_buffer;
-
+static void layout_rectangle(int screen_num, struct ModuleBounds *rect) {
   /* --- Screen dimensions --- */
   double screen_width = (double)display_config->screen_info[screen_num].width;
   double screen_height = (double)display_config->screen_info[screen_num].height;
@@ -106,34 +101,49 @@ void draw_password_entry(int screen_num) {
   double raw_width =
       (screen_width > screen_height) ? screen_width / 9.0 : screen_height / 9.0;
 
-  int rect_width = (int)ceil(raw_width);
-  int rect_height = (int)ceil(rect_width / 4.0);
+  rect->width = (int)ceil(raw_width);
+  rect->height = (int)ceil(rect->width / 4.0);
 
   /* Position the rectangle in the center of the screen. */
-  int rect_x = (int)round((screen_width / 2.0) - (rect_width / 2.0));
-  int rect_y = (int)round((screen_height / 2.0) - (rect_height / 2.0));
+  rect->x = (int)round((screen_width / 2.0) - (rect->width / 2.0));
+  rect->y = (int)round((screen_height / 2.0) - (rect->height / 2.0));
+}
 
-  /* ---------------------------------------------------------------------
-   * (1) Clear the rectangle area.
-   * --------------------------------------------------------------------- */
-  cairo_save(cr);
+/* ------------------------------------------------------------------------- */
+/* Module Callbacks                                                          */
+/* ------------------------------------------------------------------------- */
 
-  draw_rounded_rectangle_path(cr, rect_x, rect_y, rect_width, rect_height,
-                              RECTANGLE_RADIUS);
+static int password_entry_init(void) {
+  preload_glyphs(DEFAULT_FONT_SIZE, "*");
+  preload_glyphs(DEFAULT_FONT_SIZE, PLACEHOLDER_TEXT);
+  preload_glyphs(DEFAULT_FONT_SIZE, WRONG_PASSWORD_TEXT);
+  return 0;
+}
 
-  cairo_clip(cr);
-  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
-  cairo_paint(cr);
+static void password_entry_measure(int screen_num,
+                                   struct ModuleBounds *bounds) {
+  layout_rectangle(screen_num, bounds);
+}
 
-  cairo_restore(cr);
+/**
+ * @brief Draws the password entry UI on the given screen. This includes a
+ *        semi-transparent rounded rectangle with either placeholder text,
+ *        error text, or asterisks representing the current password input.
+ *
+ * @param cr The module's layer.
+ * @param screen_num Index of the screen where the widget should be drawn.
+ */
+static void password_entry_render(cairo_t *cr, int screen_num) {
 
-  /* ---------------------------------------------------------------------
-   * (2) Repaint the background in this cleared region.
-   * --------------------------------------------------------------------- */
-  repaint_background_at(rect_x, rect_y, rect_width, rect_height, screen_num);
+  struct ModuleBounds rect;
+  layout_rectangle(screen_num, &rect);
+  int rect_x = rect.x;
+  int rect_y = rect.y;
+  int rect_width = rect.width;
+  int rect_height = rect.height;
 
   /* ---------------------------------------------------------------------
-   * (3) Draw a semi-transparent rounded rectangle on top.
+   * (1) Draw a semi-transparent rounded rectangle on top.
    * --------------------------------------------------------------------- */
   cairo_save(cr);
   cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
@@ -143,17 +153,19 @@ void draw_password_entry(int screen_num) {
                         screen_configs->text_color, screen_configs->text_color,
                         SEMI_TRANSPARENCY_ALPHA);
 
-  cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+  /* The rounded corners are the costliest thing drawn on every keypress. */
+  cairo_set_antialias(cr, low_power_active() ? CAIRO_ANTIALIAS_FAST
+                                             : CAIRO_ANTIALIAS_BEST);
   draw_rounded_rectangle_path(cr, rect_x, rect_y, rect_width, rect_height,
                               RECTANGLE_RADIUS);
   cairo_fill(cr);
   cairo_restore(cr);
 
   /* ---------------------------------------------------------------------
-   * (4) Draw the text (password asterisks or placeholder/wrong password).
+   * (2) Draw the text (password asterisks or placeholder/wrong password).
    * --------------------------------------------------------------------- */
   double font_size = DEFAULT_FONT_SIZE;
-  cairo_set_font_size(cr, font_size);
+  fonts_set_size(cr, font_size);
 
   /* Compute a contrasting color for text (opposite of text_color). */
   int opposite_color = get_opposite_color(screen_configs->text_color);
@@ -165,18 +177,18 @@ void draw_password_entry(int screen_num) {
 
   double text_area_width = rect_width - 2.0 * PASSWORD_TEXT_PADDING;
 
-  if (current_input_index > 0) {
+  if (current_input_chars > 0) {
     /* --- User typed something: show asterisks. --- */
 
     cairo_text_extents_t password_extents;
     char *password_buffer =
-        (char *)calloc(current_input_index + 1, sizeof(char));
+        (char *)calloc(current_input_chars + 1, sizeof(char));
     if (!password_buffer) {
       return; /* Bail out if allocation fails. */
     }
 
     /* Build an asterisk string without exceeding text_area_width. */
-    for (int i = 0; i < current_input_index; i++) {
+    for (int i = 0; i < current_input_chars; i++) {
       password_buffer[i] = '*';
       password_buffer[i + 1] = '\0';
 
@@ -199,12 +211,10 @@ void draw_password_entry(int screen_num) {
 
   } else {
     /* --- No input yet: show a placeholder or "Wrong password!" --- */
-    const char *placeholder_str = "Enter password";
-    const char *wrong_str = "Wrong password!";
-    const char *display_str = placeholder_str;
+    const char *display_str = PLACEHOLDER_TEXT;
 
     if (password_is_wrong) {
-      display_str = wrong_str;
+      display_str = WRONG_PASSWORD_TEXT;
 
       /* Adjust text color for a "red" message. */
       if (screen_configs->text_color > 127) {
@@ -231,3 +241,15 @@ void draw_password_entry(int screen_num) {
     cairo_show_text(cr, display_str);
   }
 }
+
+/* ------------------------------------------------------------------------- */
+/* Module Definition                                                         */
+/* ------------------------------------------------------------------------- */
+
+/* No cadence: the lockscreen invalidates it on every key press. */
+struct Module password_entry_module = {
+    .name = "password_entry",
+    .init = password_entry_init,
+    .measure = password_entry_measure,
+    .render = password_entry_render,
+};
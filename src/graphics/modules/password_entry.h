@@ -0,0 +1,13 @@
+#ifndef PASSWORD_ENTRY_H
+#define PASSWORD_ENTRY_H
+
+/**
+ * @file password_entry.h
+ * @brief Declares the password-entry module.
+ */
+
+#include "module.h"
+
+extern struct Module password_entry_module;
+
+#endif /* PASSWORD_ENTRY_H */
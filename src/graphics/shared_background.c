@@ -0,0 +1,218 @@
+/**
+ * @file shared_background.c
+ * @brief Background images decoded and scaled once, then shared read-only
+ *        between the per-display lockscreen processes.
+ *
+ * The supervisor (see supervisor.c) decodes the configured image once and
+ * scales it for every distinct screen size it found, each into its own
+ * sealed memfd. The children it forks inherit the table and map the memfds
+ * read-only, so the pixels exist once in memory however many displays share
+ * a geometry.
+ */
+
+#include "shared_background.h"
+#include "graphics.h"
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const unsigned int SHARED_BACKGROUND_SEALS =
+    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief One scaled copy of the background.
+ */
+struct SharedBackground {
+  int width;
+  int height;
+  int stride;
+  int fd;       /**< Sealed memfd holding RGB24 pixels. */
+  size_t size;  /**< Size of the memfd in bytes. */
+  void *pixels; /**< Read-only mapping, once looked up; or NULL. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct SharedBackground *g_backgrounds = NULL;
+static int g_background_count = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static struct SharedBackground *find_background(int width, int height) {
+  for (int i = 0; i < g_background_count; i++) {
+    if (g_backgrounds[i].width == width && g_backgrounds[i].height == height) {
+      return &g_backgrounds[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Copies a scaled image into a new sealed memfd.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int store_background(struct SharedBackground *entry,
+                            cairo_surface_t *scaled) {
+  cairo_surface_flush(scaled);
+  entry->width = cairo_image_surface_get_width(scaled);
+  entry->height = cairo_image_surface_get_height(scaled);
+  entry->stride = cairo_image_surface_get_stride(scaled);
+  entry->size = (size_t)entry->stride * (size_t)entry->height;
+  entry->pixels = NULL;
+
+  char name[64];
+  snprintf(name, sizeof(name), "minimalist-lockscreen-%dx%d", entry->width,
+           entry->height);
+  entry->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (entry->fd < 0) {
+    perror("memfd_create");
+    return -1;
+  }
+  if (ftruncate(entry->fd, (off_t)entry->size) != 0) {
+    perror("ftruncate");
+    close(entry->fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, entry->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   entry->fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    close(entry->fd);
+    return -1;
+  }
+  memcpy(map, cairo_image_surface_get_data(scaled), entry->size);
+  munmap(map, entry->size);
+
+  /* From here on nobody, including a misbehaving child, can modify it. */
+  if (fcntl(entry->fd, F_ADD_SEALS, SHARED_BACKGROUND_SEALS) != 0) {
+    perror("fcntl(F_ADD_SEALS)");
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Decodes an image and stores one scaled copy per distinct size.
+ *        Must be called before forking the processes that will use them,
+ *        and before any thread is started.
+ *
+ * @param image_path The PNG to decode.
+ * @param sizes Screen sizes to scale for; duplicates are stored once.
+ * @param count Number of entries in sizes.
+ * @return 0 on success, -1 if the image could not be loaded (the children
+ *         then fall back to loading it themselves).
+ */
+int shared_backgrounds_create(const char *image_path,
+                              const struct BackgroundSize *sizes, int count) {
+  if (image_path[0] == '\0' || count <= 0) {
+    return -1;
+  }
+  cairo_surface_t *image = cairo_image_surface_create_from_png(image_path);
+  if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+    fprintf(stderr, "Failed to load image: %s\n", image_path);
+    cairo_surface_destroy(image);
+    return -1;
+  }
+
+  g_backgrounds = calloc((size_t)count, sizeof(*g_backgrounds));
+  if (!g_backgrounds) {
+    cairo_surface_destroy(image);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (find_background(sizes[i].width, sizes[i].height)) {
+      continue;
+    }
+    cairo_surface_t *scaled =
+        create_scaled_image(image, sizes[i].width, sizes[i].height);
+    if (!scaled) {
+      continue;
+    }
+    if (store_background(&g_backgrounds[g_background_count], scaled) == 0) {
+      g_background_count++;
+    }
+    cairo_surface_destroy(scaled);
+  }
+  cairo_surface_destroy(image);
+  malloc_trim(0);
+
+  printf("Shared %d background size(s) for %d screen(s).\n",
+         g_background_count, count);
+  fflush(stdout);
+  return (g_background_count > 0) ? 0 : -1;
+}
+
+/**
+ * @brief Reports whether shared backgrounds were handed down to this
+ *        process.
+ *
+ * @return 1 if available, 0 otherwise.
+ */
+int shared_backgrounds_available(void) { return g_background_count > 0; }
+
+/**
+ * @brief Returns a read-only image surface over the shared copy scaled for
+ *        the given size.
+ *
+ * The surface must only be used as a source. Destroying it does not unmap
+ * the pixels; shared_backgrounds_release() does.
+ *
+ * @param width Screen width.
+ * @param height Screen height.
+ * @return A new surface, or NULL if no copy of that size exists.
+ */
+cairo_surface_t *shared_background_lookup(int width, int height) {
+  struct SharedBackground *entry = find_background(width, height);
+  if (!entry) {
+    return NULL;
+  }
+  if (!entry->pixels) {
+    void *map = mmap(NULL, entry->size, PROT_READ, MAP_SHARED, entry->fd, 0);
+    if (map == MAP_FAILED) {
+      perror("mmap");
+      return NULL;
+    }
+    entry->pixels = map;
+  }
+  return cairo_image_surface_create_for_data(
+      (unsigned char *)entry->pixels, CAIRO_FORMAT_RGB24, entry->width,
+      entry->height, entry->stride);
+}
+
+/**
+ * @brief Unmaps and closes every shared background, e.g. once the image
+ *        option changed and the copies are stale.
+ */
+void shared_backgrounds_release(void) {
+  for (int i = 0; i < g_background_count; i++) {
+    if (g_backgrounds[i].pixels) {
+      munmap(g_backgrounds[i].pixels, g_backgrounds[i].size);
+    }
+    close(g_backgrounds[i].fd);
+  }
+  free(g_backgrounds);
+  g_backgrounds = NULL;
+  g_background_count = 0;
+}
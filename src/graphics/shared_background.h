@@ -0,0 +1,34 @@
+#ifndef SHARED_BACKGROUND_H
+#define SHARED_BACKGROUND_H
+
+/**
+ * @file shared_background.h
+ * @brief Declarations for background images decoded once and shared between
+ *        processes through sealed memfds.
+ */
+
+#include <cairo/cairo.h>
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief A screen size a background is needed for.
+ */
+struct BackgroundSize {
+  int width;
+  int height;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int shared_backgrounds_create(const char *image_path,
+                              const struct BackgroundSize *sizes, int count);
+int shared_backgrounds_available(void);
+cairo_surface_t *shared_background_lookup(int width, int height);
+void shared_backgrounds_release(void);
+
+#endif /* SHARED_BACKGROUND_H */
@@ -0,0 +1,500 @@
+/**
+ * @file slideshow.c
+ * @brief Rotates the static background through a directory or playlist of
+ *        PNG wallpapers.
+ *
+ * When the image option names a directory (its PNGs, in name order) or a
+ * playlist (a text file with one path per line), the first wallpaper is
+ * loaded at startup like a single image. A prefetch thread, at the lowest
+ * CPU and I/O priority, then decodes the next one and scales it once per
+ * distinct screen geometry ahead of time. The main thread swaps it in with
+ * a single pointer exchange once a lock has ended, or every
+ * slideshow_interval seconds, so rotating never delays a lock or its first
+ * frame.
+ */
+
+#include "slideshow.h"
+#include "../config.h"
+#include "../events.h"
+#include "../lockscreen.h"
+#include "../utils.h"
+#include "graphics.h"
+#include "modules/module.h"
+#include <cairo/cairo.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const int PREFETCH_THREAD_NICE = 19;
+/* ioprio_set(2); glibc has no wrapper or header for these. */
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief One wallpaper, decoded and pre-scaled for every screen.
+ */
+struct Wallpaper {
+  cairo_surface_t **screens; /**< One surface per screen (shared by size). */
+  int text_color;            /**< Text color picked for it. */
+};
+
+/**
+ * @brief State shared between the prefetch thread and the main thread.
+ */
+struct Slideshow {
+  char **paths;        /**< Wallpaper file paths, in playing order. */
+  int num_paths;
+  int next;            /**< Next path the prefetch thread decodes. */
+  int failures;        /**< Paths in a row that could not be decoded. */
+  int64_t interval_ns; /**< Time between rotations, 0 = after each lock. */
+  int64_t rotate_ns;   /**< Next timed rotation. */
+  int due;             /**< The prepared wallpaper should be shown. */
+  int announced;       /**< EVENT_WALLPAPER was posted for it. */
+  int stop;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct Slideshow *g_slideshow = NULL;
+/* The next wallpaper, published by the prefetch thread, taken by the main. */
+static _Atomic(struct Wallpaper *) g_ready = NULL;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void deadline_to_timespec(int64_t deadline_ns, struct timespec *ts) {
+  ts->tv_sec = (time_t)(deadline_ns / 1000000000LL);
+  ts->tv_nsec = (long)(deadline_ns % 1000000000LL);
+}
+
+static int has_png_suffix(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && strcasecmp(name + len - 4, ".png") == 0;
+}
+
+static int is_png_file(const struct dirent *entry) {
+  return has_png_suffix(entry->d_name);
+}
+
+static void free_paths(char **paths, int count) {
+  for (int i = 0; i < count; i++) {
+    free(paths[i]);
+  }
+  free(paths);
+}
+
+/**
+ * @brief Lists the PNG wallpapers of a directory in name order.
+ *
+ * @return Number of wallpapers found, 0 if none or on error.
+ */
+static int list_directory(const char *dir, char ***paths_out) {
+  struct dirent **entries = NULL;
+  int n = scandir(dir, &entries, is_png_file, alphasort);
+  if (n <= 0) {
+    free(entries);
+    return 0;
+  }
+
+  char **paths = calloc((size_t)n, sizeof(char *));
+  for (int i = 0; i < n; i++) {
+    if (paths && asprintf(&paths[i], "%s/%s", dir, entries[i]->d_name) < 0) {
+      paths[i] = NULL;
+    }
+    free(entries[i]);
+  }
+  free(entries);
+
+  if (!paths) {
+    return 0;
+  }
+  *paths_out = paths;
+  return n;
+}
+
+/**
+ * @brief Reads a playlist: one path per line, '#' starts a comment, and
+ *        relative paths are taken from the playlist's directory.
+ *
+ * @return Number of wallpapers listed, 0 if none or on error.
+ */
+static int read_playlist(const char *playlist, char ***paths_out) {
+  FILE *file = fopen(playlist, "r");
+  if (!file) {
+    perror(playlist);
+    return 0;
+  }
+  const char *slash = strrchr(playlist, '/');
+  int dir_len = slash ? (int)(slash - playlist) : 1;
+  const char *dir = slash ? playlist : ".";
+
+  char **paths = NULL;
+  int count = 0;
+  int capacity = 0;
+  char line[PATH_MAX];
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "#\r\n")] = '\0';
+    char *entry = line;
+    while (*entry == ' ' || *entry == '\t') {
+      entry++;
+    }
+    size_t len = strlen(entry);
+    while (len > 0 && (entry[len - 1] == ' ' || entry[len - 1] == '\t')) {
+      entry[--len] = '\0';
+    }
+    if (len == 0) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      char **grown = realloc(paths, (size_t)capacity * sizeof(char *));
+      if (!grown) {
+        break;
+      }
+      paths = grown;
+    }
+    int result = (entry[0] == '/')
+                     ? asprintf(&paths[count], "%s", entry)
+                     : asprintf(&paths[count], "%.*s/%s", dir_len, dir, entry);
+    if (result >= 0) {
+      count++;
+    }
+  }
+  fclose(file);
+
+  if (count == 0) {
+    free(paths);
+    return 0;
+  }
+  *paths_out = paths;
+  return count;
+}
+
+static void release_wallpaper(struct Wallpaper *wallpaper) {
+  if (!wallpaper) {
+    return;
+  }
+  for (int i = 0; i < display_config->num_screens; i++) {
+    if (wallpaper->screens[i]) {
+      cairo_surface_destroy(wallpaper->screens[i]);
+    }
+  }
+  free(wallpaper->screens);
+  free(wallpaper);
+}
+
+/**
+ * @brief Decodes one wallpaper, scales it once per distinct screen size and
+ *        picks its text color. Only touches image surfaces.
+ *
+ * @return The wallpaper, or NULL if it could not be loaded.
+ */
+static struct Wallpaper *decode_wallpaper(const char *path) {
+  cairo_surface_t *image = cairo_image_surface_create_from_png(path);
+  if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(image);
+    return NULL;
+  }
+
+  struct Wallpaper *wallpaper = calloc(1, sizeof(*wallpaper));
+  if (wallpaper) {
+    wallpaper->screens = calloc((size_t)display_config->num_screens,
+                                sizeof(cairo_surface_t *));
+  }
+  if (!wallpaper || !wallpaper->screens) {
+    free(wallpaper);
+    cairo_surface_destroy(image);
+    return NULL;
+  }
+
+  for (int i = 0; i < display_config->num_screens; i++) {
+    const XineramaScreenInfo *info = &display_config->screen_info[i];
+
+    /* Screens of the same size share one scaled copy. */
+    for (int j = 0; j < i; j++) {
+      if (wallpaper->screens[j] &&
+          display_config->screen_info[j].width == info->width &&
+          display_config->screen_info[j].height == info->height) {
+        wallpaper->screens[i] = cairo_surface_reference(wallpaper->screens[j]);
+        break;
+      }
+    }
+    if (!wallpaper->screens[i]) {
+      wallpaper->screens[i] =
+          create_scaled_image(image, info->width, info->height);
+    }
+    if (!wallpaper->screens[i]) {
+      cairo_surface_destroy(image);
+      release_wallpaper(wallpaper);
+      return NULL;
+    }
+  }
+  cairo_surface_destroy(image);
+
+  wallpaper->text_color =
+      text_color_for_image(wallpaper->screens[0],
+                           display_config->screen_info[0].width,
+                           display_config->screen_info[0].height);
+  return wallpaper;
+}
+
+/**
+ * @brief Keeps the prefetch thread out of the session's way, for both CPU
+ *        and disk.
+ */
+static void lower_priority(void) {
+  pid_t tid = (pid_t)syscall(SYS_gettid);
+  setpriority(PRIO_PROCESS, (id_t)tid, PREFETCH_THREAD_NICE);
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+              IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+    perror("ioprio_set");
+  }
+}
+
+/**
+ * @brief Prefetch thread: keeps the next wallpaper decoded, marks timed
+ *        rotations due, and wakes the main thread once a due wallpaper is
+ *        ready.
+ */
+static void *prefetch_loop(void *arg) {
+  struct Slideshow *show = arg;
+  lower_priority();
+
+  pthread_mutex_lock(&show->lock);
+  while (!show->stop) {
+    if (!atomic_load(&g_ready) && show->failures < show->num_paths) {
+      const char *path = show->paths[show->next];
+      show->next = (show->next + 1) % show->num_paths;
+      pthread_mutex_unlock(&show->lock);
+
+      struct Wallpaper *wallpaper = path ? decode_wallpaper(path) : NULL;
+
+      pthread_mutex_lock(&show->lock);
+      if (!wallpaper) {
+        fprintf(stderr, "Skipping wallpaper %s.\n", path ? path : "(null)");
+        show->failures++;
+        continue;
+      }
+      show->failures = 0;
+      atomic_store(&g_ready, wallpaper);
+      continue;
+    }
+
+    int64_t now = monotonic_ns();
+    if (show->interval_ns > 0 && now >= show->rotate_ns) {
+      show->due = 1;
+      show->rotate_ns = now + show->interval_ns;
+    }
+    if (show->due && !show->announced && atomic_load(&g_ready)) {
+      show->announced = 1;
+      event_post(EVENT_WALLPAPER);
+    }
+
+    if (show->interval_ns > 0) {
+      struct timespec ts;
+      deadline_to_timespec(show->rotate_ns, &ts);
+      int wait = pthread_cond_timedwait(&show->changed, &show->lock, &ts);
+      if (wait != 0 && wait != ETIMEDOUT) {
+        break;
+      }
+    } else {
+      pthread_cond_wait(&show->changed, &show->lock);
+    }
+  }
+  pthread_mutex_unlock(&show->lock);
+
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reports whether an image path names a slideshow: a directory, or
+ *        a file other than a PNG (a playlist).
+ *
+ * @return 1 for a slideshow, 0 for a single image (or nothing).
+ */
+int slideshow_source(const char *path) {
+  struct stat st;
+  if (path[0] == '\0' || stat(path, &st) != 0) {
+    return 0;
+  }
+  return S_ISDIR(st.st_mode) || (S_ISREG(st.st_mode) && !has_png_suffix(path));
+}
+
+/**
+ * @brief Starts a slideshow if the image option names one. Main thread only.
+ *
+ * @param source The image option.
+ * @param first Receives the path of the first wallpaper, to be loaded by the
+ *              caller like a single image.
+ * @param size Size of the first buffer.
+ * @return 1 if source is a slideshow, 0 if it is a single image, -1 if it is
+ *         a slideshow without any wallpaper.
+ */
+int slideshow_open(const char *source, char *first, size_t size) {
+  if (!slideshow_source(source)) {
+    return 0;
+  }
+
+  struct stat st;
+  char **paths = NULL;
+  int count = (stat(source, &st) == 0 && S_ISDIR(st.st_mode))
+                  ? list_directory(source, &paths)
+                  : read_playlist(source, &paths);
+  if (count == 0 || !paths[0]) {
+    fprintf(stderr, "No wallpapers found in %s.\n", source);
+    if (paths) {
+      free_paths(paths, count);
+    }
+    return -1;
+  }
+  snprintf(first, size, "%s", paths[0]);
+  if (count == 1) {
+    free_paths(paths, count);
+    return 1;
+  }
+
+  struct Slideshow *show = calloc(1, sizeof(*show));
+  if (!show) {
+    free_paths(paths, count);
+    return 1;
+  }
+  struct Options options;
+  get_options(&options);
+  show->paths = paths;
+  show->num_paths = count;
+  show->next = 1;
+  show->interval_ns = (int64_t)options.slideshow_interval * 1000000000LL;
+  show->rotate_ns = monotonic_ns() + show->interval_ns;
+
+  pthread_mutex_init(&show->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&show->changed, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&show->thread, NULL, prefetch_loop, show) != 0) {
+    fprintf(stderr, "Failed to create wallpaper prefetch thread.\n");
+    pthread_cond_destroy(&show->changed);
+    pthread_mutex_destroy(&show->lock);
+    free_paths(paths, count);
+    free(show);
+    return 1;
+  }
+  g_slideshow = show;
+  return 1;
+}
+
+/**
+ * @brief Stops the prefetch thread and frees the playlist and any prepared
+ *        wallpaper. Main thread only.
+ */
+void slideshow_close(void) {
+  struct Slideshow *show = g_slideshow;
+  if (!show) {
+    return;
+  }
+
+  pthread_mutex_lock(&show->lock);
+  show->stop = 1;
+  pthread_cond_signal(&show->changed);
+  pthread_mutex_unlock(&show->lock);
+  pthread_join(show->thread, NULL);
+  g_slideshow = NULL;
+
+  release_wallpaper(atomic_exchange(&g_ready, NULL));
+  free_paths(show->paths, show->num_paths);
+  pthread_cond_destroy(&show->changed);
+  pthread_mutex_destroy(&show->lock);
+  free(show);
+}
+
+/**
+ * @brief Asks for the next wallpaper after a lock ended, unless wallpapers
+ *        rotate on a timer. It is installed once EVENT_WALLPAPER arrives.
+ */
+void slideshow_lock_ended(void) {
+  struct Slideshow *show = g_slideshow;
+  if (!show || show->interval_ns > 0) {
+    return;
+  }
+  pthread_mutex_lock(&show->lock);
+  show->due = 1;
+  pthread_cond_signal(&show->changed);
+  pthread_mutex_unlock(&show->lock);
+}
+
+/**
+ * @brief Takes the prepared wallpaper and makes it every screen's
+ *        background, then lets the prefetch thread decode the next one.
+ *        Main thread only; call on EVENT_WALLPAPER.
+ *
+ * @return 1 if the background changed, 0 if nothing was ready.
+ */
+int slideshow_install(void) {
+  struct Slideshow *show = g_slideshow;
+  if (!show) {
+    return 0;
+  }
+  struct Wallpaper *wallpaper = atomic_exchange(&g_ready, NULL);
+  if (!wallpaper) {
+    return 0;
+  }
+  pthread_mutex_lock(&show->lock);
+  show->due = 0;
+  show->announced = 0;
+  pthread_cond_signal(&show->changed);
+  pthread_mutex_unlock(&show->lock);
+
+  for (int i = 0; i < display_config->num_screens; i++) {
+    cairo_pattern_t *pattern =
+        cairo_pattern_create_for_surface(wallpaper->screens[i]);
+    install_background(i, pattern);
+    cairo_pattern_destroy(pattern);
+  }
+  if (screen_configs[0].text_color != wallpaper->text_color) {
+    screen_configs[0].text_color = wallpaper->text_color;
+    modules_restyle();
+  }
+  release_wallpaper(wallpaper);
+  return 1;
+}
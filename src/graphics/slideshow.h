@@ -0,0 +1,22 @@
+#ifndef SLIDESHOW_H
+#define SLIDESHOW_H
+
+/**
+ * @file slideshow.h
+ * @brief Declarations for rotating the background through a directory or
+ *        playlist of wallpapers.
+ */
+
+#include <stddef.h>
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int slideshow_source(const char *path);
+int slideshow_open(const char *source, char *first, size_t size);
+void slideshow_close(void);
+void slideshow_lock_ended(void);
+int slideshow_install(void);
+
+#endif /* SLIDESHOW_H */
@@ -0,0 +1,304 @@
+/**
+ * @file idle.c
+ * @brief Locks, pre-warms the lock and suspends once the user has been
+ *        idle long enough.
+ *
+ * A one-shot timerfd wakes whichever main loop is running (the daemon's or
+ * the lock screen's), which then calls idle_dispatch() to read the
+ * XScreenSaver idle time and the DPMS state, advance the idle lock and
+ * suspend timeouts, and arm the timer for the next timeout that can fall
+ * due. Activity only pushes those later, so nothing is missed by sleeping
+ * until then. While locked the timer is stopped unless a suspend is still
+ * pending, so a lock with the displays off is not woken every second.
+ * Keeping these queries on the main thread means the X connection is never
+ * used from two threads at once.
+ */
+
+#include "idle.h"
+#include "config.h"
+#include "events.h"
+#include "lockscreen.h"
+#include "logind.h"
+#include "mpris.h"
+#include "profile.h"
+#include <X11/Xmd.h>
+#include <X11/extensions/dpms.h>
+#include <X11/extensions/dpmsconst.h>
+#include <X11/extensions/scrnsaver.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+/* How soon to look again while a timeout is due but held off. */
+static const int64_t IDLE_RECHECK_MS = 1000;
+/* Longest sleep while unlocked, so reloaded options are picked up. */
+static const int64_t IDLE_MAX_WAIT_MS = 60000;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Where the suspend timeout stands.
+ */
+enum SuspendState {
+  SUSPEND_IDLE_WAIT,   /**< Waiting for the suspend timeout. */
+  SUSPEND_LOCK_WAIT,   /**< Timed out; waiting for the lock to come up. */
+  SUSPEND_UNLOCK_WAIT, /**< Suspend requested; waiting for the unlock. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/* All of these are only touched from the main thread. */
+static Display *g_display = NULL;
+static XScreenSaverInfo *g_info = NULL;
+static int g_timer_fd = -1;
+static int g_lock_timeout = 0; /* X screen saver timeout, in seconds. */
+static int g_prewarmed = 0;
+static enum SuspendState g_suspend = SUSPEND_IDLE_WAIT;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Reports whether a media player is playing, if MPRIS support is
+ *        built in.
+ */
+static int media_playing(void) {
+#if PROFILE_MPRIS
+  return mpris_player_playing();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Asks for the lock to be prepared once the idle time comes within
+ *        the "prewarm" lead of the timeout, and released again if activity
+ *        resumes first.
+ */
+static void update_prewarm(const struct Options *options, int idle_ms) {
+  int lead =
+      (options->prewarm < g_lock_timeout) ? options->prewarm : g_lock_timeout;
+  int near = options->prewarm > 0 && g_lock_timeout > 0 &&
+             idle_ms >= (g_lock_timeout - lead) * 1000;
+  if (near != g_prewarmed) {
+    event_post(near ? EVENT_PREWARM : EVENT_COOLDOWN);
+    g_prewarmed = near;
+  }
+}
+
+/**
+ * @brief Locks once the idle time exceeds the X screen saver timeout.
+ */
+static void update_lock(const struct Options *options, int idle_ms,
+                        BOOL dpms_enabled) {
+  if (atomic_load(&lockscreen_running)) {
+    /* lockscreen() took whatever was prepared. */
+    g_prewarmed = 0;
+    return;
+  }
+  if (idle_ms < g_lock_timeout * 1000 || dpms_enabled == DPMSModeOn) {
+    update_prewarm(options, idle_ms);
+    return;
+  }
+  event_post(EVENT_LOCK);
+}
+
+/**
+ * @brief Suspends once the idle time exceeds the "suspend_timeout" option,
+ *        unless a media player is playing, and only after the lock is up.
+ */
+static void update_suspend(const struct Options *options, int idle_ms,
+                           BOOL dpms_enabled) {
+  int locked = atomic_load(&lockscreen_running);
+  switch (g_suspend) {
+  case SUSPEND_IDLE_WAIT:
+    if (options->suspend_timeout == 0 ||
+        idle_ms < options->suspend_timeout * 1000 ||
+        dpms_enabled == DPMSModeOn || media_playing()) {
+      break;
+    }
+    g_suspend = SUSPEND_LOCK_WAIT;
+    /* fall through */
+  case SUSPEND_LOCK_WAIT:
+    if (!locked) {
+      break;
+    }
+    logind_suspend();
+    g_suspend = SUSPEND_UNLOCK_WAIT;
+    break;
+  case SUSPEND_UNLOCK_WAIT:
+    if (!locked) {
+      g_suspend = SUSPEND_IDLE_WAIT;
+    }
+    break;
+  }
+}
+
+/**
+ * @brief Arms the one-shot timer to fire in delay_ms, or stops it for 0.
+ */
+static void arm_timer(int64_t delay_ms) {
+  struct itimerspec spec = {
+      .it_value = {.tv_sec = (time_t)(delay_ms / 1000),
+                   .tv_nsec = (long)(delay_ms % 1000) * 1000000L},
+  };
+  if (timerfd_settime(g_timer_fd, 0, &spec, NULL) < 0) {
+    perror("timerfd_settime");
+  }
+}
+
+/**
+ * @brief Time until a timeout that is idle_ms away from falling due: the
+ *        remaining idle time, or IDLE_RECHECK_MS once it is due but held
+ *        off (by DPMS or a playing media player).
+ */
+static int64_t until_due(int64_t timeout_ms, int idle_ms) {
+  int64_t remaining = timeout_ms - idle_ms;
+  return (remaining > IDLE_RECHECK_MS) ? remaining : IDLE_RECHECK_MS;
+}
+
+/**
+ * @brief Works out when idle_dispatch() next has something to do.
+ *
+ * @return Milliseconds to wait, or 0 to stop the timer until idle_rearm().
+ */
+static int64_t next_check_ms(const struct Options *options, int idle_ms) {
+  int suspend_armed =
+      g_suspend == SUSPEND_IDLE_WAIT && options->suspend_timeout > 0;
+
+  if (atomic_load(&lockscreen_running)) {
+    /* Only a pending suspend needs the timer while locked. */
+    if (g_suspend == SUSPEND_LOCK_WAIT) {
+      return IDLE_RECHECK_MS;
+    }
+    return suspend_armed
+               ? until_due((int64_t)options->suspend_timeout * 1000, idle_ms)
+               : 0;
+  }
+
+  /* A pre-warm has to notice activity, and a suspend the lock, promptly. */
+  if (g_prewarmed || g_suspend == SUSPEND_LOCK_WAIT) {
+    return IDLE_RECHECK_MS;
+  }
+  int64_t wait = IDLE_MAX_WAIT_MS;
+  if (g_lock_timeout > 0) {
+    int64_t lock_ms = (int64_t)g_lock_timeout * 1000;
+    int64_t check = until_due(lock_ms, idle_ms);
+    if (options->prewarm > 0) {
+      int64_t lead_ms = (int64_t)options->prewarm * 1000;
+      int64_t prewarm_ms = (lead_ms < lock_ms) ? lock_ms - lead_ms : 0;
+      int64_t prewarm_check = until_due(prewarm_ms, idle_ms);
+      check = (prewarm_check < check) ? prewarm_check : check;
+    }
+    wait = (check < wait) ? check : wait;
+  }
+  if (suspend_armed) {
+    int64_t check =
+        until_due((int64_t)options->suspend_timeout * 1000, idle_ms);
+    wait = (check < wait) ? check : wait;
+  }
+  return wait;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Starts the idle timer. Call from the main thread after
+ *        events_init().
+ *
+ * @param display The display whose idle time is watched.
+ * @return 0 on success, -1 if idle locking is unavailable.
+ */
+int idle_init(Display *display) {
+  g_display = display;
+  g_info = XScreenSaverAllocInfo();
+  if (!g_info) {
+    fprintf(stderr, "Failed to allocate XScreenSaverInfo.\n");
+    return -1;
+  }
+
+  /* Get current screen saver parameters. */
+  int interval, prefer_blanking, allow_exposures;
+  XGetScreenSaver(display, &g_lock_timeout, &interval, &prefer_blanking,
+                  &allow_exposures);
+
+  g_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (g_timer_fd < 0) {
+    perror("timerfd_create");
+    idle_cleanup();
+    return -1;
+  }
+  arm_timer(IDLE_RECHECK_MS);
+  return 0;
+}
+
+/**
+ * @brief Restarts the timer after a lock ended, since it may have been
+ *        stopped while locked. Main thread only.
+ */
+void idle_rearm(void) {
+  if (g_timer_fd >= 0) {
+    arm_timer(IDLE_RECHECK_MS);
+  }
+}
+
+/**
+ * @brief Stops the idle timer.
+ */
+void idle_cleanup(void) {
+  if (g_timer_fd >= 0) {
+    close(g_timer_fd);
+    g_timer_fd = -1;
+  }
+  if (g_info) {
+    XFree(g_info);
+    g_info = NULL;
+  }
+}
+
+/**
+ * @brief The timer main loops poll for POLLIN, or -1 if idle locking is
+ *        unavailable (poll() skips negative descriptors).
+ */
+int idle_fd(void) { return g_timer_fd; }
+
+/**
+ * @brief Queries the idle time and DPMS and advances the idle timeouts.
+ *        Main thread only; call when idle_fd() is readable.
+ */
+void idle_dispatch(void) {
+  uint64_t expirations;
+  if (read(g_timer_fd, &expirations, sizeof(expirations)) < 0) {
+    /* Spurious wakeup: the timer has not fired. */
+    return;
+  }
+
+  if (!XScreenSaverQueryInfo(g_display, DefaultRootWindow(g_display),
+                             g_info)) {
+    arm_timer(IDLE_RECHECK_MS);
+    return;
+  }
+  BOOL dpms_enabled = False;
+  CARD16 power_level;
+  DPMSInfo(g_display, &power_level, &dpms_enabled);
+
+  struct Options options;
+  get_options(&options);
+  int idle_ms = (int)g_info->idle;
+  update_lock(&options, idle_ms, dpms_enabled);
+  update_suspend(&options, idle_ms, dpms_enabled);
+  arm_timer(next_check_ms(&options, idle_ms));
+}
@@ -0,0 +1,21 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+/**
+ * @file idle.h
+ * @brief Declarations for the idle lock, pre-warm and suspend timeouts.
+ */
+
+#include <X11/Xlib.h>
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int idle_init(Display *display);
+void idle_cleanup(void);
+void idle_rearm(void);
+int idle_fd(void);
+void idle_dispatch(void);
+
+#endif /* IDLE_H */
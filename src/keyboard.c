@@ -0,0 +1,121 @@
+/**
+ * @file keyboard.c
+ * @brief Decodes key presses with xkbcommon, so keysyms and text follow the
+ *        user's actual layout (dead keys aside) instead of fixed keycodes.
+ */
+
+#include "keyboard.h"
+#include <X11/Xlib-xcb.h>
+#include <X11/Xutil.h>
+#include <stdio.h>
+#include <xkbcommon/xkbcommon-x11.h>
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct xkb_context *g_context = NULL;
+static struct xkb_keymap *g_keymap = NULL;
+static struct xkb_state *g_state = NULL;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Feeds the modifier and group state carried by the event into the
+ *        xkb state, so the lookup sees what the server saw.
+ */
+static void sync_state(const XKeyEvent *key_event) {
+  xkb_mod_mask_t mods = key_event->state & 0xff;
+  xkb_layout_index_t group = (key_event->state >> 13) & 0x3;
+  xkb_state_update_mask(g_state, mods, 0, 0, 0, 0, group);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Loads the current keymap of the core keyboard.
+ *
+ * Called at the start of every lock so that layout changes made while
+ * unlocked are picked up. On failure key presses fall back to
+ * XLookupString(), which only handles Latin-1.
+ *
+ * @param display The X display.
+ * @return 0 on success, -1 if XKB is unavailable.
+ */
+int keyboard_init(Display *display) {
+  xcb_connection_t *connection = XGetXCBConnection(display);
+  if (!g_context) {
+    if (!xkb_x11_setup_xkb_extension(
+            connection, XKB_X11_MIN_MAJOR_XKB_VERSION,
+            XKB_X11_MIN_MINOR_XKB_VERSION, XKB_X11_SETUP_XKB_EXTENSION_NO_FLAGS,
+            NULL, NULL, NULL, NULL)) {
+      fprintf(stderr, "XKB extension unavailable; using core key lookup.\n");
+      return -1;
+    }
+    g_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!g_context) {
+      fprintf(stderr, "Failed to create xkb context.\n");
+      return -1;
+    }
+  }
+
+  int32_t device_id = xkb_x11_get_core_keyboard_device_id(connection);
+  struct xkb_keymap *keymap = NULL;
+  struct xkb_state *state = NULL;
+  if (device_id >= 0) {
+    keymap = xkb_x11_keymap_new_from_device(g_context, connection, device_id,
+                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
+  }
+  if (keymap) {
+    state = xkb_x11_state_new_from_device(keymap, connection, device_id);
+  }
+  if (!state) {
+    fprintf(stderr, "Failed to load the keyboard map; using core lookup.\n");
+    xkb_keymap_unref(keymap);
+    return -1;
+  }
+
+  xkb_state_unref(g_state);
+  xkb_keymap_unref(g_keymap);
+  g_keymap = keymap;
+  g_state = state;
+  return 0;
+}
+
+/**
+ * @brief Releases the keymap and context.
+ */
+void keyboard_cleanup(void) {
+  xkb_state_unref(g_state);
+  xkb_keymap_unref(g_keymap);
+  xkb_context_unref(g_context);
+  g_state = NULL;
+  g_keymap = NULL;
+  g_context = NULL;
+}
+
+/**
+ * @brief Decodes a key press.
+ *
+ * @param key_event The X key event.
+ * @param text Receives the UTF-8 text the key produces (possibly empty).
+ * @param size Size of the text buffer.
+ * @return The keysym of the key under the current layout and modifiers.
+ */
+xkb_keysym_t keyboard_decode(XKeyEvent *key_event, char *text, size_t size) {
+  if (!g_state) {
+    KeySym key_sym = NoSymbol;
+    int len = XLookupString(key_event, text, (int)size - 1, &key_sym, NULL);
+    text[(len > 0) ? len : 0] = '\0';
+    return (xkb_keysym_t)key_sym;
+  }
+
+  sync_state(key_event);
+  xkb_keycode_t keycode = key_event->keycode;
+  xkb_state_key_get_utf8(g_state, keycode, text, size);
+  return xkb_state_key_get_one_sym(g_state, keycode);
+}
@@ -0,0 +1,21 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+/**
+ * @file keyboard.h
+ * @brief Declarations for XKB-based key decoding.
+ */
+
+#include <X11/Xlib.h>
+#include <stddef.h>
+#include <xkbcommon/xkbcommon.h>
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int keyboard_init(Display *display);
+void keyboard_cleanup(void);
+xkb_keysym_t keyboard_decode(XKeyEvent *key_event, char *text, size_t size);
+
+#endif /* KEYBOARD_H */
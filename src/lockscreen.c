@@ -5,26 +5,72 @@
  */
 
 #include "lockscreen.h"
+#include "auth.h"
+#include "graphics/animation.h"
+#include "graphics/blur.h"
+#include "graphics/fonts.h"
 #include "graphics/graphics.h"
-#include "graphics/modules/date.h"
-#include "pam.h"
+#include "graphics/slideshow.h"
+#include "graphics/modules/module.h"
+#include "events.h"
+#include "graphics/modules/password_entry.h"
+#include "idle.h"
+#include "keyboard.h"
+#include "logind.h"
+#include "power.h"
+#include "config.h"
+#include "control.h"
+#include "profile.h"
+#include "residency.h"
+#include "stats.h"
 #include "utils.h"
 #include <X11/X.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xmd.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/dpms.h>
+#include <X11/extensions/dpmsconst.h>
+#include <X11/extensions/scrnsaver.h>
 #include <cairo/cairo.h>
-#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+static const long WINDOW_EVENT_MASK = SubstructureNotifyMask | ExposureMask |
+                                     KeyPressMask | StructureNotifyMask |
+                                     VisibilityChangeMask;
+/* While the displays are off, pointer input may also wake them. */
+static const long DISPLAYS_OFF_EVENT_MASK = PointerMotionMask | ButtonPressMask;
+/* Re-query DPMS on a wakeup we had anyway if the cache is older than this. */
+static const int64_t DPMS_RECHECK_NS = 60LL * 1000000000LL;
+/* Margin after a DPMS timeout before checking that it took effect. */
+static const int64_t DPMS_SLACK_NS = 500LL * 1000000LL;
+/* In low-power mode, how long a redraw nobody is waiting on may be held
+ * back so that others arriving meanwhile share its frame and flush. */
+static const int64_t LOW_POWER_BATCH_NS = 250LL * 1000000LL;
+/* An override-redirect window is raised back on top at most this often. */
+static const int64_t RAISE_INTERVAL_NS = 1000LL * 1000000LL;
+/*
+ * How much older than the "prewarm" lead a pre-warmed blur may be when the
+ * lock comes: the idle timer checks once a second while pre-warmed, so an
+ * on-time lock can arrive a little after the lead has passed.
+ */
+static const int64_t PREWARM_SLACK_NS = 2000LL * 1000000LL;
+
 /* ------------------------------------------------------------------------- */
 /* Global Variables                                                          */
 /* ------------------------------------------------------------------------- */
@@ -32,28 +78,81 @@ struct ScreenConfig *screen_configs = NULL;
 struct passwd *pw = NULL;
 char current_input[128] = {0};
 int current_input_index = 0;
+int current_input_chars = 0;
 int password_is_wrong = 0;
 atomic_int lockscreen_running = 0;
-pthread_t date_thread;
+atomic_int lock_presented = 0;
 Window root_window;
 atomic_int needs_redraw = 0;
-Atom redraw_atom;
+
+/**
+ * @brief Cached display power state, owned by the lockscreen loop.
+ */
+struct DisplayPower {
+  int on;              /**< Displays are on (or DPMS is disabled). */
+  int64_t checked_ns;  /**< When DPMS was last queried. */
+  int64_t deadline_ns; /**< When a DPMS timeout could next fire, or 0. */
+};
+static struct DisplayPower g_power;
+#if PROFILE_IDLE
+static XScreenSaverInfo *g_idle_info = NULL;
+#endif
+
+/**
+ * @brief How long the current lock took to cover the screens.
+ */
+struct Coverage {
+  int64_t start_ns;  /**< When lockscreen() was entered. */
+  int64_t mapped_ns; /**< When the last window was reported mapped, or 0. */
+  int64_t drawn_ns;  /**< When the first frame reached the server, or 0. */
+  int refine;        /**< Placeholder backgrounds await the full blur. */
+  int mapped;        /**< Windows reported mapped so far. */
+  int reported;      /**< The timings have been printed. */
+};
+static struct Coverage g_coverage;
+/* This lock's windows bypass the window manager. */
+static int g_override_redirect = 0;
+
+/**
+ * @brief What lockscreen_prewarm() prepared for the next lock.
+ */
+struct Prewarm {
+  int active;          /**< Prepared and not released since. */
+  int user;            /**< pw is resolved. */
+  int blurred;         /**< Every screen's blurred background is installed. */
+  int64_t captured_ns; /**< When the screens were captured for the blur. */
+  int64_t ready_ns;    /**< When the preparation finished. */
+};
+static struct Prewarm g_prewarm;
 /* ------------------------------------------------------------------------- */
 /* Local Prototypes                                                          */
 /* ------------------------------------------------------------------------- */
 static void cleanUpLockscreen(void);
 static void handle_keypress(XKeyEvent key_event);
+static void frame_presented(void);
+static int update_display_power(int input);
+
+/**
+ * @brief Keeps the typed password out of swap, whatever the mlock option
+ *        says. Also called after munlockall() dropped all locks, so it is
+ *        safe to call from any thread.
+ */
+void lockscreen_lock_input(void) {
+  if (mlock(current_input, sizeof(current_input)) != 0) {
+    perror("mlock");
+  }
+}
 
 /**
  * @brief Initializes the X11 windows for the lockscreen.
  */
 void initialize_windows(void) {
   /* Query the screen info for multi-monitor support (Xinerama). */
-  display_config->screen_info = XineramaQueryScreens(
-      display_config->display, &display_config->num_screens);
+  display_config->screen_info =
+      query_screens(display_config->display, &display_config->num_screens);
 
   if (display_config->screen_info == NULL) {
-    fprintf(stderr, "Failed to query Xinerama screens.\n");
+    fprintf(stderr, "Failed to query the screens.\n");
     exit(EXIT_FAILURE);
   }
 
@@ -69,6 +168,8 @@ void initialize_windows(void) {
     exit(EXIT_FAILURE);
   }
 
+  lockscreen_lock_input();
+
   screen_configs = (struct ScreenConfig *)calloc(display_config->num_screens,
                                                  sizeof(struct ScreenConfig));
   if (!screen_configs) {
@@ -80,15 +181,15 @@ void initialize_windows(void) {
   for (int i = 0; i < display_config->num_screens; i++) {
     screen_configs[i].window = XCreateSimpleWindow(
         display_config->display, root_window,
-        display_config->screen_info[i].x_org, 0,
+        display_config->screen_info[i].x_org,
+        display_config->screen_info[i].y_org,
         display_config->screen_info[i].width,
         display_config->screen_info[i].height, 0, 0, background_color);
 
     XStoreName(display_config->display, screen_configs[i].window,
                "minimalist_lockscreen");
     XSelectInput(display_config->display, screen_configs[i].window,
-                 SubstructureNotifyMask | ExposureMask | KeyPressMask |
-                     StructureNotifyMask);
+                 WINDOW_EVENT_MASK);
 
     /* Make the window appear fullscreen. */
     Atom net_wm_state =
@@ -100,47 +201,359 @@ void initialize_windows(void) {
                     net_wm_state, XA_ATOM, 32, PropModeReplace,
                     (unsigned char *)&net_wm_fullscreen, 1);
   }
-
-  redraw_atom = XInternAtom(display_config->display, "REDRAW_EVENT", False);
 }
 
 /**
  * @brief Handles a key press event within the lock screen.
  *
+ * Keys are decoded through XKB, so Backspace/Return are recognised on any
+ * layout and the passphrase is stored as the UTF-8 the layout produces.
+ *
  * @param key_event The XKeyEvent representing the key press.
  */
 static void handle_keypress(XKeyEvent key_event) {
   password_is_wrong = 0;
 
-  /* 22 is the Backspace keycode in many X configurations, 36 is Return. */
-  if (key_event.keycode == 22) { /* Backspace */
+  char text[64];
+  xkb_keysym_t key_sym = keyboard_decode(&key_event, text, sizeof(text));
+
+  switch (key_sym) {
+  case XKB_KEY_BackSpace:
     if (current_input_index > 0) {
-      current_input_index--;
+      /* Drop a whole UTF-8 character: continuation bytes, then the lead. */
+      do {
+        current_input_index--;
+      } while (current_input_index > 0 &&
+               ((unsigned char)current_input[current_input_index] & 0xC0) ==
+                   0x80);
       current_input[current_input_index] = '\0';
+      current_input_chars--;
+    }
+    break;
+  case XKB_KEY_Return:
+  case XKB_KEY_KP_Enter:
+    /*
+     * Start authenticating in the background; handle_auth_result() unlocks
+     * once a service accepts. Enter is ignored while an attempt runs.
+     */
+    if (auth_pending()) {
+      break;
     }
-  } else if (key_event.keycode == 36) { /* Enter */
-    /* Attempt authentication. If successful, exit the lock screen. */
-    if (auth_pam(current_input, pw->pw_name) == 0) {
-      atomic_store(&lockscreen_running, 0);
-    } else {
+    struct Options options;
+    get_options(&options);
+    stats_auth_begin();
+    if (auth_start(options.pam_service, NULL, current_input, pw->pw_name) !=
+        0) {
+      stats_auth_end();
       password_is_wrong = 1;
     }
+    memset(current_input, 0, sizeof(current_input));
     current_input_index = 0;
-    current_input[0] = '\0';
-  } else {
-    /* Capture visible characters into current_input. */
-    char event_char;
-    KeySym key_sym;
-    XLookupString(&key_event, &event_char, 1, &key_sym, NULL);
-
-    if (isprint((unsigned char)event_char) &&
-        current_input_index < (int)(sizeof(current_input) - 1)) {
-      /* Avoid writing past the buffer. */
-      current_input[current_input_index] = event_char;
-      current_input_index++;
+    current_input_chars = 0;
+    break;
+  default: {
+    /* Capture the text the key produces, ignoring control characters. */
+    size_t len = strlen(text);
+    if (len == 0 || (unsigned char)text[0] < 0x20 ||
+        (unsigned char)text[0] == 0x7f) {
+      break;
+    }
+    /* Avoid writing past the buffer, and never split a character. */
+    if (current_input_index + len < sizeof(current_input)) {
+      memcpy(current_input + current_input_index, text, len);
+      current_input_index += (int)len;
       current_input[current_input_index] = '\0';
+      current_input_chars++;
+    }
+    break;
+  }
+  }
+  explicit_bzero(text, sizeof(text));
+}
+
+/**
+ * @brief Acts on the outcome of the authentication attempt, if it has one.
+ *
+ * @return 1 if the password entry must be redrawn.
+ */
+static int handle_auth_result(void) {
+  switch (auth_result()) {
+  case AUTH_SUCCESS:
+    stats_auth_end();
+    atomic_store(&lockscreen_running, 0);
+    return 0;
+  case AUTH_FAILURE:
+    stats_auth_end();
+    password_is_wrong = 1;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Prints how long the lock took to cover the screens, once both the
+ *        windows are mapped and the first frame has been drawn.
+ */
+static void report_coverage(void) {
+  if (g_coverage.reported || g_coverage.mapped_ns == 0 ||
+      g_coverage.drawn_ns == 0) {
+    return;
+  }
+  g_coverage.reported = 1;
+  int64_t covered_ns = (g_coverage.mapped_ns > g_coverage.drawn_ns)
+                           ? g_coverage.mapped_ns
+                           : g_coverage.drawn_ns;
+  printf("Lock coverage (%s): windows mapped after %.1f ms, first frame "
+         "after %.1f ms, covered after %.1f ms.\n",
+         g_override_redirect ? "override-redirect" : "window manager",
+         (double)(g_coverage.mapped_ns - g_coverage.start_ns) / 1e6,
+         (double)(g_coverage.drawn_ns - g_coverage.start_ns) / 1e6,
+         (double)(covered_ns - g_coverage.start_ns) / 1e6);
+  fflush(stdout);
+  stats_lock_covered(covered_ns - g_coverage.start_ns);
+}
+
+/**
+ * @brief Starts the full blur of a progressive lock's placeholder
+ *        backgrounds, now that the screens are covered. It runs on a worker
+ *        thread; install_refined() takes over on EVENT_REFINED.
+ */
+static void refine_backgrounds(void) {
+  g_coverage.refine = 0;
+  refine_blurred_backgrounds();
+}
+
+/**
+ * @brief Swaps the finished full blur in for the placeholders.
+ *
+ * @return 1 if a background changed and a frame is needed, 0 otherwise.
+ */
+static int install_refined(void) {
+  if (install_refined_backgrounds() == 0) {
+    return 0;
+  }
+  int64_t refined_ns = monotonic_ns() - g_coverage.start_ns;
+  printf("Full-quality background after %.1f ms.\n",
+         (double)refined_ns / 1e6);
+  fflush(stdout);
+  stats_background_refined(refined_ns);
+  return 1;
+}
+
+/**
+ * @brief Looks up the user to authenticate. getlogin() needs a login session
+ *        (utmp), which headless sessions such as Xvfb in CI lack.
+ *
+ * @return 0 on success, -1 if the user is unknown.
+ */
+static int resolve_user(void) {
+  const char *login = getlogin();
+  pw = login ? getpwnam(login) : NULL;
+  if (pw == NULL) {
+    pw = getpwuid(getuid());
+  }
+  return (pw == NULL) ? -1 : 0;
+}
+
+/**
+ * @brief Counts a MapNotify for one of the lock windows.
+ */
+static void window_mapped(void) {
+  if (g_coverage.mapped >= display_config->num_screens) {
+    return;
+  }
+  if (++g_coverage.mapped == display_config->num_screens) {
+    g_coverage.mapped_ns = monotonic_ns();
+    report_coverage();
+  }
+}
+
+/**
+ * @brief Checks whether an earlier screen overlaps this one (a mirrored or
+ *        partly cloned output), in which case their windows would keep
+ *        obscuring each other.
+ */
+static int overlaps_earlier_screen(int screen_num) {
+  const XineramaScreenInfo *info = display_config->screen_info;
+  const XineramaScreenInfo *self = &info[screen_num];
+  for (int i = 0; i < screen_num; i++) {
+    if (info[i].x_org < self->x_org + self->width &&
+        self->x_org < info[i].x_org + info[i].width &&
+        info[i].y_org < self->y_org + self->height &&
+        self->y_org < info[i].y_org + info[i].height) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Puts an override-redirect lock window back on top when something
+ *        (a notification, another override-redirect popup) covers it. The
+ *        window manager cannot do this for us.
+ *
+ * Each window is raised at most once per RAISE_INTERVAL_NS, so another
+ * client that also keeps itself on top cannot drag us into a raise loop.
+ *
+ * @param event The VisibilityNotify event.
+ */
+static void handle_visibility(const XVisibilityEvent *event) {
+  if (!g_override_redirect || event->state == VisibilityUnobscured) {
+    return;
+  }
+  for (int i = 0; i < display_config->num_screens; i++) {
+    struct ScreenConfig *screen = &screen_configs[i];
+    if (screen->window != event->window || overlaps_earlier_screen(i)) {
+      continue;
+    }
+    int64_t now = monotonic_ns();
+    if (screen->raised_ns != 0 && now - screen->raised_ns < RAISE_INTERVAL_NS) {
+      return;
+    }
+    screen->raised_ns = now;
+    XRaiseWindow(display_config->display, event->window);
+    return;
+  }
+}
+
+/**
+ * @brief Bookkeeping after a frame has been drawn.
+ *
+ * The first frame of a lock is synced to the X server so that "covered"
+ * really means covered before anyone waiting on it (e.g. a pending suspend)
+ * is told so.
+ */
+static void frame_presented(void) {
+  if (!atomic_load(&lock_presented)) {
+    XSync(display_config->display, False);
+    atomic_store(&lock_presented, 1);
+    stats_lock_presented();
+    control_lock_presented();
+    g_coverage.drawn_ns = monotonic_ns();
+    report_coverage();
+  }
+  logind_frame_presented();
+}
+
+/**
+ * @brief Queries DPMS and works out when the displays could next turn off
+ *        on their own: the first DPMS timeout minus the current idle time.
+ *
+ * @return Non-zero if the displays are on.
+ */
+static int query_display_power(void) {
+  Display *display = display_config->display;
+  int64_t now = monotonic_ns();
+  BOOL enabled = False;
+  CARD16 level = DPMSModeOn;
+  int on = !DPMSInfo(display, &level, &enabled) || !enabled ||
+           level == DPMSModeOn;
+
+  g_power.checked_ns = now;
+  g_power.deadline_ns = 0;
+
+  CARD16 timeouts[3];
+  if (!on || !enabled ||
+      !DPMSGetTimeouts(display, &timeouts[0], &timeouts[1], &timeouts[2])) {
+    return on;
+  }
+  int first = 0;
+  for (int i = 0; i < 3; i++) {
+    if (timeouts[i] != 0 && (first == 0 || timeouts[i] < first)) {
+      first = timeouts[i];
+    }
+  }
+#if PROFILE_IDLE
+  if (!g_idle_info) {
+    g_idle_info = XScreenSaverAllocInfo();
+  }
+  if (first != 0 && g_idle_info &&
+      XScreenSaverQueryInfo(display, root_window, g_idle_info)) {
+    int64_t remaining_ms = (int64_t)first * 1000 - (int64_t)g_idle_info->idle;
+    if (remaining_ms < 0) {
+      remaining_ms = 0;
     }
+    g_power.deadline_ns = now + remaining_ms * 1000000LL + DPMS_SLACK_NS;
+  }
+#else
+  /* Without the idle counter, assume the full timeout is still ahead. */
+  if (first != 0) {
+    g_power.deadline_ns = now + (int64_t)first * 1000000000LL + DPMS_SLACK_NS;
+  }
+#endif
+  return on;
+}
+
+/**
+ * @brief Stops or resumes module ticks and animation to match the display
+ *        power state and the low-power mode.
+ */
+static void apply_power_state(void) {
+  int low_power = low_power_active();
+  modules_set_low_power(low_power);
+  modules_set_paused(!g_power.on);
+  animation_set_paused(!g_power.on || low_power);
+}
+
+/**
+ * @brief Refreshes the cached display power state if it may have changed,
+ *        and stops or resumes module ticks and animation accordingly.
+ *
+ * DPMS is only queried when a timeout could have fired, on input while the
+ * displays are off, or piggybacked on a wakeup that happened anyway once
+ * the cache is old (to catch "xset dpms force off").
+ *
+ * @param input Non-zero if user input arrived since the last call.
+ * @return 1 if the displays just came back on.
+ */
+static int update_display_power(int input) {
+  int64_t now = monotonic_ns();
+  int stale = (input && !g_power.on) ||
+              (g_power.deadline_ns != 0 && now >= g_power.deadline_ns) ||
+              now - g_power.checked_ns >= DPMS_RECHECK_NS;
+  if (!stale) {
+    return 0;
+  }
+
+  int on = query_display_power();
+  if (on == g_power.on) {
+    return 0;
+  }
+  g_power.on = on;
+  stats_display_power(on);
+  apply_power_state();
+  for (int i = 0; i < display_config->num_screens; i++) {
+    XSelectInput(display_config->display, screen_configs[i].window,
+                 WINDOW_EVENT_MASK | (on ? 0 : DISPLAYS_OFF_EVENT_MASK));
+  }
+  return on;
+}
+
+/**
+ * @brief How long the lockscreen loop may sleep before the cached display
+ *        power state needs checking or a batched redraw is due.
+ *
+ * @param batch_deadline_ns When a held-back redraw is due, or 0 if none.
+ * @return Timeout in ms for poll(), or -1 to wait for input.
+ */
+static int loop_timeout_ms(int64_t batch_deadline_ns) {
+  int64_t deadline = (g_power.on) ? g_power.deadline_ns : 0;
+  if (batch_deadline_ns != 0 &&
+      (deadline == 0 || batch_deadline_ns < deadline)) {
+    deadline = batch_deadline_ns;
+  }
+  if (deadline == 0) {
+    return -1;
   }
+  int64_t remaining = deadline - monotonic_ns();
+  return (remaining <= 0) ? 0 : (int)((remaining + 999999) / 1000000);
 }
 
 /**
@@ -160,24 +573,100 @@ static void cleanUpLockscreen(void) {
   }
   XFlush(display_config->display);
 
-  /* Wait for the date update thread to finish. */
-  pthread_join(date_thread, NULL);
+  /* Abandon an authentication still running (its workers clean up). */
+  auth_cancel();
+
+  /* Stop the module scheduler. */
+  modules_stop();
+
+  /* Stop background playback and report its frame timings. */
+  animation_stop();
+
+  /* Drop captures a lock too short to refine left behind. */
+  discard_blurred_placeholders();
+
+  /* Move a per-lock slideshow on to the next wallpaper. */
+  slideshow_lock_ended();
+
+  /* Report wakeups and CPU time, and stop listening for pointer input. */
+  stats_lock_end();
+  if (!g_power.on) {
+    for (int i = 0; i < display_config->num_screens; i++) {
+      XSelectInput(display_config->display, screen_configs[i].window,
+                   WINDOW_EVENT_MASK);
+    }
+  }
 
   /* Clear any password data. */
   memset(current_input, 0, sizeof(current_input));
   current_input_index = 0;
+  current_input_chars = 0;
   password_is_wrong = 0;
 }
 
 void exit_cleanup(void) {
+  slideshow_close();
+  modules_destroy();
+  keyboard_cleanup();
   // destroy all windows
   for (int screen_num = 0; screen_num < display_config->num_screens;
        screen_num++) {
+    cairo_surface_destroy(screen_configs[screen_num].background_picture);
     cairo_surface_destroy(screen_configs[screen_num].surface);
     cairo_destroy(screen_configs[screen_num].overlay_buffer);
     XDestroyWindow(display_config->display, screen_configs[screen_num].window);
   }
   XDestroyWindow(display_config->display, root_window);
+  fonts_cleanup();
+}
+
+/**
+ * @brief Prepares the next lock while the idle timeout approaches: resolves
+ *        the user, takes the blurred screenshot, starts decoding the
+ *        animation, faults in the lock path's stack and renders the first
+ *        frame off-screen. lockscreen() then skips whatever is ready. Main
+ *        thread only.
+ */
+void lockscreen_prewarm(void) {
+  if (g_prewarm.active || atomic_load(&lockscreen_running)) {
+    return;
+  }
+  int64_t start_ns = monotonic_ns();
+
+  g_prewarm.user = (resolve_user() == 0);
+  if (blur_background_enabled()) {
+    g_prewarm.blurred = 1;
+    g_prewarm.captured_ns = monotonic_ns();
+    for (int i = 0; i < display_config->num_screens; i++) {
+      if (capture_blurred_background(i) != 0) {
+        g_prewarm.blurred = 0;
+      }
+    }
+  }
+  if (animation_enabled()) {
+    animation_start();
+  }
+  residency_prefault();
+  modules_prerender();
+
+  g_prewarm.active = 1;
+  g_prewarm.ready_ns = monotonic_ns();
+  printf("Pre-warmed the lock in %.1f ms.\n",
+         (double)(g_prewarm.ready_ns - start_ns) / 1e6);
+  fflush(stdout);
+}
+
+/**
+ * @brief Releases what lockscreen_prewarm() prepared, when activity resumed
+ *        before the lock. Main thread only.
+ */
+void lockscreen_release_prewarm(void) {
+  if (!g_prewarm.active) {
+    return;
+  }
+  animation_stop();
+  modules_release_prerender();
+  g_prewarm = (struct Prewarm){0};
 }
 
 /**
@@ -186,15 +675,77 @@ void exit_cleanup(void) {
  * @return 0 on success, nonzero on failure.
  */
 int lockscreen(void) {
+  atomic_store(&lock_presented, 0);
   atomic_store(&lockscreen_running, 1);
+  g_coverage = (struct Coverage){.start_ns = monotonic_ns()};
+  stats_lock_start();
+
+  /* Whatever lockscreen_prewarm() prepared is used as is. */
+  struct Prewarm prewarm = g_prewarm;
+  g_prewarm = (struct Prewarm){0};
+  if (prewarm.active) {
+    printf("Lock was pre-warmed %.1f s ahead.\n",
+           (double)(g_coverage.start_ns - prewarm.ready_ns) / 1e9);
+    fflush(stdout);
+  }
 
   /* Retrieve the user database entry for the current user. */
-  pw = getpwnam(getlogin());
-  if (pw == NULL) {
+  if (!prewarm.user && resolve_user() != 0) {
     fprintf(stderr, "Failed to get user information.\n");
+    atomic_store(&lockscreen_running, 0);
     return 1;
   }
 
+  struct Options options;
+  get_options(&options);
+
+  /*
+   * A pre-warmed blur shows the screens as they were when it was captured.
+   * If the lock came much later than the lead (a manual lock after the idle
+   * lock was held off, say), the desktop may have changed since: capture it
+   * again.
+   */
+  if (prewarm.blurred &&
+      g_coverage.start_ns - prewarm.captured_ns >
+          (int64_t)options.prewarm * 1000000000LL + PREWARM_SLACK_NS) {
+    printf("Pre-warmed blur is %.1f s old; capturing the screens again.\n",
+           (double)(g_coverage.start_ns - prewarm.captured_ns) / 1e9);
+    fflush(stdout);
+    prewarm.blurred = 0;
+  }
+
+  /*
+   * Blur mode: grab what is on screen right now, before our windows cover it,
+   * and use it as this lock's background. Progressive locks cover the screens
+   * with a cheap, coarse blur first and refine it after the first frame.
+   */
+  if (blur_background_enabled() && !prewarm.blurred) {
+    for (int i = 0; i < display_config->num_screens; i++) {
+      if (options.progressive) {
+        capture_blurred_placeholder(i);
+      } else {
+        capture_blurred_background(i);
+      }
+    }
+    g_coverage.refine = options.progressive;
+  }
+
+  /* Start decoding animation frames while the windows come up. */
+  if (animation_enabled()) {
+    animation_start();
+  }
+
+  /*
+   * Override-redirect windows are placed at the exact monitor geometry and
+   * stacked on top by the server itself, so coverage does not wait on (or
+   * depend on) the window manager honouring _NET_WM_STATE_FULLSCREEN. The
+   * attribute can only change while the windows are unmapped, which they
+   * are between locks.
+   */
+  g_override_redirect = options.override_redirect;
+  XSetWindowAttributes attributes = {.override_redirect =
+                                         g_override_redirect ? True : False};
+
   /* Map windows again; ensure fullscreen property is reapplied. */
   Atom net_wm_state =
       XInternAtom(display_config->display, "_NET_WM_STATE", False);
@@ -202,6 +753,16 @@ int lockscreen(void) {
       XInternAtom(display_config->display, "_NET_WM_STATE_FULLSCREEN", False);
 
   for (int i = 0; i < display_config->num_screens; i++) {
+    XChangeWindowAttributes(display_config->display, screen_configs[i].window,
+                            CWOverrideRedirect, &attributes);
+    if (g_override_redirect) {
+      const XineramaScreenInfo *info = &display_config->screen_info[i];
+      XMoveResizeWindow(display_config->display, screen_configs[i].window,
+                        info->x_org, info->y_org, info->width, info->height);
+      XMapRaised(display_config->display, screen_configs[i].window);
+      continue;
+    }
+
     /* Don't allow the user to close the window. */
     Atom wm_delete_window =
         XInternAtom(display_config->display, "WM_DELETE_WINDOW", False);
@@ -219,41 +780,184 @@ int lockscreen(void) {
 
   XFlush(display_config->display);
 
+  /* Pick up the current keyboard layout. */
+  keyboard_init(display_config->display);
+
   /* Hide the cursor and grab the keyboard. */
   XFixesHideCursor(display_config->display, root_window);
   XGrabKeyboard(display_config->display,
                 DefaultRootWindow(display_config->display), True, GrabModeAsync,
                 GrabModeAsync, CurrentTime);
 
-  /* Create a thread to continuously update date/time. */
-  int thread_create_result =
-      pthread_create(&date_thread, NULL, date_loop, NULL);
-  if (thread_create_result != 0) {
-    fprintf(stderr, "Failed to create date update thread.\n");
+  /* Schedule module updates (clock ticks, ...) for this lock. */
+  if (modules_start() != 0) {
     return 1;
   }
 
-  /* Event loop for the lock screen. */
+  /*
+   * Event loop for the lock screen. We sleep in poll() on both the X
+   * connection and the internal event queue; worker threads wake us through
+   * the latter without a round-trip to the X server. While the displays are
+   * off nothing is drawn and module ticks are stopped; the first input that
+   * wakes them gets one up-to-date frame. In low-power mode animation is
+   * paused and redraws not caused by input are batched. Control socket
+   * clients and the idle timer (for the suspend timeout) are answered from
+   * here too, between frames.
+   */
+  Display *display = display_config->display;
+  struct pollfd fds[3 + CONTROL_POLL_FDS] = {
+      {.fd = ConnectionNumber(display), .events = POLLIN},
+      {.fd = events_fd(), .events = POLLIN},
+      {.fd = -1, .events = POLLIN}, /* Idle timer, if built in. */
+  };
+#if PROFILE_IDLE
+  fds[2].fd = idle_fd();
+#endif
+  int reload_pending = 0;
+  int wallpaper_pending = 0;
+  /* Only a plain image background can change under the lock. */
+  int live_wallpaper = !blur_background_enabled() && !animation_enabled();
+  int64_t batch_deadline_ns = 0;
+  g_power = (struct DisplayPower){.on = 1, .checked_ns = 0, .deadline_ns = 0};
+  low_power_update();
+  stats_low_power(low_power_active());
+  apply_power_state();
   XEvent event;
   while (atomic_load(&lockscreen_running)) {
-    XNextEvent(display_config->display, &event);
-    switch (event.type) {
+    int redraw = 0;
+    int input = 0;
+    /* The first frame of a lock must cover the whole screen. */
+    int full_repaint = !atomic_load(&lock_presented);
+
+    /*
+     * Handle everything already queued before drawing, so a burst of typing
+     * or autorepeat costs a single repaint.
+     */
+    while (atomic_load(&lockscreen_running) && XPending(display)) {
+      XNextEvent(display, &event);
+      switch (event.type) {
+      case Expose:
+        redraw = 1;
+        full_repaint = 1;
+        break;
+      case KeyPress:
+        handle_keypress(event.xkey);
+        module_invalidate(&password_entry_module);
+        redraw = 1;
+        input = 1;
+        break;
+      case MotionNotify:
+      case ButtonPress:
+        input = 1;
+        break;
+      case MapNotify:
+        window_mapped();
+        break;
+      case VisibilityNotify:
+        handle_visibility(&event.xvisibility);
+        break;
+      default:
+        break;
+      }
+    }
 
-    case ClientMessage:
-      if (event.xclient.message_type == redraw_atom) {
-        draw_graphics();
+    events_clear();
+    enum EventType type;
+    while (event_next(&type)) {
+      if (type == EVENT_REDRAW) {
+        redraw = 1;
+      } else if (type == EVENT_RELOAD) {
+        /* Backgrounds are rebuilt once we are unlocked. */
+        reload_pending = 1;
+      } else if (type == EVENT_WALLPAPER) {
+        wallpaper_pending = 1;
+      } else if (type == EVENT_REFINED) {
+        redraw |= install_refined();
+      } else if (type == EVENT_AUTH && handle_auth_result()) {
+        module_invalidate(&password_entry_module);
+        redraw = 1;
       }
-      break;
-    case Expose:
-      draw_graphics();
-      break;
-    case KeyPress:
-      handle_keypress(event.xkey);
-      draw_graphics();
-      break;
-    default:
+      /* EVENT_LOCK: already locked. EVENT_QUIT: main() exits once unlocked. */
+    }
+
+    /* A timed wallpaper change waits for the lock to be on screen. */
+    if (wallpaper_pending && live_wallpaper && atomic_load(&lock_presented)) {
+      wallpaper_pending = 0;
+      redraw |= slideshow_install();
+    }
+
+    if (!atomic_load(&lockscreen_running)) {
       break;
     }
+    if (update_display_power(input)) {
+      redraw = 1;
+      full_repaint = 1;
+    }
+    if (low_power_update()) {
+      stats_low_power(low_power_active());
+      apply_power_state();
+      redraw = 1;
+    }
+
+    /*
+     * In low-power mode a redraw nobody is waiting on (clock tick, battery
+     * change) is held back briefly, so that those arriving together cost a
+     * single frame and a single flush to the server.
+     */
+    if (batch_deadline_ns != 0) {
+      redraw = 1;
+    }
+    if (redraw && !input && !full_repaint && g_power.on &&
+        low_power_active()) {
+      int64_t now = monotonic_ns();
+      if (batch_deadline_ns == 0) {
+        batch_deadline_ns = now + LOW_POWER_BATCH_NS;
+      }
+      if (now < batch_deadline_ns) {
+        redraw = 0;
+      }
+    }
+    if (redraw) {
+      batch_deadline_ns = 0;
+    }
+
+    /* Nobody can see a frame while the displays are off, except the first. */
+    if (redraw && (g_power.on || !atomic_load(&lock_presented))) {
+      unsigned long first_request = NextRequest(display);
+      draw_graphics(full_repaint);
+      frame_presented();
+      stats_frame(NextRequest(display) - first_request);
+      /* The placeholder is up; the full blur can start in the background. */
+      if (g_coverage.refine) {
+        refine_backgrounds();
+      }
+      /* Drawing may have queued X events; look again before sleeping. */
+      continue;
+    }
+
+    /* XPending() above flushed our requests; now wait for more work. */
+    int control_fds = control_pollfds(fds + 3);
+    if (poll(fds, (nfds_t)(3 + control_fds),
+             loop_timeout_ms(batch_deadline_ns)) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+        break;
+      }
+      continue;
+    }
+    stats_wakeup();
+#if PROFILE_IDLE
+    if (fds[2].revents & POLLIN) {
+      idle_dispatch();
+    }
+#endif
+    control_dispatch(fds + 3, control_fds);
+  }
+  if (reload_pending) {
+    event_post(EVENT_RELOAD);
+  }
+  if (wallpaper_pending) {
+    event_post(EVENT_WALLPAPER);
   }
 
   /* Clean up, unmap, etc. */
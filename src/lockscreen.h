@@ -12,6 +12,7 @@
 #include <X11/Xlib.h>
 #include <cairo/cairo.h>
 #include <stdatomic.h>
+#include <stdint.h>
 
 /* ------------------------------------------------------------------------- */
 /* Structure Definitions                                                     */
@@ -26,10 +27,12 @@ struct ScreenConfig {
     cairo_surface_t *surface;       /**< Main surface for rendering. */
     cairo_t *overlay_buffer;        /**< Overlay buffer for drawing text. */
     cairo_t *background_buffer;     /**< Background buffer for images or colors. */
+    cairo_surface_t *background_picture; /**< Server-side copy of the background. */
     cairo_t *screen_buffer;         /**< Combined buffer for final compositing. */
     cairo_surface_t *off_screen_buffer; /**< Off-screen surface for temporary drawing. */
     int text_color;                 /**< Numeric color value (0-255). */
     cairo_pattern_t *pattern;       /**< Cairo pattern for rendering backgrounds. */
+    int64_t raised_ns;              /**< When the window was last put back on top. */
 };
 
 /**
@@ -63,6 +66,11 @@ extern struct DisplayConfig *display_config;
  */
 extern int current_input_index;
 
+/**
+ * @brief Number of characters (not bytes) typed so far.
+ */
+extern int current_input_chars;
+
 /**
  * @brief Indicates whether the last password attempt was wrong (1) or not (0).
  */
@@ -73,14 +81,22 @@ extern int password_is_wrong;
  */
 extern atomic_int lockscreen_running;
 
+/**
+ * @brief Set once the first frame of the current lock has reached the X
+ *        server, i.e. the desktop is covered. Cleared when a new lock starts.
+ */
+extern atomic_int lock_presented;
+
 extern atomic_int needs_redraw;
-extern Atom redraw_atom;
 
 /* ------------------------------------------------------------------------- */
 /* Function Declarations                                                     */
 /* ------------------------------------------------------------------------- */
 
 int lockscreen(void);
+void lockscreen_prewarm(void);
+void lockscreen_release_prewarm(void);
 void initialize_windows(void);
+void lockscreen_lock_input(void);
 
 #endif /* LOCKSCREEN_H */
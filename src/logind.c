@@ -0,0 +1,284 @@
+/**
+ * @file logind.c
+ * @brief Locks the screen before the system sleeps, whoever triggered it.
+ *
+ * We hold a logind "delay" sleep inhibitor while awake. When logind announces
+ * PrepareForSleep(true) (lid close, power menu, our own suspend request...)
+ * we lock, and only drop the inhibitor once the lock screen's first frame has
+ * reached the X server, so the desktop is never visible on resume. After
+ * resume a new inhibitor is taken and the time until the next locked frame
+ * is reported.
+ *
+ * The watcher thread owns its bus connection and blocks in it between
+ * signals, so suspend requests from other threads go out on a connection of
+ * their own. The system bus comes from DBUS_SYSTEM_BUS_ADDRESS when set, so
+ * a mock logind on a private bus can stand in for the real one.
+ */
+
+#include "logind.h"
+#include "events.h"
+#include "lockscreen.h"
+#include <dbus/dbus.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const char *const LOGIND_SERVICE = "org.freedesktop.login1";
+static const char *const LOGIND_PATH = "/org/freedesktop/login1";
+static const char *const LOGIND_MANAGER = "org.freedesktop.login1.Manager";
+static const int LOGIND_CALL_TIMEOUT_MS = 5000;
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static DBusConnection *g_conn = NULL; /* Watcher thread only. */
+static atomic_int g_inhibitor_fd = -1;
+static atomic_int g_release_pending = 0;
+static _Atomic int64_t g_sleep_start_ns = 0;
+static _Atomic int64_t g_resume_start_ns = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Takes a "delay" sleep inhibitor, replacing any we already hold.
+ */
+static void take_inhibitor(void) {
+  DBusMessage *msg = dbus_message_new_method_call(LOGIND_SERVICE, LOGIND_PATH,
+                                                  LOGIND_MANAGER, "Inhibit");
+  if (!msg) {
+    return;
+  }
+  const char *what = "sleep";
+  const char *who = "minimalist-lockscreen";
+  const char *why = "Lock the screen before suspending";
+  const char *mode = "delay";
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &what, DBUS_TYPE_STRING,
+                           &who, DBUS_TYPE_STRING, &why, DBUS_TYPE_STRING,
+                           &mode, DBUS_TYPE_INVALID);
+
+  DBusError err;
+  dbus_error_init(&err);
+  DBusMessage *reply = dbus_connection_send_with_reply_and_block(
+      g_conn, msg, LOGIND_CALL_TIMEOUT_MS, &err);
+  dbus_message_unref(msg);
+  if (!reply) {
+    fprintf(stderr, "Failed to take sleep inhibitor: %s\n", err.message);
+    dbus_error_free(&err);
+    return;
+  }
+
+  int fd = -1;
+  if (!dbus_message_get_args(reply, &err, DBUS_TYPE_UNIX_FD, &fd,
+                             DBUS_TYPE_INVALID)) {
+    fprintf(stderr, "Unexpected Inhibit reply: %s\n", err.message);
+    dbus_error_free(&err);
+  }
+  dbus_message_unref(reply);
+
+  int old_fd = atomic_exchange(&g_inhibitor_fd, fd);
+  if (old_fd >= 0) {
+    close(old_fd);
+  }
+}
+
+/**
+ * @brief Drops the inhibitor, letting a pending suspend proceed.
+ */
+static void release_inhibitor(void) {
+  int fd = atomic_exchange(&g_inhibitor_fd, -1);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+
+  int64_t start = atomic_exchange(&g_sleep_start_ns, 0);
+  if (start != 0) {
+    printf("Locked before sleep in %.1f ms\n",
+           (double)(monotonic_ns() - start) / 1e6);
+  }
+}
+
+static void handle_prepare_for_sleep(DBusMessage *msg) {
+  dbus_bool_t going_to_sleep = FALSE;
+  if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_BOOLEAN, &going_to_sleep,
+                             DBUS_TYPE_INVALID)) {
+    return;
+  }
+
+  if (!going_to_sleep) {
+    /* Resumed: arm the latency probe and get ready for the next sleep. */
+    if (atomic_load(&lockscreen_running)) {
+      atomic_store(&g_resume_start_ns, monotonic_ns());
+    }
+    take_inhibitor();
+    return;
+  }
+
+  atomic_store(&g_sleep_start_ns, monotonic_ns());
+  /* Set before checking, so logind_frame_presented() cannot miss it. */
+  atomic_store(&g_release_pending, 1);
+
+  if (atomic_load(&lockscreen_running)) {
+    if (atomic_load(&lock_presented)) {
+      atomic_store(&g_release_pending, 0);
+      release_inhibitor();
+    }
+    return;
+  }
+  if (event_post(EVENT_LOCK) != 0) {
+    fprintf(stderr, "Failed to request lock before sleep.\n");
+    atomic_store(&g_release_pending, 0);
+    release_inhibitor();
+  }
+}
+
+/**
+ * @brief Cleanup handler of the watcher: drops the inhibitor and the
+ *        connection, also when main() cancels the thread.
+ */
+static void close_connection(void *arg __attribute__((unused))) {
+  DBusConnection *conn = g_conn;
+  g_conn = NULL;
+  release_inhibitor();
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+}
+
+static DBusHandlerResult message_filter(DBusConnection *conn
+                                        __attribute__((unused)),
+                                        DBusMessage *msg,
+                                        void *data __attribute__((unused))) {
+  if (dbus_message_is_signal(msg, LOGIND_MANAGER, "PrepareForSleep")) {
+    handle_prepare_for_sleep(msg);
+  }
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Called by the lockscreen after each frame reaches the X server.
+ *
+ * Releases the sleep inhibitor if logind is waiting for us, and reports the
+ * resume-to-locked latency after a resume. Cheap enough to call every frame.
+ */
+void logind_frame_presented(void) {
+  if (atomic_exchange(&g_release_pending, 0)) {
+    release_inhibitor();
+  }
+
+  int64_t resumed = atomic_exchange(&g_resume_start_ns, 0);
+  if (resumed != 0) {
+    printf("Resume to locked frame: %.1f ms\n",
+           (double)(monotonic_ns() - resumed) / 1e6);
+  }
+}
+
+/**
+ * @brief Asks logind to suspend the system.
+ *
+ * logind will then send PrepareForSleep, which we answer as for any other
+ * suspend. The call goes out on a short-lived connection of its own, never
+ * on the one the watcher is blocked in, so it is safe from any thread.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int logind_suspend(void) {
+  DBusError err;
+  dbus_error_init(&err);
+  DBusConnection *conn = dbus_bus_get_private(DBUS_BUS_SYSTEM, &err);
+  if (!conn) {
+    fprintf(stderr, "Cannot suspend: %s\n", err.message);
+    dbus_error_free(&err);
+    return -1;
+  }
+  dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+  DBusMessage *reply = NULL;
+  DBusMessage *msg = dbus_message_new_method_call(LOGIND_SERVICE, LOGIND_PATH,
+                                                  LOGIND_MANAGER, "Suspend");
+  if (msg) {
+    dbus_bool_t interactive = FALSE;
+    dbus_message_append_args(msg, DBUS_TYPE_BOOLEAN, &interactive,
+                             DBUS_TYPE_INVALID);
+    reply = dbus_connection_send_with_reply_and_block(
+        conn, msg, LOGIND_CALL_TIMEOUT_MS, &err);
+    dbus_message_unref(msg);
+  }
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+  if (!reply) {
+    fprintf(stderr, "Suspend failed: %s\n",
+            dbus_error_is_set(&err) ? err.message : "out of memory");
+    dbus_error_free(&err);
+    return -1;
+  }
+  dbus_message_unref(reply);
+  return 0;
+}
+
+/**
+ * @brief Thread function that holds the sleep inhibitor and reacts to
+ *        PrepareForSleep.
+ *
+ * Blocks in libdbus between signals; main() cancels it on shutdown. Without
+ * a system bus or logind it just returns and nothing locks before sleep.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+void *logind_watch_loop(void *arg __attribute__((unused))) {
+  DBusError err;
+  dbus_error_init(&err);
+
+  DBusConnection *conn = dbus_bus_get_private(DBUS_BUS_SYSTEM, &err);
+  if (!conn) {
+    fprintf(stderr, "logind integration disabled: %s\n", err.message);
+    dbus_error_free(&err);
+    return NULL;
+  }
+  dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+  dbus_bus_add_match(conn,
+                     "type='signal',sender='org.freedesktop.login1',"
+                     "interface='org.freedesktop.login1.Manager',"
+                     "member='PrepareForSleep',path='/org/freedesktop/login1'",
+                     &err);
+  if (dbus_error_is_set(&err)) {
+    fprintf(stderr, "logind integration disabled: %s\n", err.message);
+    dbus_error_free(&err);
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    return NULL;
+  }
+
+  dbus_connection_add_filter(conn, message_filter, NULL, NULL);
+
+  g_conn = conn;
+  pthread_cleanup_push(close_connection, NULL);
+  take_inhibitor();
+
+  while (dbus_connection_read_write_dispatch(conn, -1)) {
+    /* Everything happens in message_filter(). */
+  }
+  pthread_cleanup_pop(1);
+  return NULL;
+}
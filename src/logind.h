@@ -0,0 +1,18 @@
+#ifndef LOGIND_H
+#define LOGIND_H
+
+/**
+ * @file logind.h
+ * @brief Declarations for the systemd-logind integration (sleep inhibitor,
+ *        PrepareForSleep handling and suspend requests).
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void *logind_watch_loop(void *arg);
+void logind_frame_presented(void);
+int logind_suspend(void);
+
+#endif /* LOGIND_H */
@@ -4,16 +4,26 @@
  */
 
 #include "args.h"
+#include "config.h"
+#include "control.h"
+#include "events.h"
 #include "graphics/graphics.h"
+#include "graphics/slideshow.h"
+#include "idle.h"
 #include "lockscreen.h"
+#include "logind.h"
+#include "mpris.h"
+#include "power.h"
+#include "profile.h"
+#include "residency.h"
+#include "supervisor.h"
 #include <X11/Xlib.h>
-#include <X11/Xmd.h>
-#include <X11/extensions/dpms.h>
-#include <X11/extensions/dpmsconst.h>
-#include <X11/extensions/scrnsaver.h>
 #include <cairo/cairo.h>
+#include <dbus/dbus.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <fontconfig/fontconfig.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
@@ -24,19 +34,13 @@
 /* ------------------------------------------------------------------------- */
 /* Forward Declarations                                                      */
 /* ------------------------------------------------------------------------- */
-static void *screensaver_loop(void *arg);
-static void *sleep_timeout_loop(void *arg);
-static void *update_xscreensaver_info_loop(void *arg);
 static void main_cleanup(int signal);
 static void lockscreen_handler(int signal);
-static int is_player_running(void);
 
 /* Global or shared variables. */
 int lock_screen = 0;
 atomic_int running = 1;
-XScreenSaverInfo *ssi = NULL;
 struct DisplayConfig *display_config = NULL;
-int lockscreen_pipe_fd[2];
 /**
  * @brief Application entry point.
  *
@@ -45,6 +49,14 @@ int lockscreen_pipe_fd[2];
  * @return Zero on success, non-zero otherwise.
  */
 int main(int argc, char *argv[]) {
+  parse_arguments(argc, argv);
+
+  /* "--command <cmd>" talks to a running daemon instead of starting one. */
+  const char *command = retrieve_command_arg("--command");
+  if (command) {
+    return control_send(command);
+  }
+
   /*  Daemonize the process. */
 #ifndef DEBUG
   pid_t pid = fork();
@@ -62,9 +74,22 @@ int main(int argc, char *argv[]) {
   }
 #endif
 
-  /* Allocate XScreenSaverInfo struct and parse command-line arguments. */
-  ssi = XScreenSaverAllocInfo();
-  parse_arguments(argc, argv);
+  load_options();
+  low_power_load_option();
+
+  /*
+   * "--displays :1,:2,..." serves several displays: the supervisor forks one
+   * lockscreen per display and only returns in those children.
+   */
+  const char *displays = retrieve_command_arg("--displays");
+  if (displays && retrieve_command_arg("--socket")) {
+    /* Every child would try to listen on the same path. */
+    fprintf(stderr, "--socket cannot be combined with --displays.\n");
+    return EXIT_FAILURE;
+  }
+  if (displays && run_supervisor(displays) != 0) {
+    return EXIT_FAILURE;
+  }
 
   /* Allocate and initialize DisplayConfig. */
   display_config =
@@ -84,6 +109,9 @@ int main(int argc, char *argv[]) {
   initialize_windows();
   initialize_graphics();
 
+  /* Pin what the lock path needs (if asked to) and watch memory pressure. */
+  residency_init();
+
   /* Set up signal handler for SIGUSR1 */
   struct sigaction sa;
   sa.sa_handler = lockscreen_handler;
@@ -109,42 +137,128 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  /* Query initial screensaver info. */
-  XScreenSaverQueryInfo(display_config->display,
-                        DefaultRootWindow(display_config->display), ssi);
-
-  /* Get current screen saver parameters. */
-  int timeout, interval, prefer_blanking, allow_exposures;
-  XGetScreenSaver(display_config->display, &timeout, &interval,
-                  &prefer_blanking, &allow_exposures);
-
-  /* Create threads for screensaver logic. */
-  pthread_t screensaver_info_thread;
-  pthread_t screensaver_thread;
-  pthread_t sleep_timeout_thread;
-
-  pthread_create(&screensaver_info_thread, NULL, update_xscreensaver_info_loop,
-                 NULL);
-  pthread_create(&screensaver_thread, NULL, screensaver_loop, &timeout);
-  pthread_create(&sleep_timeout_thread, NULL, sleep_timeout_loop, NULL);
+  /* The event queue must exist before any thread can ask for a lock. */
+  if (events_init() != 0) {
+    exit(EXIT_FAILURE);
+  }
+  /*
+   * Without the socket only SIGUSR1 and the idle timeout can lock, but a
+   * path held by another daemon (or anything else) means we should not run.
+   */
+  if (control_init() == CONTROL_PATH_IN_USE) {
+    exit(EXIT_FAILURE);
+  }
+#if PROFILE_IDLE
+  /* Without the timer only explicit requests lock. */
+  idle_init(display_config->display);
+#endif
 
-  if (pipe(lockscreen_pipe_fd) == -1) {
-    perror("Error creating pipe");
+  /* libdbus is used from several threads (logind, MPRIS, suspend calls). */
+  if (!dbus_threads_init_default()) {
+    fprintf(stderr, "Failed to initialize D-Bus threading.\n");
     exit(EXIT_FAILURE);
   }
-  char buffer;
+
+  /* Create the watcher threads. */
+  pthread_t config_thread;
+#if PROFILE_MPRIS
+  pthread_t mpris_thread;
+#endif
+  pthread_t logind_thread;
+
+  pthread_create(&config_thread, NULL, config_watch_loop, NULL);
+#if PROFILE_MPRIS
+  pthread_create(&mpris_thread, NULL, mpris_watch_loop, NULL);
+#endif
+  pthread_create(&logind_thread, NULL, logind_watch_loop, NULL);
+
+  /*
+   * Main thread requests: EVENT_LOCK locks the screen, EVENT_RELOAD rebuilds
+   * the backgrounds after the config file changed, EVENT_PREWARM and
+   * EVENT_COOLDOWN prepare the next lock and release it again, and
+   * EVENT_WALLPAPER shows the next slideshow wallpaper. These touch cairo
+   * state, so they must run here; a reload requested while locked is handed
+   * back by lockscreen() once unlocked. EVENT_QUIT only wakes the loop so it
+   * notices it should exit. Control socket clients and the idle timer are
+   * served here while unlocked and from lockscreen()'s loop while locked.
+   */
+  struct pollfd fds[2 + CONTROL_POLL_FDS] = {
+      {.fd = events_fd(), .events = POLLIN},
+      {.fd = -1, .events = POLLIN}, /* Idle timer, if built in. */
+  };
+#if PROFILE_IDLE
+  fds[1].fd = idle_fd();
+#endif
   while (atomic_load(&running)) {
-    ssize_t bytes_read = read(lockscreen_pipe_fd[0], &buffer, 1);
-    if (bytes_read > 0) {
+    int control_fds = control_pollfds(fds + 2);
+    if (poll(fds, (nfds_t)(2 + control_fds), -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+      }
+      continue;
+    }
+#if PROFILE_IDLE
+    if (fds[1].revents & POLLIN) {
+      idle_dispatch();
+    }
+#endif
+    control_dispatch(fds + 2, control_fds);
+    events_clear();
+    int lock = 0;
+    int reload = 0;
+    int wallpaper = 0;
+    int prewarm = -1; /* The last of EVENT_PREWARM/EVENT_COOLDOWN wins. */
+    enum EventType type;
+    while (event_next(&type)) {
+      lock |= (type == EVENT_LOCK);
+      reload |= (type == EVENT_RELOAD);
+      wallpaper |= (type == EVENT_WALLPAPER);
+      if (type == EVENT_PREWARM || type == EVENT_COOLDOWN) {
+        prewarm = (type == EVENT_PREWARM);
+      }
+    }
+    /* A reload or a wallpaper replaces what a pre-warm may have set up. */
+    if (reload || (wallpaper && !lock) || prewarm == 0) {
+      lockscreen_release_prewarm();
+    }
+    if (reload) {
+      reload_backgrounds();
+    }
+    /* Never in front of a lock; lockscreen() shows it once covered. */
+    if (wallpaper) {
+      if (lock) {
+        event_post(EVENT_WALLPAPER);
+      } else {
+        slideshow_install();
+      }
+    }
+    if (prewarm == 1 && !lock) {
+      lockscreen_prewarm();
+    }
+    if (lock) {
       lockscreen();
+      /* Fails any "lock --wait" if the lock ended before covering. */
+      control_lock_ended();
+#if PROFILE_IDLE
+      /* The idle timer may have been stopped for the lock. */
+      idle_rearm();
+#endif
     }
   }
-  close(lockscreen_pipe_fd[0]);
-  close(lockscreen_pipe_fd[1]);
   /* Wait for threads to end before exiting. */
-  pthread_join(screensaver_info_thread, NULL);
-  pthread_join(screensaver_thread, NULL);
-  pthread_join(sleep_timeout_thread, NULL);
+  pthread_cancel(config_thread);
+  pthread_join(config_thread, NULL);
+#if PROFILE_MPRIS
+  pthread_cancel(mpris_thread);
+  pthread_join(mpris_thread, NULL);
+#endif
+  pthread_cancel(logind_thread);
+  pthread_join(logind_thread, NULL);
+#if PROFILE_IDLE
+  idle_cleanup();
+#endif
+  residency_cleanup();
+  control_cleanup();
 
   /* Clean up shared resources. */
   exit_cleanup();
@@ -154,11 +268,6 @@ int main(int argc, char *argv[]) {
     display_config->screen_info = NULL;
   }
 
-  if (ssi) {
-    XFree(ssi);
-    ssi = NULL;
-  }
-
   XSync(display_config->display, False);
 
   /* Force X to destroy all client resources associated with this process: */
@@ -173,126 +282,31 @@ int main(int argc, char *argv[]) {
   cairo_debug_reset_static_data();
 
   free(display_config);
+  events_cleanup();
 
   return 0;
 }
 
 /**
- * @brief Triggers the lockscreen by writing a character to the pipe.
+ * @brief Triggers the lockscreen by posting EVENT_LOCK to the main thread.
  *
- * This function writes the character 'x' to the write end of the pipe
- * specified by the global variable `pipe_fd`. This action is intended
- * to signal the lockscreen mechanism to activate.
+ * Async-signal-safe, so it can be used from the SIGUSR1 handler.
  */
-static void trigger_lockscreen() { write(lockscreen_pipe_fd[1], "x", 1); }
+static void trigger_lockscreen() { event_post(EVENT_LOCK); }
 
-/**
- * @brief Thread function that checks inactivity and triggers the lock screen.
- *
- * @param arg Expected to be a pointer to an integer containing the timeout (in
- * seconds).
- * @return Always returns NULL.
- */
-static void *screensaver_loop(void *arg) {
-  int timeout = *((int *)arg);
-
-  while (atomic_load(&running)) {
-    BOOL dpms_enabled;
-    CARD16 power_level;
-    DPMSInfo(display_config->display, &power_level, &dpms_enabled);
-
-    /* Wait until idle time exceeds 'timeout' or DPMS is not 'On'. */
-    while (((int)ssi->idle < (timeout * 1000) || dpms_enabled == DPMSModeOn) &&
-           atomic_load(&running)) {
-      DPMSInfo(display_config->display, &power_level, &dpms_enabled);
-      sleep(1);
-    }
-    if (!atomic_load(&running)) {
-      break;
-    }
-
-    /* If the lockscreen is not active, invoke it. */
-    if (!atomic_load(&lockscreen_running)) {
-      trigger_lockscreen();
-    }
-
-    /* Wait until lockscreen stops running. */
-    while (atomic_load(&lockscreen_running) && atomic_load(&running)) {
-      sleep(1);
-    }
-    sleep(1);
-  }
-
-  return NULL;
-}
-
-/**
- * @brief Thread function to manage a user-defined suspend timeout.
- *
- * @param arg Unused parameter.
- * @return Always returns NULL.
- */
-static void *sleep_timeout_loop(void *arg __attribute__((unused))) {
-  while (atomic_load(&running)) {
-    char *suspend_str = retrieve_command_arg("--suspend");
-    if (!suspend_str) {
-      sleep(1);
-      continue;
-    }
-
-    int suspend_sec = atoi(suspend_str);
-    BOOL dpms_enabled;
-    CARD16 power_level;
-    DPMSInfo(display_config->display, &power_level, &dpms_enabled);
-    // Wait until idle time exceeds 'suspend_sec' or DPMS is not 'On' or a media
-    // player is running.
-    while (((int)ssi->idle < (suspend_sec * 1000) ||
-            dpms_enabled == DPMSModeOn || is_player_running()) &&
-           atomic_load(&running)) {
-      sleep(1);
-    }
-    if (!atomic_load(&running)) {
-      break;
-    }
-
-    /* Wait for lockscreen to activate before suspending. */
-    while (!atomic_load(&lockscreen_running) && atomic_load(&running)) {
-      sleep(1);
-    }
-
-    if (atomic_load(&running)) {
-      system("systemctl suspend");
-    }
-
-    while (atomic_load(&lockscreen_running) && atomic_load(&running)) {
-      sleep(1);
-    }
-  }
-  return NULL;
-}
-
-/**
- * @brief Thread function to update XScreenSaver info periodically.
- *
- * @param arg Unused parameter.
- * @return Always returns NULL.
- */
-static void *update_xscreensaver_info_loop(void *arg __attribute__((unused))) {
-  while (atomic_load(&running)) {
-    XScreenSaverQueryInfo(display_config->display,
-                          DefaultRootWindow(display_config->display), ssi);
-    sleep(1);
-  }
-  return NULL;
-}
 
 /**
  * @brief Cleans up when a termination signal is received.
  *
+ * The signal may land on any thread, so the main loop is woken through the
+ * event queue (an eventfd write, async-signal-safe) rather than relying on
+ * its poll() being interrupted.
+ *
  * @param signal The signal number (unused).
  */
 static void main_cleanup(int signal __attribute__((unused))) {
   atomic_store(&running, 0);
+  event_post(EVENT_QUIT);
 }
 
 /**
@@ -305,32 +319,3 @@ static void lockscreen_handler(int signal __attribute__((unused))) {
     trigger_lockscreen();
   }
 }
-
-/**
- * @brief Checks if a media player (via playerctl) is currently in 'Playing'
- * state.
- *
- * @return 1 if a player is running and playing, 0 if not, -1 on error.
- */
-static int is_player_running(void) {
-  const char *command = "playerctl status";
-  char buffer[128] = {0};
-  int status = 0; /* 0 for not playing, 1 if playing */
-
-  FILE *pipe = popen(command, "r");
-  if (!pipe) {
-    fprintf(stderr, "Error executing playerctl command.\n");
-    return -1;
-  }
-
-  /* Read the output and look for "Playing". */
-  while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-    if (strstr(buffer, "Playing") != NULL) {
-      status = 1;
-      break;
-    }
-  }
-  pclose(pipe);
-
-  return status;
-}
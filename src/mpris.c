@@ -0,0 +1,387 @@
+/**
+ * @file mpris.c
+ * @brief Tracks whether any MPRIS media player is playing by listening to
+ *        D-Bus signals on the session bus.
+ *
+ * Instead of asking every player for its status when we need to know, we
+ * read each player's PlaybackStatus once at startup and then keep a cached
+ * flag up to date from PropertiesChanged and NameOwnerChanged signals. The
+ * watcher thread sleeps inside libdbus until a signal arrives, so an idle
+ * session causes no wakeups at all.
+ *
+ * The bus is found through DBUS_SESSION_BUS_ADDRESS as usual, which also
+ * makes it easy to point the watcher at a private dbus-daemon.
+ */
+
+#include "mpris.h"
+#include <dbus/dbus.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define MPRIS_MAX_PLAYERS 32
+#define MPRIS_OWNER_LEN 64
+
+static const char *const MPRIS_PREFIX = "org.mpris.MediaPlayer2.";
+static const char *const MPRIS_PATH = "/org/mpris/MediaPlayer2";
+static const char *const MPRIS_PLAYER_IFACE = "org.mpris.MediaPlayer2.Player";
+static const char *const PROPERTIES_IFACE = "org.freedesktop.DBus.Properties";
+static const char *const PROPERTIES_CHANGED_RULE =
+    "type='signal',interface='org.freedesktop.DBus.Properties',"
+    "member='PropertiesChanged',path='/org/mpris/MediaPlayer2',"
+    "arg0='org.mpris.MediaPlayer2.Player'";
+static const char *const NAME_OWNER_CHANGED_RULE =
+    "type='signal',sender='org.freedesktop.DBus',"
+    "interface='org.freedesktop.DBus',member='NameOwnerChanged',"
+    "arg0namespace='org.mpris.MediaPlayer2'";
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Last known state of one player, keyed by its unique bus name
+ *        (the sender of its signals).
+ */
+struct Player {
+  char owner[MPRIS_OWNER_LEN]; /**< Unique name, e.g. ":1.42". */
+  int playing;                 /**< 1 if PlaybackStatus is "Playing". */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/* Only touched by the watcher thread. */
+static struct Player g_players[MPRIS_MAX_PLAYERS];
+static int g_num_players = 0;
+
+/* Read by other threads. */
+static atomic_int g_any_playing = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static struct Player *find_player(const char *owner) {
+  for (int i = 0; i < g_num_players; i++) {
+    if (strcmp(g_players[i].owner, owner) == 0) {
+      return &g_players[i];
+    }
+  }
+  return NULL;
+}
+
+static void refresh_any_playing(void) {
+  int playing = 0;
+  for (int i = 0; i < g_num_players; i++) {
+    playing |= g_players[i].playing;
+  }
+  atomic_store(&g_any_playing, playing);
+}
+
+static void set_player_state(const char *owner, int playing) {
+  struct Player *player = find_player(owner);
+  if (!player) {
+    if (g_num_players == MPRIS_MAX_PLAYERS ||
+        strlen(owner) >= MPRIS_OWNER_LEN) {
+      return;
+    }
+    player = &g_players[g_num_players++];
+    strcpy(player->owner, owner);
+  }
+  player->playing = playing;
+  refresh_any_playing();
+}
+
+static void remove_player(const char *owner) {
+  struct Player *player = find_player(owner);
+  if (!player) {
+    return;
+  }
+  *player = g_players[--g_num_players];
+  refresh_any_playing();
+}
+
+/**
+ * @brief Reads "PlaybackStatus" out of a variant.
+ *
+ * @return 1 for "Playing", 0 for anything else.
+ */
+static int status_is_playing(DBusMessageIter *variant) {
+  if (dbus_message_iter_get_arg_type(variant) != DBUS_TYPE_VARIANT) {
+    return 0;
+  }
+  DBusMessageIter value;
+  dbus_message_iter_recurse(variant, &value);
+  if (dbus_message_iter_get_arg_type(&value) != DBUS_TYPE_STRING) {
+    return 0;
+  }
+  const char *status = NULL;
+  dbus_message_iter_get_basic(&value, &status);
+  return status && strcmp(status, "Playing") == 0;
+}
+
+/**
+ * @brief Asks one player for its current PlaybackStatus (blocking call).
+ *
+ * Only used when a player first appears or invalidates the property.
+ */
+static void query_player(DBusConnection *conn, const char *owner) {
+  DBusMessage *msg = dbus_message_new_method_call(owner, MPRIS_PATH,
+                                                  PROPERTIES_IFACE, "Get");
+  if (!msg) {
+    return;
+  }
+  const char *property = "PlaybackStatus";
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &MPRIS_PLAYER_IFACE,
+                           DBUS_TYPE_STRING, &property, DBUS_TYPE_INVALID);
+
+  DBusError err;
+  dbus_error_init(&err);
+  DBusMessage *reply =
+      dbus_connection_send_with_reply_and_block(conn, msg, 1000, &err);
+  dbus_message_unref(msg);
+  if (!reply) {
+    dbus_error_free(&err);
+    return;
+  }
+
+  DBusMessageIter iter;
+  if (dbus_message_iter_init(reply, &iter)) {
+    set_player_state(owner, status_is_playing(&iter));
+  }
+  dbus_message_unref(reply);
+}
+
+/**
+ * @brief Looks up the unique owner of a well-known name (blocking call).
+ *
+ * @return 0 on success, -1 if the name has no owner.
+ */
+static int get_name_owner(DBusConnection *conn, const char *name,
+                          char owner[MPRIS_OWNER_LEN]) {
+  DBusMessage *msg = dbus_message_new_method_call(
+      DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "GetNameOwner");
+  if (!msg) {
+    return -1;
+  }
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+
+  DBusError err;
+  dbus_error_init(&err);
+  DBusMessage *reply =
+      dbus_connection_send_with_reply_and_block(conn, msg, 1000, &err);
+  dbus_message_unref(msg);
+  if (!reply) {
+    dbus_error_free(&err);
+    return -1;
+  }
+
+  const char *unique = NULL;
+  int result = -1;
+  if (dbus_message_get_args(reply, &err, DBUS_TYPE_STRING, &unique,
+                            DBUS_TYPE_INVALID) &&
+      strlen(unique) < MPRIS_OWNER_LEN) {
+    strcpy(owner, unique);
+    result = 0;
+  }
+  dbus_error_free(&err);
+  dbus_message_unref(reply);
+  return result;
+}
+
+/**
+ * @brief Reads the status of every player already on the bus.
+ */
+static void scan_existing_players(DBusConnection *conn) {
+  DBusMessage *msg = dbus_message_new_method_call(
+      DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "ListNames");
+  if (!msg) {
+    return;
+  }
+
+  DBusError err;
+  dbus_error_init(&err);
+  DBusMessage *reply =
+      dbus_connection_send_with_reply_and_block(conn, msg, 1000, &err);
+  dbus_message_unref(msg);
+  if (!reply) {
+    dbus_error_free(&err);
+    return;
+  }
+
+  DBusMessageIter iter;
+  DBusMessageIter names;
+  if (dbus_message_iter_init(reply, &iter) &&
+      dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+    dbus_message_iter_recurse(&iter, &names);
+    while (dbus_message_iter_get_arg_type(&names) == DBUS_TYPE_STRING) {
+      const char *name = NULL;
+      dbus_message_iter_get_basic(&names, &name);
+      char owner[MPRIS_OWNER_LEN];
+      if (strncmp(name, MPRIS_PREFIX, strlen(MPRIS_PREFIX)) == 0 &&
+          get_name_owner(conn, name, owner) == 0) {
+        query_player(conn, owner);
+      }
+      dbus_message_iter_next(&names);
+    }
+  }
+  dbus_message_unref(reply);
+}
+
+/**
+ * @brief Handles PropertiesChanged(interface, changed, invalidated).
+ */
+static void handle_properties_changed(DBusConnection *conn, DBusMessage *msg) {
+  const char *sender = dbus_message_get_sender(msg);
+  DBusMessageIter iter;
+  if (!sender || !dbus_message_iter_init(msg, &iter)) {
+    return;
+  }
+
+  /* Skip the interface name; the match rule already filtered it. */
+  if (!dbus_message_iter_next(&iter) ||
+      dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
+    return;
+  }
+
+  DBusMessageIter changed;
+  dbus_message_iter_recurse(&iter, &changed);
+  while (dbus_message_iter_get_arg_type(&changed) == DBUS_TYPE_DICT_ENTRY) {
+    DBusMessageIter entry;
+    const char *key = NULL;
+    dbus_message_iter_recurse(&changed, &entry);
+    dbus_message_iter_get_basic(&entry, &key);
+    if (key && strcmp(key, "PlaybackStatus") == 0) {
+      dbus_message_iter_next(&entry);
+      set_player_state(sender, status_is_playing(&entry));
+      return;
+    }
+    dbus_message_iter_next(&changed);
+  }
+
+  /* The player may only tell us the property changed, without a value. */
+  if (dbus_message_iter_next(&iter) &&
+      dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+    DBusMessageIter invalidated;
+    dbus_message_iter_recurse(&iter, &invalidated);
+    while (dbus_message_iter_get_arg_type(&invalidated) == DBUS_TYPE_STRING) {
+      const char *key = NULL;
+      dbus_message_iter_get_basic(&invalidated, &key);
+      if (key && strcmp(key, "PlaybackStatus") == 0) {
+        query_player(conn, sender);
+        return;
+      }
+      dbus_message_iter_next(&invalidated);
+    }
+  }
+}
+
+/**
+ * @brief Handles NameOwnerChanged(name, old_owner, new_owner) for players.
+ */
+static void handle_name_owner_changed(DBusConnection *conn, DBusMessage *msg) {
+  const char *name = NULL;
+  const char *old_owner = NULL;
+  const char *new_owner = NULL;
+  if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name,
+                             DBUS_TYPE_STRING, &old_owner, DBUS_TYPE_STRING,
+                             &new_owner, DBUS_TYPE_INVALID)) {
+    return;
+  }
+  if (strncmp(name, MPRIS_PREFIX, strlen(MPRIS_PREFIX)) != 0) {
+    return;
+  }
+  if (old_owner[0] != '\0') {
+    remove_player(old_owner);
+  }
+  if (new_owner[0] != '\0') {
+    query_player(conn, new_owner);
+  }
+}
+
+/**
+ * @brief Subscribes the connection to the signals matching a rule.
+ *
+ * @return 0 on success, -1 (reported) on failure.
+ */
+static int add_match(DBusConnection *conn, const char *rule) {
+  DBusError err;
+  dbus_error_init(&err);
+  dbus_bus_add_match(conn, rule, &err);
+  if (dbus_error_is_set(&err)) {
+    fprintf(stderr, "MPRIS watcher disabled: %s\n", err.message);
+    dbus_error_free(&err);
+    return -1;
+  }
+  return 0;
+}
+
+static DBusHandlerResult message_filter(DBusConnection *conn, DBusMessage *msg,
+                                        void *data __attribute__((unused))) {
+  if (dbus_message_is_signal(msg, PROPERTIES_IFACE, "PropertiesChanged")) {
+    handle_properties_changed(conn, msg);
+  } else if (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS,
+                                    "NameOwnerChanged")) {
+    handle_name_owner_changed(conn, msg);
+  }
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Returns the cached "any player is playing" flag.
+ *
+ * @return 1 if at least one MPRIS player reports "Playing", 0 otherwise.
+ */
+int mpris_player_playing(void) { return atomic_load(&g_any_playing); }
+
+/**
+ * @brief Thread function that keeps the playing flag up to date.
+ *
+ * Blocks in libdbus until a signal arrives; main() cancels it on shutdown.
+ * If there is no session bus the flag simply stays 0.
+ *
+ * @param arg Unused parameter.
+ * @return Always returns NULL.
+ */
+void *mpris_watch_loop(void *arg __attribute__((unused))) {
+  DBusError err;
+  dbus_error_init(&err);
+
+  DBusConnection *conn = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+  if (!conn) {
+    fprintf(stderr, "MPRIS watcher disabled: %s\n", err.message);
+    dbus_error_free(&err);
+    return NULL;
+  }
+  dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+  /* Subscribe before scanning so no change can slip in between. */
+  if (add_match(conn, PROPERTIES_CHANGED_RULE) != 0 ||
+      add_match(conn, NAME_OWNER_CHANGED_RULE) != 0) {
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    return NULL;
+  }
+  dbus_connection_add_filter(conn, message_filter, NULL, NULL);
+
+  scan_existing_players(conn);
+
+  while (dbus_connection_read_write_dispatch(conn, -1)) {
+    /* Everything happens in message_filter(). */
+  }
+
+  atomic_store(&g_any_playing, 0);
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+  return NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef MPRIS_H
+#define MPRIS_H
+
+/**
+ * @file mpris.h
+ * @brief Declarations for the MPRIS media-player watcher.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void *mpris_watch_loop(void *arg);
+int mpris_player_playing(void);
+
+#endif /* MPRIS_H */
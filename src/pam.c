@@ -11,6 +11,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * @brief What the conversation function answers with.
+ */
+struct Conversation {
+  const char *password;
+  const atomic_int *cancel; /**< Abort the conversation once set. */
+};
+
 /* Forward declaration of the conversation function. */
 static int converse(int num_msg, const struct pam_message **msg,
                     struct pam_response **resp, void *appdata_ptr);
@@ -18,19 +26,34 @@ static int converse(int num_msg, const struct pam_message **msg,
 /**
  * @brief Authenticates a user via PAM.
  *
+ * @param service The PAM service to use (e.g. "login").
+ * @param confdir Directory holding the service file, or NULL for the system
+ *        configuration (/etc/pam.d). Used by the benchmarks to run against a
+ *        mock module.
  * @param password The user's password.
  * @param username The user's username.
+ * @param cancel If not NULL, the attempt is abandoned once this is set: the
+ *        next conversation call fails, which makes the module give up.
  * @return 0 on successful authentication, 1 on failure.
  */
-int auth_pam(const char *password, const char *username) {
-  const char *service_name = "login"; /* PAM service name. */
-
-  struct pam_conv conv = {.conv = converse, .appdata_ptr = (void *)password};
+int auth_pam(const char *service, const char *confdir, const char *password,
+             const char *username, const atomic_int *cancel) {
+  struct Conversation conversation = {.password = password, .cancel = cancel};
+  struct pam_conv conv = {.conv = converse, .appdata_ptr = &conversation};
   pam_handle_t *pamh = NULL;
   int ret;
 
   /* Start a PAM session. */
-  ret = pam_start(service_name, username, &conv, &pamh);
+#ifdef HAVE_PAM_START_CONFDIR
+  ret = pam_start_confdir(service, username, &conv, confdir, &pamh);
+#else
+  if (confdir) {
+    fprintf(stderr, "This PAM library cannot load services from %s.\n",
+            confdir);
+    return 1;
+  }
+  ret = pam_start(service, username, &conv, &pamh);
+#endif
   if (ret != PAM_SUCCESS) {
     fprintf(stderr, "pam_start failed: %s\n", pam_strerror(pamh, ret));
     return 1;
@@ -38,7 +61,10 @@ int auth_pam(const char *password, const char *username) {
 
   /* Attempt to authenticate the user. */
   ret = pam_authenticate(pamh, 0);
-  if (ret == PAM_SUCCESS) {
+  if (cancel && atomic_load(cancel)) {
+    /* Another service already decided; don't report this one. */
+    ret = (ret == PAM_SUCCESS) ? PAM_ABORT : ret;
+  } else if (ret == PAM_SUCCESS) {
     printf("Authentication successful!\n");
   } else {
     fprintf(stderr, "Authentication failed: %s\n", pam_strerror(pamh, ret));
@@ -54,18 +80,26 @@ int auth_pam(const char *password, const char *username) {
  * @brief Conducts the conversation between the PAM module and the application.
  *
  * This function responds to the module's prompts with the provided password,
- * and prints or logs any informational or error messages.
+ * and prints or logs any informational or error messages. Once the attempt
+ * is cancelled it refuses to answer.
  *
  * @param num_msg The number of messages in the conversation.
  * @param msg An array of pointers to PAM message structures.
  * @param resp A pointer to an array of PAM response structures.
- * @param appdata_ptr Custom data provided by the application (the password).
+ * @param appdata_ptr The struct Conversation of this attempt.
  * @return PAM_SUCCESS on success, or an appropriate error code otherwise.
  */
 static int converse(int num_msg, const struct pam_message **msg,
                     struct pam_response **resp, void *appdata_ptr) {
-  const char *password = (const char *)appdata_ptr;
-  *resp = (struct pam_response *)malloc(num_msg * sizeof(struct pam_response));
+  const struct Conversation *conversation =
+      (const struct Conversation *)appdata_ptr;
+  if (conversation->cancel && atomic_load(conversation->cancel)) {
+    *resp = NULL;
+    return PAM_CONV_ERR;
+  }
+  const char *password = conversation->password;
+  *resp = (struct pam_response *)calloc((size_t)num_msg,
+                                        sizeof(struct pam_response));
   if (*resp == NULL) {
     return PAM_BUF_ERR;
   }
@@ -95,6 +129,13 @@ static int converse(int num_msg, const struct pam_message **msg,
       break;
 
     default:
+      /* Don't leave copies of the password behind. */
+      for (int j = 0; j < i; ++j) {
+        if ((*resp)[j].resp) {
+          explicit_bzero((*resp)[j].resp, strlen((*resp)[j].resp));
+          free((*resp)[j].resp);
+        }
+      }
       free(*resp);
       *resp = NULL;
       return PAM_CONV_ERR;
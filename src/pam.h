@@ -6,10 +6,13 @@
  * @brief Declarations for PAM authentication functions.
  */
 
+#include <stdatomic.h>
+
 /* ------------------------------------------------------------------------- */
 /* Function Declarations                                                     */
 /* ------------------------------------------------------------------------- */
 
-int auth_pam(const char *password, const char *username);
+int auth_pam(const char *service, const char *confdir, const char *password,
+             const char *username, const atomic_int *cancel);
 
 #endif /* PAM_H */
@@ -0,0 +1,74 @@
+/**
+ * @file power.c
+ * @brief Decides whether the lockscreen renders in its low-power mode:
+ *        always, never, or (by default) only while running off the battery.
+ *
+ * In low-power mode module ticks may fire late so their timers coalesce,
+ * animations are paused, the password entry skips its most expensive
+ * antialiasing, and redraws nobody is waiting on are batched.
+ */
+
+#include "power.h"
+#include "config.h"
+#include "graphics/modules/battery.h"
+#include "profile.h"
+#include <stdatomic.h>
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/* Written by the main thread, read from render callbacks. */
+static atomic_int g_low_power = 0;
+/* The "powersave" option, written by whichever thread loaded it. */
+static atomic_int g_powersave = POWERSAVE_AUTO;
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Picks up the "powersave" option. Call after the options are
+ *        (re)loaded; safe from any thread.
+ */
+void low_power_load_option(void) {
+  struct Options options;
+  get_options(&options);
+  atomic_store(&g_powersave, (int)options.powersave);
+}
+
+/**
+ * @brief Re-evaluates the "powersave" option against the current power
+ *        supply state. Main thread only; cheap enough to call on every
+ *        wakeup.
+ *
+ * @return 1 if the mode just changed, 0 otherwise.
+ */
+int low_power_update(void) {
+  int low;
+  switch (atomic_load(&g_powersave)) {
+  case POWERSAVE_ON:
+    low = 1;
+    break;
+  case POWERSAVE_OFF:
+    low = 0;
+    break;
+  default:
+#if PROFILE_MODULE_BATTERY
+    low = battery_discharging();
+#else
+    /* Without the battery module there is nobody to ask. */
+    low = 0;
+#endif
+    break;
+  }
+  return atomic_exchange(&g_low_power, low) != low;
+}
+
+/**
+ * @brief Reports whether the low-power mode is in effect, as of the last
+ *        low_power_update(). Safe to call from any thread.
+ *
+ * @return 1 if in low-power mode, 0 otherwise.
+ */
+int low_power_active(void) { return atomic_load(&g_low_power); }
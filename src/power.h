@@ -0,0 +1,17 @@
+#ifndef POWER_H
+#define POWER_H
+
+/**
+ * @file power.h
+ * @brief Declarations for the low-power rendering mode switch.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void low_power_load_option(void);
+int low_power_update(void);
+int low_power_active(void);
+
+#endif /* POWER_H */
@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/**
+ * @file profile.h
+ * @brief Build-time feature switches and defaults.
+ *
+ * A normal build has every feature and reads its options at runtime. With
+ * -DMINIMALIST_LOCKSCREEN_STATIC_PROFILE=ON, CMake generates
+ * static_profile.h from static_profile.h.in instead: the defaults below are
+ * replaced by the values chosen at configure time, there is no config file,
+ * and the features switched off are compiled out along with their
+ * libraries.
+ */
+
+#ifdef LOCKSCREEN_STATIC_PROFILE
+#include "static_profile.h"
+#else
+#define PROFILE_STATIC 0
+#define PROFILE_IMAGE ""
+#define PROFILE_COLOR ""
+#define PROFILE_SUSPEND 0
+#define PROFILE_FONT "JetBrainsMono NF"
+#define PROFILE_MODULE_DATE 1    /* Clock and date. */
+#define PROFILE_MODULE_BATTERY 1 /* Battery level (and auto power saving). */
+#define PROFILE_XINERAMA 1       /* One lock window per monitor. */
+#define PROFILE_IDLE 1           /* Lock and suspend on idle (XScreenSaver). */
+#define PROFILE_MPRIS 1          /* Don't suspend while media plays. */
+#endif
+
+#endif /* PROFILE_H */
@@ -0,0 +1,243 @@
+/**
+ * @file residency.c
+ * @brief Keeps the lock path resident in memory on loaded machines and
+ *        watches memory pressure.
+ *
+ * With the "mlock" option the whole client process (its code and libraries,
+ * heap, thread stacks and the password buffers) is locked into RAM once it
+ * has been set up, and the main thread's stack is prefaulted, so that
+ * locking or typing on a swapping machine never waits on page-ins. The
+ * backgrounds and glyphs live in the X server (pixmaps and glyph sets), so
+ * they are not covered; keeping those resident is up to the server. Turning the option on or off in
+ * the config file locks or unlocks the process on reload. Independently, a
+ * PSI trigger on /proc/pressure/memory counts memory stalls so they can be
+ * reported along with the major faults taken while locked (see stats.c).
+ */
+
+#include "residency.h"
+#include "auth.h"
+#include "config.h"
+#include "lockscreen.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const char *const PSI_MEMORY_PATH = "/proc/pressure/memory";
+/*
+ * Fire when tasks stalled on memory for 200 ms within a 2 s window. Windows
+ * must be a multiple of 2 s for unprivileged triggers.
+ */
+static const char PSI_TRIGGER[] = "some 200000 2000000";
+/* Main-thread stack the lock path may use, faulted in (and locked) ahead. */
+#define PREFAULT_STACK_BYTES (256 * 1024)
+static const size_t PAGE_STRIDE = 4096;
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static pthread_t g_pressure_thread;
+static int g_pressure_started = 0;
+static atomic_int g_memory_locked = 0;
+static atomic_long g_pressure_events = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Touches the next PREFAULT_STACK_BYTES of the calling thread's
+ *        stack, so later calls this deep do not fault.
+ */
+static void __attribute__((noinline)) prefault_stack(void) {
+  volatile unsigned char stack[PREFAULT_STACK_BYTES];
+  for (size_t i = 0; i < sizeof(stack); i += PAGE_STRIDE) {
+    stack[i] = 0;
+  }
+}
+
+/**
+ * @brief Reports how much memory ended up locked, from /proc/self/status.
+ */
+static void print_locked_memory(void) {
+  FILE *file = fopen("/proc/self/status", "r");
+  if (!file) {
+    return;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    long kib;
+    if (sscanf(line, "VmLck: %ld kB", &kib) == 1) {
+      printf("Locked %.1f MiB of the lockscreen in memory.\n", kib / 1024.0);
+      fflush(stdout);
+      break;
+    }
+  }
+  fclose(file);
+}
+
+/**
+ * @brief Warns that the process could not be locked and why.
+ */
+static void warn_lock_failed(void) {
+  struct rlimit limit;
+  int err = errno;
+  getrlimit(RLIMIT_MEMLOCK, &limit);
+  fprintf(stderr,
+          "Warning: mlockall failed (%s); RLIMIT_MEMLOCK is %llu KiB. "
+          "Raise it (e.g. LimitMEMLOCK= or limits.conf) to use --mlock.\n",
+          strerror(err), (unsigned long long)limit.rlim_cur / 1024);
+}
+
+/**
+ * @brief Faults in and locks every current mapping, then locks future ones
+ *        as they are touched.
+ *
+ * MCL_ONFAULT applies to MCL_CURRENT as well, so the current mappings are
+ * locked (and faulted in) by a plain MCL_CURRENT call first. The second call
+ * adds MCL_FUTURE with MCL_ONFAULT, so that new thread stacks are not pinned
+ * whole up front; kernels before 4.4 lack MCL_ONFAULT and only get the first.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int lock_memory(void) {
+  if (mlockall(MCL_CURRENT) != 0) {
+    warn_lock_failed();
+    return -1;
+  }
+  if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0 &&
+      errno != EINVAL) {
+    warn_lock_failed();
+  }
+  atomic_store(&g_memory_locked, 1);
+  return 0;
+}
+
+static void close_fd(void *arg) { close(*(int *)arg); }
+
+/**
+ * @brief Thread function that counts PSI memory pressure events.
+ *
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+static void *pressure_watch_loop(void *arg __attribute__((unused))) {
+  int fd = open(PSI_MEMORY_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    /* No PSI (CONFIG_PSI=n or psi=0): nothing to watch. */
+    return NULL;
+  }
+  if (write(fd, PSI_TRIGGER, sizeof(PSI_TRIGGER)) < 0) {
+    fprintf(stderr, "Warning: cannot set a PSI memory trigger: %s\n",
+            strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  pthread_cleanup_push(close_fd, &fd);
+  struct pollfd pfd = {.fd = fd, .events = POLLPRI};
+  for (;;) {
+    /* poll() is a cancellation point; residency_cleanup() cancels us. */
+    if (poll(&pfd, 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (pfd.revents & POLLERR) {
+      break;
+    }
+    if (pfd.revents & POLLPRI) {
+      atomic_fetch_add(&g_pressure_events, 1);
+    }
+  }
+  pthread_cleanup_pop(1);
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Locks the process into memory if the "mlock" option is set, and
+ *        starts the memory pressure watcher.
+ *
+ * Call once the lockscreen is set up, so its allocations are faulted in.
+ */
+void residency_init(void) {
+  struct Options options;
+  get_options(&options);
+  if (options.mlock && lock_memory() == 0) {
+    prefault_stack();
+    print_locked_memory();
+  }
+
+  if (pthread_create(&g_pressure_thread, NULL, pressure_watch_loop, NULL) ==
+      0) {
+    g_pressure_started = 1;
+  }
+}
+
+/**
+ * @brief Follows a reloaded "mlock" option: locks the process into memory
+ *        when it was turned on, and unlocks it when it was turned off.
+ *
+ * Only the startup path prefaults the main thread's stack (a pre-warm does
+ * it again, see residency_prefault()), so this may run on the config
+ * watcher's thread.
+ */
+void residency_reload(void) {
+  struct Options options;
+  get_options(&options);
+  if (options.mlock && !atomic_load(&g_memory_locked)) {
+    if (lock_memory() == 0) {
+      print_locked_memory();
+    }
+  } else if (!options.mlock && atomic_load(&g_memory_locked)) {
+    if (munlockall() != 0) {
+      perror("munlockall");
+      return;
+    }
+    /* munlockall() also dropped the password buffers' own locks. */
+    lockscreen_lock_input();
+    auth_relock();
+    atomic_store(&g_memory_locked, 0);
+    printf("Unlocked the lockscreen from memory.\n");
+    fflush(stdout);
+  }
+}
+
+/**
+ * @brief Faults in the stack the lock path is about to use, e.g. when a lock
+ *        is expected soon. Main thread only.
+ */
+void residency_prefault(void) { prefault_stack(); }
+
+/**
+ * @brief Stops the memory pressure watcher.
+ */
+void residency_cleanup(void) {
+  if (g_pressure_started) {
+    pthread_cancel(g_pressure_thread);
+    pthread_join(g_pressure_thread, NULL);
+    g_pressure_started = 0;
+  }
+}
+
+/**
+ * @brief Number of memory pressure events seen so far. Safe to call from
+ *        any thread.
+ */
+long residency_pressure_events(void) { return atomic_load(&g_pressure_events); }
@@ -0,0 +1,20 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+/**
+ * @file residency.h
+ * @brief Declarations for keeping the lock path resident in memory and
+ *        watching memory pressure.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void residency_init(void);
+void residency_reload(void);
+void residency_cleanup(void);
+void residency_prefault(void);
+long residency_pressure_events(void);
+
+#endif /* RESIDENCY_H */
@@ -0,0 +1,285 @@
+/**
+ * @file stats.c
+ * @brief Counts main-loop wakeups, frames and CPU time while locked, split
+ *        by whether the displays were on, and prints them on unlock.
+ *
+ * The totals (wakeups per minute, CPU time spent locked, time in low-power
+ * mode) are meant for comparing battery impact across machines. Major page
+ * faults and memory pressure events show whether locking or unlocking had
+ * to wait on swap. The exposed interval is how long the desktop stayed
+ * visible after the lock was requested.
+ */
+
+#include "stats.h"
+#include "residency.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Totals for one display power state.
+ */
+struct PowerBucket {
+  int64_t wall_ns;
+  int64_t cpu_ns;
+  long wakeups;
+  long frames;
+  unsigned long x_requests;
+};
+
+static struct PowerBucket g_buckets[2]; /* [0] = displays off, [1] = on. */
+static int g_displays_on = 1;
+static int g_locked = 0;
+static int g_low_power = 0;
+static int64_t g_low_power_ns = 0;
+static int64_t g_since_wall_ns = 0;
+static int64_t g_since_cpu_ns = 0;
+/* Lock start until every screen was covered, or -1 if not yet. */
+static int64_t g_exposed_ns = -1;
+/* Lock start until the full-quality background was shown, or -1. */
+static int64_t g_refined_ns = -1;
+
+/**
+ * @brief Major page faults (pages read back from disk or swap) on the lock
+ *        path.
+ */
+struct FaultCounts {
+  long at_start;           /**< Process total when the lock started. */
+  long to_cover;           /**< Taken until the first frame was shown. */
+  long auth;               /**< Taken while authenticating. */
+  long auth_started;       /**< Process total when this attempt began. */
+  int64_t auth_ns;         /**< Time spent authenticating. */
+  int64_t auth_started_ns; /**< When this attempt began. */
+  int attempts;            /**< Authentication attempts. */
+  long pressure_at_start;  /**< PSI events seen before the lock. */
+};
+static struct FaultCounts g_faults;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long major_faults(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_majflt;
+}
+
+/**
+ * @brief Charges the time since the last call to the current bucket.
+ */
+static void account(void) {
+  int64_t wall = clock_ns(CLOCK_MONOTONIC);
+  int64_t cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  g_buckets[g_displays_on].wall_ns += wall - g_since_wall_ns;
+  if (g_low_power) {
+    g_low_power_ns += wall - g_since_wall_ns;
+  }
+  g_buckets[g_displays_on].cpu_ns += cpu - g_since_cpu_ns;
+  g_since_wall_ns = wall;
+  g_since_cpu_ns = cpu;
+}
+
+static void print_bucket(const char *label, const struct PowerBucket *bucket) {
+  if (bucket->wall_ns <= 0) {
+    return;
+  }
+  double minutes = (double)bucket->wall_ns / 6e10;
+  double requests_per_frame =
+      bucket->frames ? (double)bucket->x_requests / bucket->frames : 0.0;
+  printf("  displays %-3s %7.1f min: %ld wakeups (%.2f/min), %ld frames "
+         "(%.1f X requests each), CPU %.3f s (%.3f s/h)\n",
+         label, minutes, bucket->wakeups, (double)bucket->wakeups / minutes,
+         bucket->frames, requests_per_frame, (double)bucket->cpu_ns / 1e9,
+         (double)bucket->cpu_ns / 1e9 / (minutes / 60.0));
+}
+
+static void print_totals(void) {
+  struct PowerBucket total = {0, 0, 0, 0, 0};
+  for (int i = 0; i < 2; i++) {
+    total.wall_ns += g_buckets[i].wall_ns;
+    total.cpu_ns += g_buckets[i].cpu_ns;
+    total.wakeups += g_buckets[i].wakeups;
+  }
+  if (total.wall_ns <= 0) {
+    return;
+  }
+  double minutes = (double)total.wall_ns / 6e10;
+  printf("  total        %7.1f min: %.2f wakeups/min, CPU %.3f s locked "
+         "(%.3f%%), low power for %.1f min\n",
+         minutes, (double)total.wakeups / minutes, (double)total.cpu_ns / 1e9,
+         100.0 * (double)total.cpu_ns / (double)total.wall_ns,
+         (double)g_low_power_ns / 6e10);
+}
+
+static void print_coverage(void) {
+  if (g_exposed_ns < 0) {
+    return;
+  }
+  printf("  desktop exposed for %.1f ms", (double)g_exposed_ns / 1e6);
+  if (g_refined_ns >= 0) {
+    printf(", full-quality background after %.1f ms",
+           (double)g_refined_ns / 1e6);
+  }
+  printf("\n");
+}
+
+static void print_faults(void) {
+  printf("  major faults: %ld until covered, %ld in %d authentication(s) "
+         "(%.1f ms), %ld in total; %ld memory pressure event(s)\n",
+         g_faults.to_cover, g_faults.auth, g_faults.attempts,
+         (double)g_faults.auth_ns / 1e6, major_faults() - g_faults.at_start,
+         residency_pressure_events() - g_faults.pressure_at_start);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Resets the counters at the start of a lock.
+ */
+void stats_lock_start(void) {
+  g_buckets[0] = (struct PowerBucket){0, 0, 0, 0, 0};
+  g_buckets[1] = (struct PowerBucket){0, 0, 0, 0, 0};
+  g_displays_on = 1;
+  g_low_power_ns = 0;
+  g_exposed_ns = -1;
+  g_refined_ns = -1;
+  g_faults = (struct FaultCounts){0};
+  g_faults.at_start = major_faults();
+  g_faults.pressure_at_start = residency_pressure_events();
+  g_since_wall_ns = clock_ns(CLOCK_MONOTONIC);
+  g_since_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  g_locked = 1;
+}
+
+/**
+ * @brief Counts one return from the main loop's poll().
+ */
+void stats_wakeup(void) { g_buckets[g_displays_on].wakeups++; }
+
+/**
+ * @brief Counts one frame drawn.
+ *
+ * @param x_requests Number of X requests the frame took.
+ */
+void stats_frame(unsigned long x_requests) {
+  g_buckets[g_displays_on].frames++;
+  g_buckets[g_displays_on].x_requests += x_requests;
+}
+
+/**
+ * @brief Records a display power transition.
+ *
+ * @param on Non-zero if the displays are now on.
+ */
+void stats_display_power(int on) {
+  account();
+  g_displays_on = on ? 1 : 0;
+}
+
+/**
+ * @brief Records entering or leaving the low-power mode.
+ *
+ * @param low_power Non-zero if the low-power mode is now in effect.
+ */
+void stats_low_power(int low_power) {
+  account();
+  g_low_power = low_power;
+}
+
+/**
+ * @brief Records that the first frame of the lock reached the screen.
+ */
+void stats_lock_presented(void) {
+  g_faults.to_cover = major_faults() - g_faults.at_start;
+}
+
+/**
+ * @brief Records how long the desktop stayed exposed: from the start of the
+ *        lock until every window was mapped and had a frame.
+ *
+ * @param exposed_ns The exposed interval.
+ */
+void stats_lock_covered(int64_t exposed_ns) { g_exposed_ns = exposed_ns; }
+
+/**
+ * @brief Records when a progressive lock's placeholder was replaced by the
+ *        full-quality background.
+ *
+ * @param refined_ns Time since the start of the lock.
+ */
+void stats_background_refined(int64_t refined_ns) {
+  g_refined_ns = refined_ns;
+}
+
+/**
+ * @brief Marks the start of an authentication attempt.
+ */
+void stats_auth_begin(void) {
+  g_faults.auth_started = major_faults();
+  g_faults.auth_started_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+/**
+ * @brief Marks the end of an authentication attempt.
+ */
+void stats_auth_end(void) {
+  g_faults.auth += major_faults() - g_faults.auth_started;
+  g_faults.auth_ns += clock_ns(CLOCK_MONOTONIC) - g_faults.auth_started_ns;
+  g_faults.attempts++;
+}
+
+/**
+ * @brief Prints the counters for the lock that just ended.
+ */
+void stats_lock_end(void) {
+  account();
+  g_locked = 0;
+  printf("Lock statistics:\n");
+  print_bucket("on", &g_buckets[1]);
+  print_bucket("off", &g_buckets[0]);
+  print_totals();
+  print_coverage();
+  print_faults();
+  fflush(stdout);
+}
+
+/**
+ * @brief Formats the counters of the current (or last) lock on one line,
+ *        for the control socket. Main thread only.
+ *
+ * @param buffer Receives the text.
+ * @param size Size of buffer.
+ */
+void stats_format(char *buffer, size_t size) {
+  if (g_locked) {
+    account();
+  }
+  int64_t wall_ns = g_buckets[0].wall_ns + g_buckets[1].wall_ns;
+  int64_t cpu_ns = g_buckets[0].cpu_ns + g_buckets[1].cpu_ns;
+  long wakeups = g_buckets[0].wakeups + g_buckets[1].wakeups;
+  long frames = g_buckets[0].frames + g_buckets[1].frames;
+  unsigned long x_requests = g_buckets[0].x_requests + g_buckets[1].x_requests;
+  snprintf(buffer, size,
+           "locked=%d seconds=%.1f displays_off_seconds=%.1f wakeups=%ld "
+           "frames=%ld x_requests=%lu cpu_seconds=%.3f "
+           "low_power_seconds=%.1f exposed_ms=%.1f faults_to_cover=%ld "
+           "auth_attempts=%d",
+           g_locked, (double)wall_ns / 1e9,
+           (double)g_buckets[0].wall_ns / 1e9, wakeups, frames, x_requests,
+           (double)cpu_ns / 1e9, (double)g_low_power_ns / 1e9,
+           (double)g_exposed_ns / 1e6, g_faults.to_cover, g_faults.attempts);
+}
@@ -0,0 +1,29 @@
+#ifndef STATS_H
+#define STATS_H
+
+/**
+ * @file stats.h
+ * @brief Declarations for the per-lock wakeup, CPU and power-mode counters.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+void stats_lock_start(void);
+void stats_wakeup(void);
+void stats_frame(unsigned long x_requests);
+void stats_display_power(int on);
+void stats_low_power(int low_power);
+void stats_lock_presented(void);
+void stats_lock_covered(int64_t exposed_ns);
+void stats_background_refined(int64_t refined_ns);
+void stats_auth_begin(void);
+void stats_auth_end(void);
+void stats_lock_end(void);
+void stats_format(char *buffer, size_t size);
+
+#endif /* STATS_H */
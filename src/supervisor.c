@@ -0,0 +1,262 @@
+/**
+ * @file supervisor.c
+ * @brief Runs one lockscreen per X display from a single daemon, for
+ *        terminal servers hosting many (e.g. Xvnc) sessions.
+ *
+ * Started with "--displays :1,:2,...", the supervisor connects to every
+ * display once to learn its screen sizes, decodes the background image a
+ * single time for each distinct size (see shared_background.c), and then
+ * forks one lockscreen per display. Each child has its own connection, idle
+ * tracking and lock state exactly as in single-display mode, while the
+ * decoded pixels are shared between all of them. Children that crash are
+ * restarted; termination signals are forwarded.
+ */
+
+#include "supervisor.h"
+#include "config.h"
+#include "graphics/shared_background.h"
+#include "graphics/slideshow.h"
+#include "utils.h"
+#include <X11/Xlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* Constants                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const int MAX_DISPLAYS = 256;
+/* Pause before restarting a crashed child, so a crash loop stays cheap. */
+static const unsigned int RESPAWN_DELAY_S = 1;
+
+/* ------------------------------------------------------------------------- */
+/* Structure Definitions                                                     */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief The lockscreen process serving one display.
+ */
+struct Child {
+  char display[64]; /**< Display name, e.g. ":1". */
+  pid_t pid;        /**< Running process, or 0. */
+};
+
+/* ------------------------------------------------------------------------- */
+/* Global Variables                                                          */
+/* ------------------------------------------------------------------------- */
+
+static struct Child *g_children = NULL;
+static int g_child_count = 0;
+static volatile sig_atomic_t g_stopping = 0;
+
+/* ------------------------------------------------------------------------- */
+/* Static Helper Functions                                                   */
+/* ------------------------------------------------------------------------- */
+
+static void handle_stop(int signal __attribute__((unused))) { g_stopping = 1; }
+
+/**
+ * @brief Splits the comma-separated display list into g_children.
+ *
+ * @return 0 on success, -1 if the list is empty or invalid.
+ */
+static int parse_display_list(const char *list) {
+  g_children = calloc((size_t)MAX_DISPLAYS, sizeof(*g_children));
+  if (!g_children) {
+    return -1;
+  }
+
+  const char *start = list;
+  while (*start != '\0' && g_child_count < MAX_DISPLAYS) {
+    size_t len = strcspn(start, ",");
+    if (len > 0 && len < sizeof(g_children[0].display)) {
+      memcpy(g_children[g_child_count].display, start, len);
+      g_children[g_child_count].display[len] = '\0';
+      g_child_count++;
+    } else if (len > 0) {
+      fprintf(stderr, "Warning: display name '%.*s' is too long.\n",
+              (int)len, start);
+    }
+    start += len;
+    if (*start == ',') {
+      start++;
+    }
+  }
+  return (g_child_count > 0) ? 0 : -1;
+}
+
+/**
+ * @brief Connects to every display to collect the screen sizes backgrounds
+ *        are needed for.
+ *
+ * @param count Receives the number of sizes.
+ * @return A malloc'ed array (possibly with duplicates), or NULL.
+ */
+static struct BackgroundSize *probe_screen_sizes(int *count) {
+  int capacity = 0;
+  struct BackgroundSize *sizes = NULL;
+  *count = 0;
+
+  for (int i = 0; i < g_child_count; i++) {
+    Display *display = XOpenDisplay(g_children[i].display);
+    if (!display) {
+      fprintf(stderr, "Warning: cannot open display %s.\n",
+              g_children[i].display);
+      continue;
+    }
+
+    int screens = 0;
+    XineramaScreenInfo *info = query_screens(display, &screens);
+    for (int s = 0; s < screens; s++) {
+      if (*count == capacity) {
+        capacity = capacity ? capacity * 2 : 16;
+        struct BackgroundSize *grown =
+            realloc(sizes, (size_t)capacity * sizeof(*sizes));
+        if (!grown) {
+          break;
+        }
+        sizes = grown;
+      }
+      sizes[*count].width = info[s].width;
+      sizes[*count].height = info[s].height;
+      (*count)++;
+    }
+    if (info) {
+      XFree(info);
+    }
+    XCloseDisplay(display);
+  }
+  return sizes;
+}
+
+/**
+ * @brief Forks the lockscreen process for one display.
+ *
+ * @return 0 in the new child, 1 in the supervisor, -1 on failure.
+ */
+static int start_child(struct Child *child) {
+  /* Otherwise buffered output would be printed by both processes. */
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    /* Don't outlive the supervisor. */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    setenv("DISPLAY", child->display, 1);
+    return 0;
+  }
+  child->pid = pid;
+  return 1;
+}
+
+static struct Child *find_child(pid_t pid) {
+  for (int i = 0; i < g_child_count; i++) {
+    if (g_children[i].pid == pid) {
+      return &g_children[i];
+    }
+  }
+  return NULL;
+}
+
+static void signal_children(int signal) {
+  for (int i = 0; i < g_child_count; i++) {
+    if (g_children[i].pid > 0) {
+      kill(g_children[i].pid, signal);
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Public Functions                                                          */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Starts one lockscreen per display and supervises them.
+ *
+ * Must be called after load_options() and before any thread is started or
+ * display opened. Returns only in the children (with $DISPLAY set to their
+ * display), which then carry on as a normal single-display lockscreen; the
+ * supervisor itself exits once every child has.
+ *
+ * @param display_list Comma-separated display names.
+ * @return 0 in a child, -1 if the list is invalid.
+ */
+int run_supervisor(const char *display_list) {
+  if (parse_display_list(display_list) != 0) {
+    fprintf(stderr, "No displays given to --displays.\n");
+    return -1;
+  }
+
+  struct Options options;
+  get_options(&options);
+  int size_count = 0;
+  struct BackgroundSize *sizes = probe_screen_sizes(&size_count);
+  /* Each process rotates its own slideshow. */
+  if (!slideshow_source(options.image)) {
+    shared_backgrounds_create(options.image, sizes, size_count);
+  }
+  free(sizes);
+
+  /* Not SA_RESTART: waitpid() must return so the signal can be forwarded. */
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  for (int i = 0; i < g_child_count; i++) {
+    if (start_child(&g_children[i]) == 0) {
+      return 0;
+    }
+  }
+
+  int forwarded = 0;
+  for (;;) {
+    if (g_stopping && !forwarded) {
+      signal_children(SIGTERM);
+      forwarded = 1;
+    }
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break; /* ECHILD: every child is gone. */
+    }
+
+    struct Child *child = find_child(pid);
+    if (!child) {
+      continue;
+    }
+    child->pid = 0;
+    if (g_stopping || !WIFSIGNALED(status)) {
+      /* A clean exit (e.g. the display went away) is final. */
+      continue;
+    }
+
+    fprintf(stderr, "Lockscreen for %s died (signal %d); restarting it.\n",
+            child->display, WTERMSIG(status));
+    sleep(RESPAWN_DELAY_S);
+    if (!g_stopping && start_child(child) == 0) {
+      return 0;
+    }
+  }
+
+  shared_backgrounds_release();
+  free(g_children);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,16 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+/**
+ * @file supervisor.h
+ * @brief Declarations for running one lockscreen per X display from a
+ *        single daemon.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Function Declarations                                                     */
+/* ------------------------------------------------------------------------- */
+
+int run_supervisor(const char *display_list);
+
+#endif /* SUPERVISOR_H */
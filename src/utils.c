@@ -6,12 +6,14 @@
 #include "utils.h"
 #include "graphics/graphics.h"
 #include "lockscreen.h"
+#include "profile.h"
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <cairo/cairo.h>
 #include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /**
@@ -50,17 +52,19 @@ int get_opposite_color(int color) {
 }
 
 /**
- * @brief Determines and sets the text color in `screen_configs->text_color`
- *        based on average image brightness or a default color.
+ * @brief Picks the text color for an image from its average brightness, or
+ *        for a default color.
  *
  * If the average of the image's pixels is below the midpoint, the text color
- * is set to 255; otherwise it remains 0 (unless overridden by logic below).
+ * is 255; otherwise it is 0 (unless overridden by logic below). Only reads
+ * the image, so it is safe to call from worker threads.
  *
  * @param img The Cairo surface representing the image.
  * @param width The width of the image.
  * @param height The height of the image.
+ * @return The text color, 0 or 255.
  */
-void determine_text_color(cairo_surface_t *img, int width, int height) {
+int text_color_for_image(cairo_surface_t *img, int width, int height) {
   /* Default color used if no image is provided. */
   char default_color_hex[] = "a3a3a3";
   int text_color = 0; /* Default to black-ish if no reasons to invert. */
@@ -124,10 +128,21 @@ void determine_text_color(cairo_surface_t *img, int width, int height) {
       text_color = 255;
     }
   }
+  return text_color;
+}
 
+/**
+ * @brief Determines and sets the text color in `screen_configs->text_color`
+ *        based on average image brightness or a default color.
+ *
+ * @param img The Cairo surface representing the image.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ */
+void determine_text_color(cairo_surface_t *img, int width, int height) {
   /* Apply to the first screen_config. If multiple screens are used,
      you can adapt logic to apply individually per screen. */
-  screen_configs[0].text_color = text_color;
+  screen_configs[0].text_color = text_color_for_image(img, width, height);
 }
 
 /**
@@ -161,3 +176,32 @@ void determine_text_color_for_color(double r, double g, double b) {
     screen_configs[0].text_color = 0; // Black
   }
 }
+
+/**
+ * @brief Lists the monitors to cover, one per Xinerama screen. Without
+ *        Xinerama (not running, or compiled out of a static profile) the
+ *        default screen is covered as a single monitor.
+ *
+ * @param display The display to query.
+ * @param count Receives the number of screens.
+ * @return The screens, to be released with XFree(), or NULL on failure.
+ */
+XineramaScreenInfo *query_screens(Display *display, int *count) {
+#if PROFILE_XINERAMA
+  XineramaScreenInfo *info = XineramaQueryScreens(display, count);
+  if (info) {
+    return info;
+  }
+#endif
+  /* XFree() is plain free(), so callers need not know which path ran. */
+  XineramaScreenInfo *single = calloc(1, sizeof(*single));
+  if (!single) {
+    *count = 0;
+    return NULL;
+  }
+  int screen = DefaultScreen(display);
+  single->width = (short)DisplayWidth(display, screen);
+  single->height = (short)DisplayHeight(display, screen);
+  *count = 1;
+  return single;
+}
@@ -3,9 +3,12 @@
 
 /**
  * @file utils.h
- * @brief Utility functions for color handling and text color determination.
+ * @brief Utility functions for color handling, text color determination and
+ *        screen layout.
  */
 
+#include <X11/Xlib.h>
+#include <X11/extensions/Xinerama.h>
 #include <cairo/cairo.h>
 #include <stdint.h>
 
@@ -15,7 +18,9 @@
 
 unsigned long hex_color_to_pixel(char *hex_color, int screen_num);
 int get_opposite_color(int color);
+int text_color_for_image(cairo_surface_t *img, int width, int height);
 void determine_text_color(cairo_surface_t *img, int width, int height);
 void determine_text_color_for_color(double r, double g, double b);
+XineramaScreenInfo *query_screens(Display *display, int *count);
 
 #endif /* UTILS_H */